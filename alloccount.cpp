@@ -0,0 +1,94 @@
+#include "alloccount.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifndef NDEBUG
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+thread_local bool excluded = false;
+
+void* countedAlloc(std::size_t size) {
+    if (!excluded)
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    // malloc(0) is allowed to return nullptr, operator new isn't
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* countedAlignedAlloc(std::size_t size, std::size_t alignment) {
+    if (!excluded)
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    if (alignment < sizeof(void*))
+        alignment = sizeof(void*);
+    // aligned_alloc wants the size to be a multiple of the alignment
+    size = (size + alignment - 1) / alignment * alignment;
+    void* p = std::aligned_alloc(alignment, size ? size : alignment);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+}
+
+void* operator new(std::size_t size) { return countedAlloc(size); }
+void* operator new[](std::size_t size) { return countedAlloc(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return countedAlloc(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return countedAlloc(size); } catch (...) { return nullptr; }
+}
+
+void* operator new(std::size_t size, std::align_val_t al) {
+    return countedAlignedAlloc(size, static_cast<std::size_t>(al));
+}
+void* operator new[](std::size_t size, std::align_val_t al) {
+    return countedAlignedAlloc(size, static_cast<std::size_t>(al));
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+uint64_t allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void assertNoAllocationsSince(uint64_t startCount) {
+    uint64_t count = allocationCount() - startCount;
+    if (count != 0) {
+        std::fprintf(stderr,
+                     "ERROR::ALLOC::STEADY_STATE\n%llu heap allocation(s) "
+                     "during a steady-state frame\n",
+                     static_cast<unsigned long long>(count));
+    }
+    assert(count == 0);
+}
+
+void excludeThreadFromAllocationCount() {
+    excluded = true;
+}
+
+#else
+
+uint64_t allocationCount() {
+    return 0;
+}
+
+void assertNoAllocationsSince(uint64_t) {}
+
+void excludeThreadFromAllocationCount() {}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+#include <cstdint>
+
+// In debug builds (NDEBUG not defined) alloccount.cpp replaces the global
+// operator new/delete with versions that count every allocation. Gameplay is
+// supposed to run entirely out of pools and the frame arena once it has warmed
+// up, so the main loop takes a snapshot of the counter at the start of each
+// frame and asserts that it hasn't moved by the end. In release builds the
+// counter always reads 0 and the check compiles away.
+uint64_t allocationCount();
+
+// Call once per frame, after warm-up, with the count taken at the start of the
+// frame. Prints how many allocations happened and asserts if any did.
+void assertNoAllocationsSince(uint64_t startCount);
+
+// Stop counting allocations made on the calling thread. For background
+// threads that don't run any part of a frame, like the session writer, whose
+// allocations would otherwise land in whatever frame is being checked.
+void excludeThreadFromAllocationCount();
+
+#endif
@@ -0,0 +1,37 @@
+#include "arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+FrameArena::FrameArena(std::size_t capacity)
+    : buffer(static_cast<unsigned char*>(std::malloc(capacity))),
+      size(buffer ? capacity : 0), offset(0), peak(0) {}
+
+FrameArena::~FrameArena() {
+    std::free(buffer);
+}
+
+void* FrameArena::allocate(std::size_t bytes, std::size_t alignment) {
+    // round the current position up to the requested alignment (alignment is
+    // always a power of two)
+    std::uintptr_t base = reinterpret_cast<std::uintptr_t>(buffer);
+    std::uintptr_t aligned = (base + offset + alignment - 1) & ~(alignment - 1);
+    std::size_t start = aligned - base;
+
+    if (start + bytes > size)
+        return nullptr;
+
+    offset = start + bytes;
+    if (offset > peak)
+        peak = offset;
+    return buffer + start;
+}
+
+void FrameArena::reset() {
+    offset = 0;
+}
+
+void FrameArena::rewind(std::size_t mark) {
+    if (mark < offset)
+        offset = mark;
+}
@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+// Linear ("bump") allocator for data that only has to live for one frame:
+// transient events, scratch arrays, etc. The backing buffer is allocated once
+// up front and every allocation just moves an offset forward. Nothing is ever
+// freed individually; instead reset() is called once at the start of each
+// frame and everything handed out during the previous frame is gone.
+//
+// Work that runs many times a frame (sim ticks) can hand its scratch back
+// as it goes: take used() before, rewind() to it after.
+class FrameArena {
+public:
+    explicit FrameArena(std::size_t capacity);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Returns nullptr if the arena is out of space. Nothing is constructed,
+    // so only use this for trivially constructible data.
+    void* allocate(std::size_t size,
+                   std::size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocateArray(std::size_t count) {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    void reset();
+    // Free everything allocated since used() returned mark.
+    void rewind(std::size_t mark);
+
+    std::size_t used() const { return offset; }
+    std::size_t capacity() const { return size; }
+    // The most that was ever in use at once; handy for sizing the arena.
+    std::size_t highWater() const { return peak; }
+
+private:
+    unsigned char* buffer;
+    std::size_t size;
+    std::size_t offset;
+    std::size_t peak;
+};
+
+#endif
@@ -0,0 +1,1148 @@
+#include "bench.h"
+#include "alloccount.h"
+#include "codec.h"
+#include "commandbuffer.h"
+#include "cull.h"
+#include "export.h"
+#include "heatmap.h"
+#include "history.h"
+#include "mesh.h"
+#include "motion.h"
+#include "particles.h"
+#include "particleview.h"
+#include "recorder.h"
+#include "replay.h"
+#include "resolution.h"
+#include "sim.h"
+#include "sweep.h"
+#include "targetview.h"
+#include "vertexformat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BENCH_F16C
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+long fileSize(const char* path) {
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f)
+        return 0;
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    std::fclose(f);
+    return size;
+}
+
+// A made-up player: sweeps the view around and clicks every few hundred
+// milliseconds. Good enough to exercise hits, misses and spawns.
+SimInput scriptedInput(uint32_t tick) {
+    SimInput input;
+    float t = tick * SIM_DT;
+    input.yaw = 0.35f * std::sin(t * 1.7f) + 0.1f * std::sin(t * 5.3f);
+    input.pitch = 0.18f * std::cos(t * 1.3f);
+    input.fire = tick % 60 == 0;
+    input.fireAge = 0.0f;
+    input.fireYaw = input.yaw;
+    input.firePitch = input.pitch;
+    return input;
+}
+
+// Simulate and record a session of `ticks` ticks to path, resetting the
+// frame arena every ticksPerFrame ticks like the game does once a frame.
+void recordScriptedSession(const char* path, const SimConfig& config,
+                           uint32_t ticks, uint32_t snapshotInterval,
+                           uint32_t ticksPerFrame = 1) {
+    std::unique_ptr<SimState> sim(new SimState());
+    FrameArena frameArena(4 << 20);
+    simInit(*sim, config);
+
+    SessionRecorder recorder;
+    recorder.open(path, 0, &config, sizeof(config));
+    for (uint32_t i = 0; i < ticks; i++) {
+        if (i % ticksPerFrame == 0)
+            frameArena.reset();
+        SimInput input = scriptedInput(sim->tick);
+        uint32_t tick = sim->tick;
+        simUpdate(*sim, input, frameArena, nullptr);
+        recordTick(recorder, *sim, input, tick, uint64_t(tick) * 1000000 / SIM_TICK_RATE);
+
+        // This runs far faster than real time, so give the writer a chance
+        // to catch up instead of letting snapshots get skipped.
+        while (recorder.snapshotBusy())
+            std::this_thread::yield();
+        recordSnapshot(recorder, *sim, snapshotInterval);
+    }
+    recorder.close();
+}
+
+/// ~~~ Replay determinism ~~~
+
+// Replays must come out the same however the game's frames split the ticks
+// up. Record as if every frame were a 0.25 s hitch (the most ticks the game
+// runs in one frame), with bouncing targets and expiry so every kind of sim
+// scratch is in use, and replay it.
+bool checkReplay() {
+    std::printf("\n== replay check: 60 ticks a frame against a replay ==\n");
+    const char* path = "bench_check.mlog";
+    SimConfig config = defaultSimConfig();
+    config.bouncing = 1;
+    config.activeTargets = 2048;
+    config.targetLifetime = 1.5f;
+    recordScriptedSession(path, config, 10 * SIM_TICK_RATE, 0, SIM_TICK_RATE / 4);
+
+    SessionLog log;
+    ReplayResult result;
+    bool ok = readSessionLog(path, log) && replaySession(log, result) && result.matches;
+    std::remove(path);
+    if (ok)
+        std::printf("OK      ticks=%u hits=%u misses=%u\n", result.ticks, result.hits,
+                    result.misses);
+    else
+        std::printf("FAILED  mismatches=%u\n", result.mismatches);
+    return ok;
+}
+
+/// ~~~ Replay seeking ~~~
+
+void benchSeek() {
+    std::printf("\n== replay seek: time to seek to a random tick ==\n");
+    std::printf("%10s %10s %12s %12s %12s %14s\n", "session", "interval",
+                "file KB", "avg ms", "max ms", "avg ticks sim");
+
+    const char* path = "bench_seek.mlog";
+    const uint32_t lengths[] = {10, 60, 300};
+    const uint32_t intervals[] = {0, 10 * SIM_TICK_RATE, 2 * SIM_TICK_RATE, SIM_TICK_RATE / 2};
+    const int seeks = 50;
+
+    SimConfig config = defaultSimConfig();
+    for (uint32_t seconds : lengths) {
+        for (uint32_t interval : intervals) {
+            uint32_t ticks = seconds * SIM_TICK_RATE;
+            recordScriptedSession(path, config, ticks, interval);
+
+            SessionLog log;
+            ReplayPlayer player;
+            if (!readSessionLog(path, log) || !player.load(log))
+                continue;
+
+            // jump around the session like someone scrubbing a timeline
+            uint32_t rng = 0x1234567u;
+            double total = 0.0, worst = 0.0;
+            uint64_t simulated = 0;
+            bool failed = false;
+            for (int i = 0; i < seeks && !failed; i++) {
+                rng = rng * 1664525u + 1013904223u;
+                uint32_t target = (rng >> 8) % ticks;
+                Clock::time_point start = Clock::now();
+                failed = !player.seek(target);
+                double ms = millisecondsSince(start);
+                total += ms;
+                worst = ms > worst ? ms : worst;
+                simulated += player.lastSeekTicks();
+            }
+
+            if (failed) {
+                std::printf("%9us %10u   snapshot restore failed\n", seconds, interval);
+                continue;
+            }
+            std::printf("%9us %10u %12.1f %12.3f %12.3f %14llu\n", seconds, interval,
+                        fileSize(path) / 1024.0, total / seeks, worst,
+                        static_cast<unsigned long long>(simulated / seeks));
+        }
+    }
+    std::remove(path);
+}
+
+/// ~~~ Replay encoding ~~~
+
+bool sameRecord(const SessionRecord& a, const SessionRecord& b) {
+    // values compared as bits, since the codec promises a lossless round trip
+    return a.type == b.type && a.tick == b.tick && a.timeUs == b.timeUs &&
+           a.subject == b.subject && std::memcmp(a.values, b.values, sizeof(a.values)) == 0;
+}
+
+// Decode path again and compare every record and snapshot with the log it
+// was encoded from.
+bool roundTrips(const char* path, const SessionLog& log) {
+    ReplayDecoder decoder;
+    if (!decoder.open(path))
+        return false;
+    SessionRecord record;
+    LogSnapshot snapshot;
+    std::size_t records = 0, snapshots = 0;
+    for (;;) {
+        ReplayDecoder::Item item = decoder.next(record, snapshot);
+        if (item == ReplayDecoder::Record) {
+            if (records >= log.records.size() || !sameRecord(record, log.records[records]))
+                return false;
+            records++;
+        } else if (item == ReplayDecoder::Snapshot) {
+            if (snapshots >= log.snapshots.size() ||
+                snapshot.tick != log.snapshots[snapshots].tick ||
+                snapshot.data != log.snapshots[snapshots].data)
+                return false;
+            snapshots++;
+        } else {
+            return item == ReplayDecoder::End && records == log.records.size() &&
+                   snapshots == log.snapshots.size();
+        }
+    }
+}
+
+// Also a check: every encoding must decode back to exactly the log it came
+// from.
+bool benchCodec() {
+    std::printf("\n== replay encoding: size and decode speed ==\n");
+    std::printf("%10s %8s %12s %12s %8s %12s %12s %14s %11s\n", "session", "blocks",
+                "raw KB", "encoded KB", "ratio", "encode ms", "decode ms",
+                "decode x real", "round trip");
+
+    const char* rawPath = "bench_codec.mlog";
+    const char* encodedPath = "bench_codec.mrz";
+    const uint32_t lengths[] = {60, 300};
+
+    bool ok = true;
+    SimConfig config = defaultSimConfig();
+    for (uint32_t seconds : lengths) {
+        uint32_t ticks = seconds * SIM_TICK_RATE;
+        recordScriptedSession(rawPath, config, ticks, 10 * SIM_TICK_RATE);
+        SessionLog log;
+        if (!readSessionLog(rawPath, log)) {
+            std::printf("%9us   recording unreadable FAILED\n", seconds);
+            ok = false;
+            continue;
+        }
+
+        BlockCompression modes[] = {BlockCompression::None, BlockCompression::Zstd};
+        for (BlockCompression mode : modes) {
+            if (mode == BlockCompression::Zstd && !blockCompressionAvailable())
+                continue;
+
+            Clock::time_point start = Clock::now();
+            writeCompressedReplay(encodedPath, log, mode);
+            double encodeMs = millisecondsSince(start);
+
+            // decode the way a player would: streaming, one item at a time
+            start = Clock::now();
+            ReplayDecoder decoder;
+            SessionRecord record;
+            LogSnapshot snapshot;
+            if (decoder.open(encodedPath)) {
+                ReplayDecoder::Item item;
+                do {
+                    item = decoder.next(record, snapshot);
+                } while (item == ReplayDecoder::Record || item == ReplayDecoder::Snapshot);
+            }
+            double decodeMs = millisecondsSince(start);
+
+            bool same = roundTrips(encodedPath, log);
+            ok = ok && same;
+
+            double rawKb = fileSize(rawPath) / 1024.0;
+            double encodedKb = fileSize(encodedPath) / 1024.0;
+            std::printf("%9us %8s %12.1f %12.1f %7.1fx %12.2f %12.2f %14.0f %11s\n", seconds,
+                        mode == BlockCompression::Zstd ? "zstd" : "none", rawKb, encodedKb,
+                        rawKb / encodedKb, encodeMs, decodeMs,
+                        decodeMs > 0.0 ? seconds * 1000.0 / decodeMs : 0.0,
+                        same ? "OK" : "FAILED");
+        }
+    }
+    std::remove(rawPath);
+    std::remove(encodedPath);
+    return ok;
+}
+
+
+/// ~~~ History queries ~~~
+
+// A heavy player: a session every 20 minutes, cycling scenarios, accuracy
+// slowly improving.
+void fillHistory(HistoryDb& db, int64_t start, uint32_t sessions, uint32_t scenarios) {
+    for (uint32_t i = 0; i < sessions; i++) {
+        SessionSummary row = {};
+        row.startTime = start + int64_t(i) * 1200;
+        row.scenario = i % scenarios;
+        float trend = float(i) / sessions;
+        row.values[uint32_t(HistoryColumn::Accuracy) - 2] =
+            0.4f + 0.3f * trend + 0.05f * std::sin(i * 0.37f);
+        row.values[uint32_t(HistoryColumn::Duration) - 2] = 60.0f;
+        row.values[uint32_t(HistoryColumn::Shots) - 2] = float(100 + i % 50);
+        db.append(row);
+    }
+}
+
+void benchHistory() {
+    std::printf("\n== history: weekly accuracy for one scenario ==\n");
+    std::printf("%10s %8s %12s %10s %10s %12s %12s\n", "sessions", "blocks",
+                "file KB", "scanned", "skipped", "all ms", "recent ms");
+
+    const char* path = "bench_history.db";
+    const uint32_t sizes[] = {1000, 20000, 100000};
+    const int64_t week = 7 * 24 * 3600;
+    const uint32_t scenarios = 8;
+    const int queries = 20;
+
+    for (uint32_t sessions : sizes) {
+        std::remove(path);
+        HistoryDb db;
+        if (!db.open(path))
+            return;
+
+        int64_t start = 1700000000;
+        fillHistory(db, start, sessions, scenarios);
+        int64_t end = start + int64_t(sessions) * 1200;
+
+        HistoryBucket buckets[1024];
+        HistoryScanStats scan = {};
+        HistoryFilter all = {start, end, false, 3};
+        Clock::time_point begin = Clock::now();
+        for (int q = 0; q < queries; q++)
+            db.aggregate(HistoryColumn::Accuracy, all, week, buckets, 1024, &scan);
+        double allMs = millisecondsSince(begin) / queries;
+
+        // the last four weeks only: zone maps skip almost every block
+        HistoryFilter recent = {end - 4 * week, end, false, 3};
+        HistoryScanStats recentScan = {};
+        begin = Clock::now();
+        for (int q = 0; q < queries; q++)
+            db.aggregate(HistoryColumn::Accuracy, recent, week, buckets, 4, &recentScan);
+        double recentMs = millisecondsSince(begin) / queries;
+
+        std::printf("%10u %8u %12.1f %5u/%-4u %5u/%-4u %12.3f %12.3f\n", sessions,
+                    db.blocks(), fileSize(path) / 1024.0, scan.blocksScanned,
+                    recentScan.blocksScanned, scan.blocksSkipped,
+                    recentScan.blocksSkipped, allMs, recentMs);
+        db.close();
+    }
+    std::remove(path);
+}
+
+
+/// ~~~ Flick analysis ~~~
+
+// A synthetic raw mouse stream at `rate` Hz: a flick to a new spot every
+// 700 ms that overshoots by 10% and pulls back, a shot once it settles, and
+// a little sensor noise throughout.
+void syntheticFlicks(MouseStream& stream, std::vector<uint64_t>& shots,
+                     uint32_t seconds, uint32_t rate) {
+    stream.clear();
+    shots.clear();
+    const uint64_t periodUs = 700000;
+    const float flickSeconds = 0.15f, returnSeconds = 0.12f;
+    uint32_t samples = seconds * rate;
+    float lastX = 0.0f, lastY = 0.0f;
+    uint64_t lastFlick = 0;
+    bool shot = false;
+    uint32_t noise = 12345;
+    for (uint32_t i = 0; i < samples; i++) {
+        uint64_t t = uint64_t(i) * 1000000 / rate;
+        uint64_t flick = t / periodUs;
+        float local = (t % periodUs) * 1e-6f;
+        // flick direction and size change every period
+        float angle = flick * 2.39996f;
+        float size = 0.1f + 0.25f * ((flick * 7919) % 100) / 100.0f;
+
+        // minimum-jerk ease to 110% of the flick, then back to 100%
+        auto ease = [](float u) {
+            u = std::min(std::max(u, 0.0f), 1.0f);
+            return u * u * u * (10.0f + u * (-15.0f + 6.0f * u));
+        };
+        float progress = 1.1f * ease(local / flickSeconds) -
+                         0.1f * ease((local - flickSeconds) / returnSeconds);
+        float x = size * progress * std::cos(angle);
+        float y = size * progress * std::sin(angle);
+        // each flick starts from where the last one ended
+        if (flick != lastFlick) {
+            lastX = lastY = 0.0f;
+            lastFlick = flick;
+            shot = false;
+        }
+
+        noise = noise * 1664525u + 1013904223u;
+        float jitter = ((noise >> 8) / 16777216.0f - 0.5f) * 2e-5f;
+        stream.add(t, x - lastX + jitter, y - lastY - jitter);
+        lastX = x;
+        lastY = y;
+
+        if (!shot && local >= 0.4f) {
+            shots.push_back(t);
+            shot = true;
+        }
+    }
+}
+
+void benchMotion() {
+    std::printf("\n== flick analysis: raw 8 kHz mouse stream ==\n");
+    std::printf("%10s %10s %8s %8s %8s %11s %12s %12s\n", "session", "samples",
+                "shots", "flicks", "other", "overshoot", "analyze ms", "x real");
+
+    const uint32_t lengths[] = {60, 300, 1200};
+    const uint32_t rate = 8000;
+    MouseStream stream;
+    std::vector<uint64_t> shots;
+    std::vector<ShotSegment> segments;
+    MotionAnalyzer analyzer;
+    MotionConfig config = defaultMotionConfig();
+    for (uint32_t seconds : lengths) {
+        syntheticFlicks(stream, shots, seconds, rate);
+        // first run sizes the scratch buffers
+        analyzer.analyze(stream, shots.data(), uint32_t(shots.size()), config, segments);
+        Clock::time_point start = Clock::now();
+        analyzer.analyze(stream, shots.data(), uint32_t(shots.size()), config, segments);
+        double ms = millisecondsSince(start);
+
+        MotionSummary s = summarizeMotion(segments);
+        std::printf("%9us %10u %8u %8u %8u %8.2fdeg %12.2f %12.0f\n", seconds,
+                    stream.size(), s.shots, s.flicks, s.corrections + s.still,
+                    s.flickOvershoot * 57.2957795f, ms,
+                    ms > 0.0 ? seconds * 1000.0 / ms : 0.0);
+    }
+}
+
+
+/// ~~~ Heatmaps ~~~
+
+void benchHeatmap() {
+    std::printf("\n== heatmaps: binning session logs ==\n");
+    std::printf("%10s %8s %10s %12s %12s\n", "sessions", "threads", "shots",
+                "ms", "sessions/s");
+
+    // a handful of real logs, each listed many times over
+    const uint32_t distinct = 8;
+    const uint32_t sessions = 512;
+    SimConfig config = defaultSimConfig();
+    std::vector<std::string> files, paths;
+    for (uint32_t i = 0; i < distinct; i++) {
+        files.push_back("bench_heatmap_" + std::to_string(i) + ".mlog");
+        config.seed = 1000 + i;
+        recordScriptedSession(files.back().c_str(), config, 30 * SIM_TICK_RATE, 0);
+    }
+    for (uint32_t i = 0; i < sessions; i++)
+        paths.push_back(files[i % distinct]);
+
+    std::unique_ptr<HeatmapSet> maps(new HeatmapSet());
+    const uint32_t threadCounts[] = {1, 0};
+    for (uint32_t threads : threadCounts) {
+        JobSystemConfig jobConfig;
+        jobConfig.threadCount = threads;
+        JobSystem jobs(jobConfig);
+        Clock::time_point start = Clock::now();
+        HeatmapStats stats;
+        buildHeatmaps(paths, true, 0, &jobs, *maps, &stats);
+        double ms = millisecondsSince(start);
+        std::printf("%10u %8u %10u %12.1f %12.0f\n", stats.sessions, jobs.threadCount(),
+                    maps->view.total[0] + maps->view.total[1], ms,
+                    ms > 0.0 ? stats.sessions * 1000.0 / ms : 0.0);
+    }
+    for (const std::string& file : files)
+        std::remove(file.c_str());
+}
+
+
+/// ~~~ Swept aim ~~~
+
+// Counts on-target ticks for a fast-flicking player in a crowded bouncing
+// scenario, with and without the swept test, then times the kernel alone on
+// bigger target counts.
+void benchSweep() {
+    std::printf("\n== swept aim: fast flicks over bouncing targets ==\n");
+    std::printf("%8s %10s %12s %12s\n", "swept", "ticks", "on target", "ms/tick");
+
+    SimConfig config = defaultSimConfig();
+    config.activeTargets = 48;
+    config.bouncing = 1;
+    config.targetSpeed = 12.0f;
+    config.targetRadius = 0.25f;
+    const uint32_t ticks = 30 * SIM_TICK_RATE;
+    std::unique_ptr<SimState> sim(new SimState());
+    FrameArena frameArena(4 << 20);
+    for (int swept = 0; swept < 2; swept++) {
+        simInit(*sim, config);
+        sim->sweptAim = swept != 0;
+        uint32_t onTarget = 0;
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < ticks; i++) {
+            frameArena.reset();
+            // the scripted sweep, sped up to flick speeds (several degrees
+            // a tick), never firing so the targets stay put
+            SimInput input = scriptedInput(sim->tick * 6);
+            input.fire = false;
+            simUpdate(*sim, input, frameArena, nullptr);
+            onTarget += sim->aim.onTarget;
+        }
+        double ms = millisecondsSince(start);
+        std::printf("%8s %10u %12u %12.4f\n", swept ? "yes" : "no", ticks, onTarget,
+                    ms / ticks);
+    }
+
+    std::printf("%8s %12s %12s\n", "targets", "ns/target", "crossed");
+    const uint32_t counts[] = {16, 256, 4096};
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> spread(-8.0f, 8.0f);
+    std::uniform_real_distribution<float> depth(-20.0f, -10.0f);
+    std::uniform_real_distribution<float> step(-0.05f, 0.05f);
+    for (uint32_t count : counts) {
+        std::vector<float> data(count * 7);
+        float* x0 = data.data();
+        float* y0 = x0 + count;
+        float* z0 = y0 + count;
+        float* x1 = z0 + count;
+        float* y1 = x1 + count;
+        float* z1 = y1 + count;
+        float* radius = z1 + count;
+        for (uint32_t i = 0; i < count; i++) {
+            x0[i] = spread(rng);
+            y0[i] = spread(rng) * 0.5f;
+            z0[i] = depth(rng);
+            x1[i] = x0[i] + step(rng);
+            y1[i] = y0[i] + step(rng);
+            z1[i] = z0[i] + step(rng);
+            radius[i] = 0.25f;
+        }
+        SweepTargets targets = {x0, y0, z0, x1, y1, z1, radius, count};
+
+        const uint32_t rounds = 1000000 / count + 1;
+        uint32_t crossed = 0;
+        Clock::time_point start = Clock::now();
+        for (uint32_t r = 0; r < rounds; r++) {
+            float yaw = 0.4f * std::sin(r * 0.37f);
+            CrosshairSweep sweep = makeCrosshairSweep(yaw, 0.0f, yaw + 0.06f, 0.02f);
+            crossed += sweepCrosshair(sweep, targets);
+        }
+        double ms = millisecondsSince(start);
+        std::printf("%8u %12.2f %12.1f\n", count, ms * 1e6 / (double(rounds) * count),
+                    double(crossed) / rounds);
+    }
+}
+
+
+/// ~~~ Culling ~~~
+
+// Targets scattered all around the player, with the view turning through
+// them. Survivors are written out as instances, as the renderer does.
+void benchCull() {
+    std::printf("\n== culling: targets against the view frustum ==\n");
+    std::printf("%8s %8s %10s %12s %12s\n", "targets", "threads", "visible", "us/frame",
+                "ns/target");
+
+    const uint32_t counts[] = {1024, 8192};
+    const uint32_t frames = 2000;
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> around(-80.0f, 80.0f);
+    std::uniform_real_distribution<float> height(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> size(0.2f, 1.0f);
+    FrameArena frameArena(4 << 20);
+    std::vector<TargetInstance> instances(MAX_TARGETS);
+    for (uint32_t count : counts) {
+        std::vector<float> data(count * 4);
+        float* x = data.data();
+        float* y = x + count;
+        float* z = y + count;
+        float* radius = z + count;
+        for (uint32_t i = 0; i < count; i++) {
+            x[i] = around(rng);
+            y[i] = height(rng);
+            z[i] = around(rng);
+            radius[i] = size(rng);
+        }
+        CullSpheres spheres = {x, y, z, radius, count};
+
+        const uint32_t threadCounts[] = {1, 0};
+        for (uint32_t threads : threadCounts) {
+            JobSystemConfig jobConfig;
+            jobConfig.threadCount = threads;
+            JobSystem jobs(jobConfig);
+            uint64_t visible = 0;
+            Clock::time_point start = Clock::now();
+            for (uint32_t frame = 0; frame < frames; frame++) {
+                frameArena.reset();
+                Camera camera = makeCamera(frame * 0.01f, 0.1f * std::sin(frame * 0.003f),
+                                           1.2f, 16.0f / 9.0f, 0.05f, 200.0f);
+                CullStats stats = cullSpheresParallel(
+                    cameraFrustum(camera), 100.0f, spheres, &jobs, frameArena,
+                    [&](uint32_t offset, const uint32_t* indices, uint32_t n) {
+                        for (uint32_t j = 0; j < n; j++) {
+                            uint32_t i = indices[j];
+                            TargetInstance& t = instances[offset + j];
+                            t.x = x[i];
+                            t.y = y[i];
+                            t.z = z[i];
+                            t.radius = radius[i];
+                        }
+                    });
+                visible += stats.visible;
+            }
+            double ms = millisecondsSince(start);
+            std::printf("%8u %8u %10.0f %12.2f %12.2f\n", count, jobs.threadCount(),
+                        double(visible) / frames, ms * 1000.0 / frames,
+                        ms * 1e6 / (double(frames) * count));
+        }
+    }
+}
+
+
+/// ~~~ Job graphs ~~~
+
+const uint32_t graphLayers = 12;
+const uint32_t graphWidth = 16;
+
+struct JobGraphRun {
+    std::atomic<uint32_t> sequence{0};
+    // order each job ran in, from 1
+    uint32_t ran[graphLayers * graphWidth];
+};
+
+void recordGraphJob(void* context, uint32_t job, uint32_t) {
+    JobGraphRun& run = *static_cast<JobGraphRun*>(context);
+    run.ran[job] = run.sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+// Layers of jobs where each waits on two in the layer before, submitted
+// last layer first so everything past the first layer is held back by its
+// dependencies. True if every job ran after both of its prerequisites.
+bool runJobGraph(JobSystem& jobs, JobGraphRun& run) {
+    Job* graph[graphLayers * graphWidth];
+    JobCounter counter;
+    run.sequence.store(0);
+    for (uint32_t i = 0; i < graphLayers * graphWidth; i++) {
+        run.ran[i] = 0;
+        graph[i] = jobs.allocateJob(recordGraphJob, &run, i, i + 1, &counter);
+    }
+    for (uint32_t layer = 1; layer < graphLayers; layer++) {
+        for (uint32_t i = 0; i < graphWidth; i++) {
+            Job* job = graph[layer * graphWidth + i];
+            jobs.addDependency(graph[(layer - 1) * graphWidth + i], job);
+            jobs.addDependency(graph[(layer - 1) * graphWidth + (i + 1) % graphWidth], job);
+        }
+    }
+    for (uint32_t i = graphLayers * graphWidth; i-- > 0;)
+        jobs.submit(graph[i]);
+    jobs.wait(counter);
+
+    for (uint32_t layer = 1; layer < graphLayers; layer++) {
+        for (uint32_t i = 0; i < graphWidth; i++) {
+            uint32_t job = run.ran[layer * graphWidth + i];
+            if (job == 0 || job < run.ran[(layer - 1) * graphWidth + i] ||
+                job < run.ran[(layer - 1) * graphWidth + (i + 1) % graphWidth])
+                return false;
+        }
+    }
+    return true;
+}
+
+// Submitted from a worker, graphs spread across the deques; from any other
+// thread, they run inline on that thread.
+bool checkJobGraphs() {
+    std::printf("\n== job graphs: %u layers of %u, two dependencies each ==\n",
+                graphLayers, graphWidth);
+    std::printf("%10s %8s %12s %8s\n", "from", "threads", "us/graph", "order");
+    const uint32_t runs = 500;
+    JobSystem jobs;
+    std::unique_ptr<JobGraphRun> run(new JobGraphRun());
+    bool ok = true;
+    for (int outside = 0; outside < 2; outside++) {
+        bool ordered = true;
+        double ms = 0.0;
+        auto all = [&]() {
+            Clock::time_point start = Clock::now();
+            for (uint32_t i = 0; i < runs; i++)
+                ordered = runJobGraph(jobs, *run) && ordered;
+            ms = millisecondsSince(start);
+        };
+        if (outside)
+            std::thread(all).join();
+        else
+            all();
+        std::printf("%10s %8u %12.2f %8s\n", outside ? "outside" : "worker",
+                    jobs.threadCount(), ms * 1000.0 / runs, ordered ? "OK" : "FAILED");
+        ok = ok && ordered;
+    }
+    return ok;
+}
+
+/// ~~~ Sim tick scaling ~~~
+
+void benchTickScaling() {
+    std::printf("\n== sim tick: bouncing targets across worker counts ==\n");
+    std::printf("%8s %8s %12s %10s %12s\n", "targets", "threads", "us/tick", "speedup",
+                "efficiency");
+
+    // A full arena of bouncing targets that never expire, in a box big
+    // enough that they aren't all touching.
+    SimConfig config = defaultSimConfig();
+    config.activeTargets = MAX_TARGETS;
+    config.bouncing = 1;
+    config.targetLifetime = 1e9f;
+    config.bounds = CollisionBounds{-60.0f, 60.0f, -30.0f, 30.0f, -150.0f, -30.0f};
+    const uint32_t warmupTicks = 60;
+    const uint32_t ticks = 500;
+
+    // 1, 2, 4, ... up to every hardware thread, and that count itself
+    uint32_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t n = 1; n < hardware; n *= 2)
+        threadCounts.push_back(n);
+    threadCounts.push_back(hardware);
+
+    std::unique_ptr<SimState> sim(new SimState());
+    FrameArena frameArena(4 << 20);
+    SimInput input = {};
+    double single = 0.0;
+    for (uint32_t threads : threadCounts) {
+        JobSystemConfig jobConfig;
+        jobConfig.threadCount = threads;
+        JobSystem jobs(jobConfig);
+        simInit(*sim, config);
+        for (uint32_t i = 0; i < warmupTicks; i++) {
+            frameArena.reset();
+            simUpdate(*sim, input, frameArena, &jobs);
+        }
+        Clock::time_point start = Clock::now();
+        for (uint32_t i = 0; i < ticks; i++) {
+            frameArena.reset();
+            simUpdate(*sim, input, frameArena, &jobs);
+        }
+        double us = millisecondsSince(start) * 1000.0 / ticks;
+        if (threads == 1)
+            single = us;
+        double speedup = single / us;
+        std::printf("%8u %8u %12.1f %9.2fx %11.0f%%\n", sim->world.size(),
+                    jobs.threadCount(), us, speedup, speedup / threads * 100.0);
+    }
+}
+
+/// ~~~ Particles ~~~
+
+void benchParticles() {
+    std::printf("\n== particles: update at a steady budget ==\n");
+    std::printf("%8s %10s %12s %12s %10s\n", "budget", "live", "us/frame", "ns/particle",
+                "dropped");
+
+    // bursts keep coming faster than particles die, so the pool sits at its
+    // budget and every frame pays for integration and compaction both
+    const uint32_t budgets[] = {1024, MAX_PARTICLES};
+    const uint32_t frames = 4000;
+    const float dt = 1.0f / 144.0f;
+    for (uint32_t budget : budgets) {
+        ParticleSystem particles;
+        particles.setBudget(budget);
+        ParticleBurst burst = hitBurst();
+        uint64_t live = 0;
+        double ms = 0.0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            for (uint32_t b = 0; b < 4; b++)
+                particles.emit(burst, b * 1.0f, 0.0f, -10.0f);
+            Clock::time_point start = Clock::now();
+            particles.update(dt);
+            ms += millisecondsSince(start);
+            live += particles.live();
+        }
+        double meanLive = double(live) / frames;
+        std::printf("%8u %10.0f %12.2f %12.2f %10llu\n", budget, meanLive,
+                    ms * 1000.0 / frames, ms * 1e6 / (double(frames) * meanLive),
+                    static_cast<unsigned long long>(particles.dropped()));
+    }
+}
+
+/// ~~~ Draw submission ~~~
+
+void benchCommands() {
+    std::printf("\n== draw submission: sorting packets by key ==\n");
+    std::printf("%8s %12s %12s %14s %14s\n", "packets", "sort us", "std us",
+                "switches in", "switches out");
+
+    const uint32_t counts[] = {16, 256, 1024, 1536, 4096};
+    const uint32_t rounds = 2000;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<uint32_t> programs(1, 12);
+    std::uniform_int_distribution<uint32_t> materials(1, 64);
+    std::uniform_real_distribution<float> depths(0.1f, 150.0f);
+    for (uint32_t count : counts) {
+        // a spread of opaque, blended and overlay packets, recorded in no
+        // particular order
+        std::vector<uint64_t> recorded(count);
+        std::vector<uint32_t> programOf(count);
+        for (uint32_t i = 0; i < count; i++) {
+            programOf[i] = programs(rng);
+            uint32_t kind = i % 8;
+            if (kind < 6)
+                recorded[i] = opaqueKey(programOf[i], materials(rng), depths(rng));
+            else if (kind < 7)
+                recorded[i] = blendedKey(programOf[i], materials(rng), depths(rng));
+            else
+                recorded[i] = overlayKey(i);
+        }
+
+        std::vector<uint64_t> keys(count), tmpKeys(count);
+        std::vector<uint32_t> values(count), tmpValues(count);
+        Clock::time_point start = Clock::now();
+        for (uint32_t r = 0; r < rounds; r++) {
+            keys = recorded;
+            for (uint32_t i = 0; i < count; i++)
+                values[i] = i;
+            radixSort(keys.data(), values.data(), count, tmpKeys.data(), tmpValues.data());
+        }
+        double radixMs = millisecondsSince(start);
+
+        std::vector<std::pair<uint64_t, uint32_t>> pairs(count);
+        start = Clock::now();
+        for (uint32_t r = 0; r < rounds; r++) {
+            for (uint32_t i = 0; i < count; i++)
+                pairs[i] = {recorded[i], i};
+            std::stable_sort(pairs.begin(), pairs.end(),
+                             [](const std::pair<uint64_t, uint32_t>& a,
+                                const std::pair<uint64_t, uint32_t>& b) {
+                                 return a.first < b.first;
+                             });
+        }
+        double stdMs = millisecondsSince(start);
+        for (uint32_t i = 0; i < count; i++) {
+            if (pairs[i].second != values[i]) {
+                std::printf("radix and std::stable_sort disagree at %u\n", i);
+                break;
+            }
+        }
+
+        uint32_t before = 0, after = 0;
+        for (uint32_t i = 1; i < count; i++) {
+            before += programOf[i] != programOf[i - 1];
+            after += programOf[values[i]] != programOf[values[i - 1]];
+        }
+        std::printf("%8u %12.2f %12.2f %14u %14u\n", count, radixMs * 1000.0 / rounds,
+                    stdMs * 1000.0 / rounds, before, after);
+    }
+}
+
+/// ~~~ Dynamic resolution ~~~
+
+void benchResolution() {
+    std::printf("\n== dynamic resolution: a modelled GPU against a 5 ms budget ==\n");
+    std::printf("%12s %10s %12s %12s %12s\n", "controller", "frames", "over budget",
+                "mean scale", "worst ms");
+
+    // Scene cost in ms: a fixed part plus a part that goes with the pixel
+    // count, under a load that swells for a second every few seconds (a wave
+    // of targets and effects), with some noise. Timings reach the
+    // controller three frames late, as GPU timer queries do.
+    const uint32_t frames = 144 * 60;
+    const float budget = 5.0f;
+    const uint32_t latency = 3;
+    for (int enabled = 0; enabled < 2; enabled++) {
+        ResolutionController controller(defaultResolutionConfig(budget));
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> noise(0.95f, 1.05f);
+        float inFlight[latency] = {};
+        uint32_t over = 0;
+        double scaleSum = 0.0;
+        float worst = 0.0f;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            float t = frame / 144.0f;
+            float load = std::fmod(t, 5.0f) < 1.0f ? 2.2f : 1.0f;
+            float scale = enabled ? controller.scale() : 1.0f;
+            float ms = (0.4f + 3.2f * load * scale * scale) * noise(rng);
+            over += ms > budget;
+            worst = std::max(worst, ms);
+            scaleSum += scale;
+
+            float arrived = inFlight[frame % latency];
+            inFlight[frame % latency] = ms;
+            if (enabled && frame >= latency)
+                controller.update(arrived);
+        }
+        std::printf("%12s %10u %12u %12.2f %12.2f\n", enabled ? "on" : "off", frames,
+                    over, scaleSum / frames, worst);
+    }
+}
+
+/// ~~~ Instance formats ~~~
+
+void benchInstances() {
+    std::printf("\n== instance formats: full against packed ==\n");
+    std::printf("%8s %8s %12s %12s %12s\n", "targets", "format", "bytes/inst", "KB/frame",
+                "ns/target");
+
+    // targets all over the arena, out to the draw distance
+    const uint32_t counts[] = {1024, 8192};
+    const uint32_t frames = 2000;
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> around(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> height(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> size(0.2f, 1.0f);
+    std::uniform_real_distribution<float> fade(0.4f, 1.0f);
+    std::vector<TargetInstance> full(counts[1]);
+    std::vector<PackedTargetInstance> packed(counts[1]);
+    std::vector<float> x(counts[1]), y(counts[1]), z(counts[1]), radius(counts[1]),
+        fades(counts[1]);
+    for (uint32_t i = 0; i < counts[1]; i++) {
+        x[i] = around(rng);
+        y[i] = height(rng);
+        z[i] = around(rng);
+        radius[i] = size(rng);
+        fades[i] = fade(rng);
+    }
+    for (uint32_t count : counts) {
+        for (int isPacked = 0; isPacked < 2; isPacked++) {
+            Clock::time_point start = Clock::now();
+            for (uint32_t frame = 0; frame < frames; frame++) {
+                for (uint32_t i = 0; i < count; i++) {
+                    bool aimed = i == frame % count;
+                    if (isPacked)
+                        packed[i] = packTargetInstance(x[i], y[i], z[i], radius[i], aimed,
+                                                       fades[i]);
+                    else
+                        full[i] = makeTargetInstance(x[i], y[i], z[i], radius[i], aimed,
+                                                     fades[i]);
+                }
+            }
+            double ms = millisecondsSince(start);
+            size_t bytes = isPacked ? sizeof(PackedTargetInstance) : sizeof(TargetInstance);
+            std::printf("%8u %8s %12zu %12.1f %12.2f\n", count, isPacked ? "packed" : "full",
+                        bytes, count * bytes / 1024.0, ms * 1e6 / (double(frames) * count));
+        }
+    }
+    std::printf("%8s %8s %12zu -> %zu bytes per particle\n", "", "",
+                sizeof(ParticleInstance), sizeof(PackedParticleInstance));
+
+    // How far rounding to halves moves the targets in view on screen, at
+    // worst, against the bound halfPositionsFit holds to.
+    std::printf("%8s %12s %12s %8s\n", "height", "worst px", "bound px", "packed");
+    const int heights[] = {600, 1080, 1440, 2160};
+    for (int h : heights) {
+        Camera camera = makeCamera(0.0f, 0.0f, 1.2f, 16.0f / 9.0f, 0.05f, 200.0f);
+        float tanY = std::tan(0.5f * camera.fovY);
+        float tanX = tanY * camera.aspect;
+        // pixels per unit of x/depth and y/depth
+        float focal = 0.5f * h / tanY;
+        float worst = 0.0f;
+        for (uint32_t i = 0; i < counts[1]; i++) {
+            float depth = -z[i];
+            if (depth < 1.0f || std::fabs(x[i]) > tanX * depth ||
+                std::fabs(y[i]) > tanY * depth)
+                continue;
+            float hx = fromHalf(toHalf(x[i]));
+            float hy = fromHalf(toHalf(y[i]));
+            float hdepth = -fromHalf(toHalf(z[i]));
+            float dx = focal * (hx / hdepth - x[i] / depth);
+            float dy = focal * (hy / hdepth - y[i] / depth);
+            worst = std::max(worst, std::sqrt(dx * dx + dy * dy));
+        }
+        float bound = focal * (1.0f + tanX * tanX + tanY * tanY) / 2048.0f;
+        std::printf("%8d %12.3f %12.3f %8s\n", h, worst, bound,
+                    halfPositionsFit(camera, h, 1.0f) ? "yes" : "no");
+    }
+}
+
+/// ~~~ Half floats ~~~
+
+#ifdef BENCH_F16C
+// Built for F16C on its own so the rest of the bench runs on any x86.
+__attribute__((target("f16c"))) uint16_t hardwareHalf(float f) {
+    return static_cast<uint16_t>(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+}
+#endif
+
+// toHalf against the CPU's own conversion for every float bit pattern. They
+// must agree bit for bit, except that NaNs only have to stay NaNs (toHalf
+// doesn't keep payloads).
+bool checkHalfs() {
+    std::printf("\n== half floats: toHalf against F16C, every float ==\n");
+#ifdef BENCH_F16C
+    if (!__builtin_cpu_supports("f16c")) {
+        std::printf("skipped (no F16C on this CPU)\n");
+        return true;
+    }
+
+    // in blocks of 2^16 patterns, split across the workers
+    JobSystem jobs;
+    std::atomic<uint64_t> mismatches{0};
+    std::atomic<uint32_t> firstBad{0xFFFFFFFFu};
+    Clock::time_point start = Clock::now();
+    jobs.parallelFor(1u << 16, 16, [&](uint32_t begin, uint32_t end) {
+        uint64_t bad = 0;
+        for (uint64_t bits = uint64_t(begin) << 16; bits < uint64_t(end) << 16; bits++) {
+            uint32_t b = static_cast<uint32_t>(bits);
+            float f;
+            std::memcpy(&f, &b, sizeof(f));
+            uint16_t ours = toHalf(f);
+            uint16_t theirs = hardwareHalf(f);
+            bool nan = (b & 0x7FFFFFFF) > 0x7F800000;
+            bool same = nan ? (ours & 0x7FFF) > 0x7C00 && (theirs & 0x7FFF) > 0x7C00 &&
+                                  (ours & 0x8000) == (theirs & 0x8000)
+                            : ours == theirs;
+            if (!same) {
+                uint32_t expected = 0xFFFFFFFFu;
+                firstBad.compare_exchange_strong(expected, b);
+                bad++;
+            }
+        }
+        mismatches.fetch_add(bad, std::memory_order_relaxed);
+    });
+    double ms = millisecondsSince(start);
+
+    if (mismatches.load()) {
+        std::printf("FAILED  %llu patterns differ, e.g. 0x%08X\n",
+                    static_cast<unsigned long long>(mismatches.load()), firstBad.load());
+        return false;
+    }
+    std::printf("OK      2^32 patterns in %.0f ms\n", ms);
+    return true;
+#else
+    std::printf("skipped (not an x86 build)\n");
+    return true;
+#endif
+}
+
+/// ~~~ Mesh import ~~~
+
+// A flat grid of n by n quads as soup, row by row.
+void gridSoup(uint32_t n, std::vector<MeshVertex>& soup) {
+    soup.clear();
+    for (uint32_t j = 0; j < n; j++) {
+        for (uint32_t i = 0; i < n; i++) {
+            MeshVertex q[4];
+            for (int c = 0; c < 4; c++) {
+                q[c] = MeshVertex{float(i + (c == 1 || c == 2)), 0.0f, float(j + (c >= 2)),
+                                  0.0f, 1.0f, 0.0f};
+            }
+            const int order[6] = {0, 2, 1, 0, 3, 2};
+            for (int c : order)
+                soup.push_back(q[c]);
+        }
+    }
+}
+
+void benchMesh() {
+    std::printf("\n== mesh import: merge, vertex cache and fetch order ==\n");
+    std::printf("%18s %9s %9s %11s %5s %8s %9s %8s %8s\n", "mesh", "tris", "soup KB",
+                "indexed KB", "bits", "ACMR in", "ACMR out", "shaded", "ms");
+
+    struct Case {
+        const char* name;
+        std::vector<MeshVertex> soup;
+    };
+    std::vector<Case> cases(4);
+    cases[0].name = "arena";
+    buildArenaMesh(defaultSimConfig().bounds, cases[0].soup);
+    cases[1].name = "grid 100";
+    gridSoup(100, cases[1].soup);
+    // the same triangles in the order a careless exporter might write them
+    cases[2].name = "grid 100 shuffled";
+    gridSoup(100, cases[2].soup);
+    std::mt19937 rng(17);
+    for (uint32_t t = static_cast<uint32_t>(cases[2].soup.size() / 3); t > 1; t--) {
+        uint32_t other = rng() % t;
+        std::swap_ranges(cases[2].soup.begin() + (t - 1) * 3, cases[2].soup.begin() + t * 3,
+                         cases[2].soup.begin() + other * 3);
+    }
+    cases[3].name = "grid 300";
+    gridSoup(300, cases[3].soup);
+
+    // Sizes are as uploaded, 16 bytes a vertex (MapVertex in mapview.h).
+    for (const Case& c : cases) {
+        Mesh mesh;
+        uint32_t count = static_cast<uint32_t>(c.soup.size());
+        Clock::time_point start = Clock::now();
+        MeshImportStats stats = importMesh(c.soup.data(), count, mesh);
+        double ms = millisecondsSince(start);
+        uint32_t indexBytes = meshFitsShortIndices(mesh) ? 2 : 4;
+        // vertex shader runs per frame, against one per corner for soup
+        double shaded = stats.acmrAfter * stats.triangles / count;
+        std::printf("%18s %9u %9.0f %11.0f %5u %8.2f %9.2f %7.0f%% %8.2f\n", c.name,
+                    stats.triangles, count * 16 / 1024.0,
+                    (stats.vertices * 16.0 + count * indexBytes) / 1024.0, indexBytes * 8,
+                    stats.acmrBefore, stats.acmrAfter, shaded * 100.0, ms);
+    }
+}
+
+/// ~~~ Export ~~~
+
+void benchExport() {
+    std::printf("\n== export: history to CSV/JSON ==\n");
+    std::printf("%10s %6s %10s %12s %10s %10s %8s\n", "sessions", "format", "columns",
+                "output KB", "ms", "MB/s", "allocs");
+
+    const char* dbPath = "bench_export.db";
+    const char* outPath = "bench_export.out";
+    const uint32_t sizes[] = {20000, 100000};
+    for (uint32_t sessions : sizes) {
+        std::remove(dbPath);
+        HistoryDb db;
+        if (!db.open(dbPath))
+            return;
+        fillHistory(db, 1700000000, sessions, 8);
+
+        ExportFormat formats[] = {ExportFormat::Csv, ExportFormat::Json};
+        for (ExportFormat format : formats) {
+            for (int selected = 0; selected < 2; selected++) {
+                ExportOptions options = defaultExportOptions(format);
+                if (selected)
+                    parseHistoryColumns("start_time,accuracy", options.columns);
+
+                ExportWriter out;
+                out.open(outPath);
+                uint64_t allocations = allocationCount();
+                Clock::time_point start = Clock::now();
+                exportHistory(db, options, out);
+                out.close();
+                double ms = millisecondsSince(start);
+                // counted in debug builds only; stays flat as history grows
+                allocations = allocationCount() - allocations;
+
+                double kb = out.bytesWritten() / 1024.0;
+                std::printf("%10u %6s %10s %12.1f %10.2f %10.1f %8llu\n", sessions,
+                            format == ExportFormat::Json ? "json" : "csv",
+                            selected ? "2" : "all", kb, ms,
+                            ms > 0.0 ? kb / 1024.0 / (ms / 1000.0) : 0.0,
+                            static_cast<unsigned long long>(allocations));
+            }
+        }
+        db.close();
+    }
+    std::remove(dbPath);
+    std::remove(outPath);
+}
+
+}
+
+int runBenchmarks() {
+    int failures = 0;
+    failures += !checkReplay();
+    benchSeek();
+    failures += !benchCodec();
+    benchHistory();
+    benchMotion();
+    benchHeatmap();
+    benchSweep();
+    benchCull();
+    failures += !checkJobGraphs();
+    benchTickScaling();
+    benchParticles();
+    benchCommands();
+    benchResolution();
+    benchInstances();
+    failures += !checkHalfs();
+    benchMesh();
+    benchExport();
+    if (failures)
+        std::printf("\n%d check(s) FAILED\n", failures);
+    return failures ? 1 : 0;
+}
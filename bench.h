@@ -0,0 +1,9 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Offline benchmarks, run with `maxaim --bench`. They need no window or GL
+// context and print their results as plain-text tables. A few sections are
+// checks rather than timings; if any of them fails, this returns 1.
+int runBenchmarks();
+
+#endif
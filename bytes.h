@@ -0,0 +1,63 @@
+#ifndef BYTES_H
+#define BYTES_H
+
+#include <cstddef>
+#include <cstring>
+
+// Tiny helpers for packing plain data into a caller-provided byte buffer and
+// reading it back, used for sim snapshots. Nothing here allocates: when the
+// buffer is too small the writer just sets `overflow` and stops writing, and
+// the reader sets `failed` if it runs off the end.
+
+struct ByteWriter {
+    unsigned char* data;
+    std::size_t capacity;
+    std::size_t size = 0;
+    bool overflow = false;
+
+    ByteWriter(unsigned char* data, std::size_t capacity)
+        : data(data), capacity(capacity) {}
+
+    void write(const void* p, std::size_t n) {
+        if (overflow || n > capacity - size) {
+            overflow = true;
+            return;
+        }
+        std::memcpy(data + size, p, n);
+        size += n;
+    }
+
+    template <typename T>
+    void put(const T& value) {
+        write(&value, sizeof(T));
+    }
+};
+
+struct ByteReader {
+    const unsigned char* data;
+    std::size_t size;
+    std::size_t offset = 0;
+    bool failed = false;
+
+    ByteReader(const unsigned char* data, std::size_t size)
+        : data(data), size(size) {}
+
+    bool read(void* p, std::size_t n) {
+        if (failed || n > size - offset) {
+            failed = true;
+            return false;
+        }
+        std::memcpy(p, data + offset, n);
+        offset += n;
+        return true;
+    }
+
+    template <typename T>
+    T get() {
+        T value{};
+        read(&value, sizeof(T));
+        return value;
+    }
+};
+
+#endif
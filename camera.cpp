@@ -0,0 +1,57 @@
+#include "camera.h"
+
+#include <cmath>
+
+Camera makeCamera(float yaw, float pitch, float fovY, float aspect,
+                  float nearPlane, float farPlane) {
+    Camera c;
+    c.yaw = yaw;
+    c.pitch = pitch;
+    c.fovY = fovY;
+    c.aspect = aspect;
+    c.nearPlane = nearPlane;
+    c.farPlane = farPlane;
+
+    // same direction the sim aims along
+    float cy = std::cos(yaw), sy = std::sin(yaw);
+    float cp = std::cos(pitch), sp = std::sin(pitch);
+    c.forward[0] = cp * sy;  c.forward[1] = sp;  c.forward[2] = -cp * cy;
+    c.right[0] = cy;         c.right[1] = 0.0f;  c.right[2] = sy;
+    c.up[0] = -sp * sy;      c.up[1] = cp;       c.up[2] = sp * cy;
+
+    // Rows are right, up and back; no translation since the eye is at the
+    // origin.
+    float* v = c.view;
+    for (int i = 0; i < 3; i++) {
+        v[i * 4 + 0] = c.right[i];
+        v[i * 4 + 1] = c.up[i];
+        v[i * 4 + 2] = -c.forward[i];
+        v[i * 4 + 3] = 0.0f;
+    }
+    v[12] = 0.0f;  v[13] = 0.0f;  v[14] = 0.0f;  v[15] = 1.0f;
+
+    // the usual OpenGL perspective, depth to [-1, 1]
+    float f = 1.0f / std::tan(0.5f * fovY);
+    float* p = c.projection;
+    for (int i = 0; i < 16; i++)
+        p[i] = 0.0f;
+    p[0] = f / aspect;
+    p[5] = f;
+    p[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    p[11] = -1.0f;
+    p[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+    return c;
+}
+
+bool halfPositionsFit(const Camera& camera, int viewportHeight, float maxPixels) {
+    // Rounding moves each coordinate by at most 2^-11 of itself, so a point
+    // by at most 2^-11 of its distance, which is an angle of 2^-11 radians
+    // seen from the eye. The projection stretches angles most in the
+    // corners, radially, by 1 + tan^2 of the angle off the view axis.
+    const float rounding = 1.0f / 2048.0f;
+    float tanY = std::tan(0.5f * camera.fovY);
+    float tanX = tanY * camera.aspect;
+    float cornerStretch = 1.0f + tanX * tanX + tanY * tanY;
+    float pixelsPerRadian = 0.5f * viewportHeight / tanY;
+    return pixelsPerRadian * cornerStretch * rounding <= maxPixels;
+}
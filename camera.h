@@ -0,0 +1,32 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+// The player's view. The camera sits at the origin, where the sim puts the
+// player, and turns with the view angles from SimInput: yaw to the right
+// and pitch up, both in radians, with yaw = pitch = 0 looking down -Z.
+struct Camera {
+    float yaw, pitch;
+    float right[3];
+    float up[3];
+    float forward[3];
+    // vertical field of view in radians, and width / height
+    float fovY;
+    float aspect;
+    float nearPlane, farPlane;
+    // column-major, as glUniformMatrix4fv takes them untransposed
+    float view[16];
+    float projection[16];
+};
+
+Camera makeCamera(float yaw, float pitch, float fovY, float aspect,
+                  float nearPlane, float farPlane);
+
+// Whether world positions stored as half floats land within maxPixels of
+// where full floats would put them, in a view viewportHeight pixels high.
+// A half keeps 11 significant bits, so its error grows with distance from
+// the origin; but the eye is at the origin, so the error seen on screen is
+// about the same angle at any distance, and only the pixel density decides
+// whether it shows.
+bool halfPositionsFit(const Camera& camera, int viewportHeight, float maxPixels);
+
+#endif
@@ -0,0 +1,393 @@
+#include "codec.h"
+#include "sim.h"
+
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#ifdef MAXAIM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+const char codecMagic[8] = {'M', 'A', 'X', 'A', 'I', 'M', 'R', 'Z'};
+const uint32_t codecVersion = 1;
+
+// type byte that marks a snapshot instead of a record
+const unsigned char snapshotMarker = 0xFF;
+
+// blocks are cut at the first record or snapshot boundary past this many
+// bytes, so none is bigger than that plus one snapshot (the biggest item)
+const std::size_t blockTarget = 256 * 1024;
+const std::size_t maxBlockSize = blockTarget + SessionRecorder::snapshotCapacity + 64;
+
+// Subjects are entity indices, or no entity at all (a shot that missed
+// everything).
+bool validSubject(uint64_t subject) {
+    return subject < MAX_TARGETS || subject == Handle().index;
+}
+
+struct BlockHeader {
+    uint32_t rawSize;
+    uint32_t storedSize;
+    BlockCompression compression;
+};
+
+/// ~~~ Varints ~~~
+//
+// Unsigned LEB128: 7 bits per byte, high bit set on every byte but the last.
+// Signed values are zigzag-mapped first (0, -1, 1, -2, ... -> 0, 1, 2, 3,
+// ...) so small negative deltas stay short too.
+
+void putVarint(std::vector<unsigned char>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<unsigned char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+bool getVarint(const std::vector<unsigned char>& in, std::size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= in.size())
+            return false;
+        unsigned char byte = in[pos++];
+        v |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+uint32_t floatBits(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+float bitsFloat(uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+void encodeRecord(std::vector<unsigned char>& out, CodecPredictor& p, const SessionRecord& r) {
+    out.push_back(static_cast<unsigned char>(r.type));
+    putVarint(out, zigzag(int64_t(r.tick) - int64_t(p.previous.tick)));
+    putVarint(out, zigzag(static_cast<int64_t>(r.timeUs - p.previous.timeUs)));
+    putVarint(out, r.subject);
+
+    float predicted[3];
+    p.predict(r.type, r.subject, predicted);
+    for (int k = 0; k < 3; k++) {
+        int32_t delta = static_cast<int32_t>(floatBits(r.values[k]) - floatBits(predicted[k]));
+        putVarint(out, zigzag(delta));
+    }
+    p.update(r);
+}
+
+void encodeSnapshot(std::vector<unsigned char>& out, const LogSnapshot& s) {
+    out.push_back(snapshotMarker);
+    putVarint(out, s.tick);
+    putVarint(out, s.data.size());
+    out.insert(out.end(), s.data.begin(), s.data.end());
+}
+
+bool writeBlock(std::FILE* f, const std::vector<unsigned char>& raw,
+                BlockCompression compression) {
+    BlockHeader header = {static_cast<uint32_t>(raw.size()),
+                          static_cast<uint32_t>(raw.size()), BlockCompression::None};
+    const unsigned char* payload = raw.data();
+
+#ifdef MAXAIM_WITH_ZSTD
+    std::vector<unsigned char> packed;
+    if (compression == BlockCompression::Zstd && !raw.empty()) {
+        packed.resize(ZSTD_compressBound(raw.size()));
+        std::size_t size = ZSTD_compress(packed.data(), packed.size(), raw.data(), raw.size(), 3);
+        // keep the raw bytes if compressing didn't help
+        if (!ZSTD_isError(size) && size < raw.size()) {
+            header.storedSize = static_cast<uint32_t>(size);
+            header.compression = BlockCompression::Zstd;
+            payload = packed.data();
+        }
+    }
+#else
+    (void)compression;
+#endif
+
+    return std::fwrite(&header, sizeof(header), 1, f) == 1 &&
+           std::fwrite(payload, 1, header.storedSize, f) == header.storedSize;
+}
+
+}
+
+/// ~~~ Prediction ~~~
+
+void CodecPredictor::predict(RecordType type, uint32_t subject, float out[3]) const {
+    const float* source = lastOfType[static_cast<uint8_t>(type)].values;
+    // hits and expiries happen where the target was last seen
+    if ((type == RecordType::TargetHit || type == RecordType::TargetExpired) &&
+        subject < known.size() && known[subject])
+        source = &positions[subject * 3];
+    out[0] = source[0];
+    out[1] = source[1];
+    out[2] = source[2];
+}
+
+void CodecPredictor::update(const SessionRecord& r) {
+    previous = r;
+    lastOfType[static_cast<uint8_t>(r.type)] = r;
+
+    bool target = r.type == RecordType::TargetSpawned || r.type == RecordType::TargetHit ||
+                  r.type == RecordType::TargetExpired;
+    // subjects past the sim's entity range never get this far (the encoder
+    // and decoder both refuse them), but don't size anything from one
+    if (target && r.subject < MAX_TARGETS) {
+        if (r.subject >= known.size()) {
+            known.resize(r.subject + 1, 0);
+            positions.resize((r.subject + 1) * 3, 0.0f);
+        }
+        known[r.subject] = 1;
+        std::memcpy(&positions[r.subject * 3], r.values, sizeof(r.values));
+    }
+}
+
+bool blockCompressionAvailable() {
+#ifdef MAXAIM_WITH_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool isCompressedReplay(const char* path) {
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f)
+        return false;
+    char magic[8] = {};
+    bool match = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                 std::memcmp(magic, codecMagic, sizeof(magic)) == 0;
+    std::fclose(f);
+    return match;
+}
+
+/// ~~~ Encoding ~~~
+
+bool writeCompressedReplay(const char* path, const SessionLog& log,
+                           BlockCompression compression) {
+    std::FILE* f = std::fopen(path, "wb");
+    if (!f) {
+        std::cout << "ERROR::CODEC::OPEN_FAILED\n" << path << std::endl;
+        return false;
+    }
+
+    std::fwrite(codecMagic, 1, sizeof(codecMagic), f);
+    std::fwrite(&codecVersion, sizeof(codecVersion), 1, f);
+    std::fwrite(&log.header, sizeof(log.header), 1, f);
+
+    CodecPredictor predictor;
+    std::vector<unsigned char> raw;
+    raw.reserve(blockTarget * 2);
+    bool ok = true;
+
+    // Snapshots go in just before the first record of the tick they were
+    // taken at, so a streaming reader meets them in the right place.
+    // a subject or snapshot the decoder would refuse fails the write
+    bool inRange = true;
+    std::size_t nextSnapshot = 0;
+    auto cutBlock = [&]() {
+        if (raw.size() >= blockTarget) {
+            ok = ok && writeBlock(f, raw, compression);
+            raw.clear();
+        }
+    };
+    for (const SessionRecord& r : log.records) {
+        while (nextSnapshot < log.snapshots.size() &&
+               log.snapshots[nextSnapshot].tick <= r.tick) {
+            inRange = inRange && log.snapshots[nextSnapshot].data.size() <= SessionRecorder::snapshotCapacity;
+            encodeSnapshot(raw, log.snapshots[nextSnapshot++]);
+            cutBlock();
+        }
+
+        inRange = inRange && validSubject(r.subject);
+        encodeRecord(raw, predictor, r);
+        cutBlock();
+    }
+    while (nextSnapshot < log.snapshots.size()) {
+        inRange = inRange && log.snapshots[nextSnapshot].data.size() <= SessionRecorder::snapshotCapacity;
+        encodeSnapshot(raw, log.snapshots[nextSnapshot++]);
+        cutBlock();
+    }
+
+    if (!raw.empty())
+        ok = ok && writeBlock(f, raw, compression);
+    // an empty block ends the stream
+    raw.clear();
+    ok = ok && writeBlock(f, raw, BlockCompression::None);
+
+    ok = std::fclose(f) == 0 && ok;
+    if (!inRange)
+        std::cout << "ERROR::CODEC::OUT_OF_RANGE\n" << path << std::endl;
+    else if (!ok)
+        std::cout << "ERROR::CODEC::WRITE_FAILED\n" << path << std::endl;
+    return ok && inRange;
+}
+
+/// ~~~ Decoding ~~~
+
+ReplayDecoder::ReplayDecoder() : file(nullptr), logHeader(), position(0) {}
+
+ReplayDecoder::~ReplayDecoder() {
+    close();
+}
+
+void ReplayDecoder::close() {
+    if (file)
+        std::fclose(file);
+    file = nullptr;
+}
+
+bool ReplayDecoder::open(const char* path) {
+    close();
+    file = std::fopen(path, "rb");
+    if (!file) {
+        std::cout << "ERROR::CODEC::OPEN_FAILED\n" << path << std::endl;
+        return false;
+    }
+
+    char magic[8];
+    uint32_t version = 0;
+    if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        std::memcmp(magic, codecMagic, sizeof(magic)) != 0 ||
+        std::fread(&version, sizeof(version), 1, file) != 1 || version != codecVersion ||
+        std::fread(&logHeader, sizeof(logHeader), 1, file) != 1) {
+        std::cout << "ERROR::CODEC::BAD_HEADER\n" << path << std::endl;
+        close();
+        return false;
+    }
+
+    block.clear();
+    position = 0;
+    predictor = CodecPredictor();
+    return true;
+}
+
+bool ReplayDecoder::readBlock() {
+    BlockHeader header;
+    if (!file || std::fread(&header, sizeof(header), 1, file) != 1)
+        return false;
+    // Sizes come straight from the file; refuse anything the writer couldn't
+    // have made before allocating for it. (An empty block with position past
+    // it is how next() tells this from the end of the stream.)
+    if (header.rawSize > maxBlockSize || header.storedSize > header.rawSize) {
+        block.clear();
+        position = 1;
+        return false;
+    }
+
+    block.resize(header.rawSize);
+    position = 0;
+    if (header.rawSize == 0)
+        return false;
+
+    if (header.compression == BlockCompression::None) {
+        return header.storedSize == header.rawSize &&
+               std::fread(block.data(), 1, header.rawSize, file) == header.rawSize;
+    }
+
+#ifdef MAXAIM_WITH_ZSTD
+    if (header.compression == BlockCompression::Zstd) {
+        stored.resize(header.storedSize);
+        if (std::fread(stored.data(), 1, stored.size(), file) != stored.size())
+            return false;
+        std::size_t size = ZSTD_decompress(block.data(), block.size(), stored.data(), stored.size());
+        return !ZSTD_isError(size) && size == header.rawSize;
+    }
+#endif
+
+    std::cout << "ERROR::CODEC::UNSUPPORTED_COMPRESSION" << std::endl;
+    return false;
+}
+
+ReplayDecoder::Item ReplayDecoder::next(SessionRecord& record, LogSnapshot& snapshot) {
+    if (position >= block.size()) {
+        if (!readBlock())
+            return block.empty() && position == 0 ? End : Error;
+    }
+
+    unsigned char type = block[position++];
+    uint64_t a, b, c;
+
+    if (type == snapshotMarker) {
+        if (!getVarint(block, position, a) || !getVarint(block, position, b) ||
+            b > block.size() - position)
+            return Error;
+        snapshot.tick = static_cast<uint32_t>(a);
+        snapshot.data.assign(block.begin() + position, block.begin() + position + b);
+        position += b;
+        return Snapshot;
+    }
+
+    SessionRecord r = {};
+    r.type = static_cast<RecordType>(type);
+    if (!getVarint(block, position, a) || !getVarint(block, position, b) ||
+        !getVarint(block, position, c) || !validSubject(c))
+        return Error;
+    r.tick = static_cast<uint32_t>(int64_t(predictor.previous.tick) + unzigzag(a));
+    r.timeUs = predictor.previous.timeUs + static_cast<uint64_t>(unzigzag(b));
+    r.subject = static_cast<uint32_t>(c);
+
+    float predicted[3];
+    predictor.predict(r.type, r.subject, predicted);
+    for (int k = 0; k < 3; k++) {
+        uint64_t v;
+        if (!getVarint(block, position, v))
+            return Error;
+        uint32_t delta = static_cast<uint32_t>(static_cast<int32_t>(unzigzag(v)));
+        r.values[k] = bitsFloat(floatBits(predicted[k]) + delta);
+    }
+    predictor.update(r);
+
+    record = r;
+    return Record;
+}
+
+bool readCompressedReplay(const char* path, SessionLog& log) {
+    log.records.clear();
+    log.blocks.clear();
+    log.snapshots.clear();
+    log.recovered = false;
+
+    ReplayDecoder decoder;
+    if (!decoder.open(path))
+        return false;
+    log.header = decoder.header();
+
+    SessionRecord record;
+    LogSnapshot snapshot;
+    while (true) {
+        switch (decoder.next(record, snapshot)) {
+        case ReplayDecoder::Record:
+            log.records.push_back(record);
+            break;
+        case ReplayDecoder::Snapshot:
+            log.snapshots.push_back(std::move(snapshot));
+            break;
+        case ReplayDecoder::End:
+            return true;
+        case ReplayDecoder::Error:
+            std::cout << "ERROR::CODEC::CORRUPT\n" << path << std::endl;
+            return false;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "recorder.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Compact replay encoding.
+//
+// The session log is built for writing fast and surviving crashes, and
+// spends 32 bytes on every record. For storing and sharing replays, this
+// codec re-encodes a log as a byte stream where every field is written as a
+// (zigzag) varint delta against a prediction:
+//
+//   - ticks and timestamps against the previous record's
+//   - view angles against the previous input sample
+//   - target positions against the last position recorded for that target
+//     (spawn, then hit/expire), which is exact for targets that don't move
+//   - everything else against the previous record of the same type
+//
+// Floats are predicted on their bit patterns, so the encoding is lossless
+// and a decoded replay still re-simulates bit-for-bit.
+//
+// Subjects are entity indices (or an invalid Handle's index when a record
+// has none), so anything else at or past MAX_TARGETS is refused on both
+// sides, as is a block bigger than the writer ever makes.
+//
+// The byte stream is cut into blocks at record boundaries. When built with
+// MAXAIM_WITH_ZSTD each block is optionally zstd-compressed on top. Decoding
+// is streaming: ReplayDecoder reads and decodes one block at a time.
+//
+// File layout: "MAXAIMRZ", version, the original LogHeader, then blocks of
+// { rawSize, storedSize, compression, payload }, ending with rawSize == 0.
+
+enum class BlockCompression : uint32_t {
+    None = 0,
+    Zstd = 1
+};
+
+// true if this build can write and read zstd blocks
+bool blockCompressionAvailable();
+
+bool isCompressedReplay(const char* path);
+
+bool writeCompressedReplay(const char* path, const SessionLog& log,
+                           BlockCompression compression);
+
+// Predicts each record's fields from the ones before it. The encoder and
+// decoder each keep one and feed it the same records, so they always agree.
+struct CodecPredictor {
+    SessionRecord previous = {};
+    SessionRecord lastOfType[256] = {};
+    // last known x, y, z per target subject, and whether we've seen it
+    std::vector<float> positions;
+    std::vector<unsigned char> known;
+
+    void predict(RecordType type, uint32_t subject, float out[3]) const;
+    void update(const SessionRecord& r);
+};
+
+class ReplayDecoder {
+public:
+    enum Item {
+        Record,
+        Snapshot,
+        End,
+        Error
+    };
+
+    ReplayDecoder();
+    ~ReplayDecoder();
+
+    ReplayDecoder(const ReplayDecoder&) = delete;
+    ReplayDecoder& operator=(const ReplayDecoder&) = delete;
+
+    bool open(const char* path);
+    void close();
+
+    const LogHeader& header() const { return logHeader; }
+
+    // Decode the next item into record or snapshot.
+    Item next(SessionRecord& record, LogSnapshot& snapshot);
+
+private:
+    bool readBlock();
+
+    std::FILE* file;
+    LogHeader logHeader;
+    std::vector<unsigned char> stored;
+    std::vector<unsigned char> block;
+    std::size_t position;
+
+    CodecPredictor predictor;
+};
+
+// Decode a whole file into a SessionLog (for replaying/verifying).
+bool readCompressedReplay(const char* path, SessionLog& log);
+
+#endif
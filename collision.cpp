@@ -0,0 +1,325 @@
+#include "collision.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLLISION_SSE 1
+#endif
+
+/// ~~~ Broadphase ~~~
+
+SweepAndPrune::SweepAndPrune(uint32_t capacity)
+    : capacity(capacity), count(0),
+      order(static_cast<uint32_t*>(std::malloc(sizeof(uint32_t) * capacity))),
+      minKey(static_cast<float*>(std::malloc(sizeof(float) * capacity))),
+      tracked(static_cast<uint8_t*>(std::calloc(capacity, 1))),
+      sortMoves(0), droppedPairs(0) {}
+
+SweepAndPrune::~SweepAndPrune() {
+    std::free(order);
+    std::free(minKey);
+    std::free(tracked);
+}
+
+void SweepAndPrune::clear() {
+    for (uint32_t i = 0; i < count; i++)
+        tracked[order[i]] = 0;
+    count = 0;
+}
+
+void SweepAndPrune::save(ByteWriter& out) const {
+    out.put(count);
+    out.write(order, sizeof(uint32_t) * count);
+}
+
+bool SweepAndPrune::load(ByteReader& in) {
+    clear();
+    uint32_t saved = in.get<uint32_t>();
+    if (in.failed || saved > capacity)
+        return false;
+    if (!in.read(order, sizeof(uint32_t) * saved))
+        return false;
+    for (uint32_t i = 0; i < saved; i++) {
+        if (order[i] >= capacity) {
+            count = i;
+            clear();
+            return false;
+        }
+        tracked[order[i]] = 1;
+    }
+    // the keys are refreshed from the bodies on the next findPairs()
+    count = saved;
+    return true;
+}
+
+uint32_t SweepAndPrune::findPairs(const CollisionBodies& bodies,
+                                  FrameArena& frameArena,
+                                  CollisionPair** pairs) {
+    uint32_t limit = bodies.capacity < capacity ? bodies.capacity : capacity;
+
+    // drop bodies that have gone away and refresh the keys of the rest,
+    // keeping last frame's order
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t id = order[i];
+        if (id < limit && bodies.active[id]) {
+            order[kept] = id;
+            minKey[kept] = bodies.x[id] - bodies.radius[id];
+            kept++;
+        } else {
+            tracked[id] = 0;
+        }
+    }
+    count = kept;
+
+    // new bodies go on the end; the sort below moves them into place
+    for (uint32_t id = 0; id < limit; id++) {
+        if (bodies.active[id] && !tracked[id]) {
+            tracked[id] = 1;
+            order[count] = id;
+            minKey[count] = bodies.x[id] - bodies.radius[id];
+            count++;
+        }
+    }
+
+    // insertion sort: nearly free when the order barely changed
+    sortMoves = 0;
+    for (uint32_t i = 1; i < count; i++) {
+        float key = minKey[i];
+        uint32_t id = order[i];
+        uint32_t j = i;
+        while (j > 0 && minKey[j - 1] > key) {
+            minKey[j] = minKey[j - 1];
+            order[j] = order[j - 1];
+            j--;
+        }
+        minKey[j] = key;
+        order[j] = id;
+        sortMoves += i - j;
+    }
+
+    // sweep: everything whose left edge starts before body i's right edge
+    // overlaps it on X, then check Y and Z to get the box overlaps. Room is
+    // made for eight pairs a body, far more than spheres of similar size can
+    // touch at once; past that the sweep goes on only to count what it drops.
+    uint32_t maxPairs = count * 8 + 64;
+    CollisionPair* out = frameArena.allocateArray<CollisionPair>(maxPairs);
+    uint32_t pairCount = 0;
+    assert(out && "frame arena too small for the broadphase");
+    if (!out)
+        maxPairs = 0;
+    droppedPairs = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t a = order[i];
+        float ra = bodies.radius[a];
+        float maxX = bodies.x[a] + ra;
+        for (uint32_t j = i + 1; j < count && minKey[j] <= maxX; j++) {
+            uint32_t b = order[j];
+            float reach = ra + bodies.radius[b];
+            if (std::fabs(bodies.y[a] - bodies.y[b]) > reach ||
+                std::fabs(bodies.z[a] - bodies.z[b]) > reach)
+                continue;
+            if (pairCount < maxPairs)
+                out[pairCount++] = CollisionPair{a, b};
+            else
+                droppedPairs++;
+        }
+    }
+
+    *pairs = out;
+    return pairCount;
+}
+
+/// ~~~ Narrowphase and response ~~~
+
+namespace {
+
+void respond(CollisionBodies& bodies, uint32_t a, uint32_t b) {
+    // The narrowphase measured every contact before any of them moved
+    // anything. In a cluster an earlier response may have pushed one of these
+    // two since, so the normal and the penetration come from where they are
+    // now, and a pair that has been pushed apart already is left alone.
+    float dx = bodies.x[b] - bodies.x[a];
+    float dy = bodies.y[b] - bodies.y[a];
+    float dz = bodies.z[b] - bodies.z[a];
+    float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+    float reach = bodies.radius[a] + bodies.radius[b];
+    if (distance >= reach)
+        return;
+
+    float nx = 1.0f, ny = 0.0f, nz = 0.0f;
+    if (distance > 1e-6f) {
+        float inv = 1.0f / distance;
+        nx = dx * inv;
+        ny = dy * inv;
+        nz = dz * inv;
+    }
+
+    // split the penetration evenly between the two spheres
+    float push = 0.5f * (reach - distance);
+    bodies.x[a] -= nx * push; bodies.y[a] -= ny * push; bodies.z[a] -= nz * push;
+    bodies.x[b] += nx * push; bodies.y[b] += ny * push; bodies.z[b] += nz * push;
+
+    // equal masses: swap the velocity components along the normal, but only
+    // if they're moving towards each other
+    float closing = (bodies.vx[b] - bodies.vx[a]) * nx +
+                    (bodies.vy[b] - bodies.vy[a]) * ny +
+                    (bodies.vz[b] - bodies.vz[a]) * nz;
+    if (closing < 0.0f) {
+        bodies.vx[a] += nx * closing; bodies.vy[a] += ny * closing; bodies.vz[a] += nz * closing;
+        bodies.vx[b] -= nx * closing; bodies.vy[b] -= ny * closing; bodies.vz[b] -= nz * closing;
+    }
+}
+
+}
+
+namespace {
+
+// Pairs per narrowphase job, and bodies per bounds job.
+const uint32_t pairChunk = 1024;
+const uint32_t bodyChunk = 1024;
+
+// Copy the pairs that really touch to out, in order, four pairs at a time.
+// Only reads positions.
+uint32_t findContacts(const CollisionBodies& bodies, const CollisionPair* pairs,
+                      uint32_t pairCount, CollisionPair* out) {
+    uint32_t contactCount = 0;
+    uint32_t i = 0;
+#ifdef COLLISION_SSE
+    const float* x = bodies.x;
+    const float* y = bodies.y;
+    const float* z = bodies.z;
+    const float* r = bodies.radius;
+    for (; i + 4 <= pairCount; i += 4) {
+        const CollisionPair* p = pairs + i;
+        __m128 dx = _mm_sub_ps(
+            _mm_setr_ps(x[p[0].b], x[p[1].b], x[p[2].b], x[p[3].b]),
+            _mm_setr_ps(x[p[0].a], x[p[1].a], x[p[2].a], x[p[3].a]));
+        __m128 dy = _mm_sub_ps(
+            _mm_setr_ps(y[p[0].b], y[p[1].b], y[p[2].b], y[p[3].b]),
+            _mm_setr_ps(y[p[0].a], y[p[1].a], y[p[2].a], y[p[3].a]));
+        __m128 dz = _mm_sub_ps(
+            _mm_setr_ps(z[p[0].b], z[p[1].b], z[p[2].b], z[p[3].b]),
+            _mm_setr_ps(z[p[0].a], z[p[1].a], z[p[2].a], z[p[3].a]));
+        __m128 reach = _mm_add_ps(
+            _mm_setr_ps(r[p[0].a], r[p[1].a], r[p[2].a], r[p[3].a]),
+            _mm_setr_ps(r[p[0].b], r[p[1].b], r[p[2].b], r[p[3].b]));
+
+        __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                  _mm_mul_ps(dz, dz));
+        int hits = _mm_movemask_ps(_mm_cmplt_ps(dist2, _mm_mul_ps(reach, reach)));
+        for (int lane = 0; lane < 4; lane++) {
+            if (hits & (1 << lane))
+                out[contactCount++] = p[lane];
+        }
+    }
+#endif
+    for (; i < pairCount; i++) {
+        uint32_t a = pairs[i].a;
+        uint32_t b = pairs[i].b;
+        float dx = bodies.x[b] - bodies.x[a];
+        float dy = bodies.y[b] - bodies.y[a];
+        float dz = bodies.z[b] - bodies.z[a];
+        float reach = bodies.radius[a] + bodies.radius[b];
+        float dist2 = dx * dx + dy * dy + dz * dz;
+        if (dist2 < reach * reach)
+            out[contactCount++] = pairs[i];
+    }
+    return contactCount;
+}
+
+}
+
+uint32_t resolveCollisions(CollisionBodies& bodies,
+                           const CollisionPair* pairs, uint32_t pairCount,
+                           FrameArena& frameArena, JobSystem* jobs) {
+    uint32_t chunks = (pairCount + pairChunk - 1) / pairChunk;
+    CollisionPair* contacts = frameArena.allocateArray<CollisionPair>(pairCount);
+    uint32_t* chunkContacts = frameArena.allocateArray<uint32_t>(chunks);
+    assert((contacts && chunkContacts) && "frame arena too small for the narrowphase");
+    if (!contacts || !chunkContacts)
+        return 0;
+
+    // First find which of the candidate pairs really touch. This only reads
+    // positions, so it can all run in parallel before the response starts
+    // moving bodies around. Each chunk of pairs writes its contacts to its
+    // own part of the array, and they're packed together in order after.
+    auto detect = [&](uint32_t first, uint32_t last) {
+        for (uint32_t c = first; c < last; c++) {
+            uint32_t begin = c * pairChunk;
+            uint32_t count = std::min(pairCount - begin, pairChunk);
+            chunkContacts[c] = findContacts(bodies, pairs + begin, count, contacts + begin);
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(chunks, 1, detect);
+    else
+        detect(0, chunks);
+
+    uint32_t contactCount = 0;
+    for (uint32_t c = 0; c < chunks; c++) {
+        std::memmove(contacts + contactCount, contacts + c * pairChunk,
+                     chunkContacts[c] * sizeof(CollisionPair));
+        contactCount += chunkContacts[c];
+    }
+
+    // Response has to be serial since a body can be in several contacts.
+    for (uint32_t c = 0; c < contactCount; c++)
+        respond(bodies, contacts[c].a, contacts[c].b);
+
+    return contactCount;
+}
+
+namespace {
+
+void bounceOffBounds(CollisionBodies& bodies, const CollisionBounds& bounds, uint32_t id) {
+    if (!bodies.active[id])
+        return;
+    float r = bodies.radius[id];
+
+    if (bodies.x[id] - r < bounds.minX) {
+        bodies.x[id] = bounds.minX + r;
+        bodies.vx[id] = std::fabs(bodies.vx[id]);
+    } else if (bodies.x[id] + r > bounds.maxX) {
+        bodies.x[id] = bounds.maxX - r;
+        bodies.vx[id] = -std::fabs(bodies.vx[id]);
+    }
+
+    if (bodies.y[id] - r < bounds.minY) {
+        bodies.y[id] = bounds.minY + r;
+        bodies.vy[id] = std::fabs(bodies.vy[id]);
+    } else if (bodies.y[id] + r > bounds.maxY) {
+        bodies.y[id] = bounds.maxY - r;
+        bodies.vy[id] = -std::fabs(bodies.vy[id]);
+    }
+
+    if (bodies.z[id] - r < bounds.minZ) {
+        bodies.z[id] = bounds.minZ + r;
+        bodies.vz[id] = std::fabs(bodies.vz[id]);
+    } else if (bodies.z[id] + r > bounds.maxZ) {
+        bodies.z[id] = bounds.maxZ - r;
+        bodies.vz[id] = -std::fabs(bodies.vz[id]);
+    }
+}
+
+}
+
+void collideWithBounds(CollisionBodies& bodies, const CollisionBounds& bounds,
+                       JobSystem* jobs) {
+    // every body on its own, so any split across threads is the same
+    auto bounce = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t id = begin; id < end; id++)
+            bounceOffBounds(bodies, bounds, id);
+    };
+    if (jobs)
+        jobs->parallelFor(bodies.capacity, bodyChunk, bounce);
+    else
+        bounce(0, bodies.capacity);
+}
+
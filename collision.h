@@ -0,0 +1,89 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "arena.h"
+#include "bytes.h"
+#include "jobs.h"
+
+#include <cstdint>
+
+// Sphere bodies in structure-of-arrays form. Arrays are indexed by a stable
+// body id (for targets, the pool slot index) and active[id] says whether the
+// id is in use, so ids keep their place in the broadphase between frames.
+struct CollisionBodies {
+    float* x;
+    float* y;
+    float* z;
+    float* vx;
+    float* vy;
+    float* vz;
+    const float* radius;
+    const uint8_t* active;
+    uint32_t capacity;
+};
+
+struct CollisionBounds {
+    float minX, maxX;
+    float minY, maxY;
+    float minZ, maxZ;
+};
+
+struct CollisionPair {
+    uint32_t a, b;
+};
+
+// Sort-and-sweep broadphase along X. The list of bodies sorted by the left
+// edge of their bounds is kept from one frame to the next, and since bodies
+// only move a little per tick it is almost sorted already, so insertion sort
+// brings it back in order in close to O(n).
+class SweepAndPrune {
+public:
+    explicit SweepAndPrune(uint32_t capacity);
+    ~SweepAndPrune();
+
+    SweepAndPrune(const SweepAndPrune&) = delete;
+    SweepAndPrune& operator=(const SweepAndPrune&) = delete;
+
+    // Re-sort and return every pair whose bounding boxes overlap. The pairs
+    // are allocated from frameArena, with room for 8 per body plus 64; pairs
+    // past that (or all of them, if the arena runs out) are dropped for this
+    // frame and counted in lastDroppedPairs.
+    uint32_t findPairs(const CollisionBodies& bodies, FrameArena& frameArena,
+                       CollisionPair** pairs);
+
+    void clear();
+
+    // The sorted order decides the order contacts are resolved in, so it is
+    // part of the sim state that snapshots have to capture.
+    void save(ByteWriter& out) const;
+    bool load(ByteReader& in);
+
+    // number of element moves the last insertion sort needed
+    uint32_t lastSortMoves() const { return sortMoves; }
+    // overlapping pairs the last findPairs had no room for
+    uint32_t lastDroppedPairs() const { return droppedPairs; }
+
+private:
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t* order;
+    float* minKey;
+    uint8_t* tracked;
+    uint32_t sortMoves;
+    uint32_t droppedPairs;
+};
+
+// Narrowphase and response: push overlapping spheres apart and reflect their
+// velocities along the contact normal (equal-mass elastic collision).
+// Returns the number of pairs that were actually touching. Finding the
+// contacts is split across jobs if given; the response is serial, in pair
+// order, so the result is the same either way.
+uint32_t resolveCollisions(CollisionBodies& bodies,
+                           const CollisionPair* pairs, uint32_t pairCount,
+                           FrameArena& frameArena, JobSystem* jobs = nullptr);
+
+// Keep bodies inside the arena box, bouncing them off its walls.
+void collideWithBounds(CollisionBodies& bodies, const CollisionBounds& bounds,
+                       JobSystem* jobs = nullptr);
+
+#endif
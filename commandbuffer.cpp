@@ -0,0 +1,198 @@
+#include "commandbuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Non-negative floats order the same as their bit patterns.
+uint32_t depthBits(float depth) {
+    if (!(depth > 0.0f))
+        return 0;
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits;
+}
+
+// Runs this short are insertion sorted.
+const uint32_t smallSort = 32;
+// Below this many keys a merge sort of insertion sorted runs beats the radix
+// passes, whose cost is mostly clearing and walking 256-entry histograms.
+// Measured with the draw submission bench.
+const uint32_t radixMinimum = 1536;
+
+void insertionSort(uint64_t* keys, uint32_t* values, uint32_t count) {
+    for (uint32_t i = 1; i < count; i++) {
+        uint64_t k = keys[i];
+        uint32_t v = values[i];
+        uint32_t j = i;
+        for (; j > 0 && keys[j - 1] > k; j--) {
+            keys[j] = keys[j - 1];
+            values[j] = values[j - 1];
+        }
+        keys[j] = k;
+        values[j] = v;
+    }
+}
+
+// Stable bottom-up merge sort, ping-ponging between the two buffers.
+void mergeSort(uint64_t* keys, uint32_t* values, uint32_t count,
+               uint64_t* tmpKeys, uint32_t* tmpValues) {
+    for (uint32_t begin = 0; begin < count; begin += smallSort)
+        insertionSort(keys + begin, values + begin, std::min(smallSort, count - begin));
+
+    uint64_t* srcKeys = keys;
+    uint32_t* srcValues = values;
+    uint64_t* dstKeys = tmpKeys;
+    uint32_t* dstValues = tmpValues;
+    for (uint32_t width = smallSort; width < count; width *= 2) {
+        for (uint32_t begin = 0; begin < count; begin += 2 * width) {
+            uint32_t middle = std::min(count, begin + width);
+            uint32_t end = std::min(count, begin + 2 * width);
+            uint32_t a = begin, b = middle, out = begin;
+            while (a < middle && b < end) {
+                // taking from the left on ties keeps the sort stable
+                uint32_t from = srcKeys[b] < srcKeys[a] ? b++ : a++;
+                dstKeys[out] = srcKeys[from];
+                dstValues[out++] = srcValues[from];
+            }
+            for (; a < middle; a++, out++) {
+                dstKeys[out] = srcKeys[a];
+                dstValues[out] = srcValues[a];
+            }
+            for (; b < end; b++, out++) {
+                dstKeys[out] = srcKeys[b];
+                dstValues[out] = srcValues[b];
+            }
+        }
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    if (srcKeys != keys) {
+        std::memcpy(keys, srcKeys, count * sizeof(uint64_t));
+        std::memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+}
+
+uint64_t passBits(RenderPass pass) {
+    return static_cast<uint64_t>(pass) << 60;
+}
+
+}
+
+uint64_t opaqueKey(unsigned int program, uint32_t material, float depth) {
+    return passBits(RenderPass::Opaque) | static_cast<uint64_t>(program & 0xFFF) << 48 |
+           static_cast<uint64_t>(material & 0xFFFF) << 32 | depthBits(depth);
+}
+
+uint64_t blendedKey(unsigned int program, uint32_t material, float depth) {
+    return passBits(RenderPass::Blended) | static_cast<uint64_t>(~depthBits(depth)) << 28 |
+           static_cast<uint64_t>(program & 0xFFF) << 16 | (material & 0xFFFF);
+}
+
+uint64_t compositeKey(uint32_t order) {
+    return passBits(RenderPass::Composite) | order;
+}
+
+uint64_t overlayKey(uint32_t order) {
+    return passBits(RenderPass::Overlay) | order;
+}
+
+void radixSort(uint64_t* keys, uint32_t* values, uint32_t count,
+               uint64_t* tmpKeys, uint32_t* tmpValues) {
+    if (count < 2)
+        return;
+    // A frame usually has a handful of packets, and for those clearing and
+    // walking the histograms costs more than just sorting by insertion.
+    if (count <= smallSort) {
+        insertionSort(keys, values, count);
+        return;
+    }
+    if (count < radixMinimum) {
+        mergeSort(keys, values, count, tmpKeys, tmpValues);
+        return;
+    }
+
+    // Only bytes where some keys differ need a pass; with the key layout
+    // above most of them are the same in every key. One OR and AND over the
+    // keys finds them, so the histograms skip the rest.
+    uint64_t anyBits = 0, allBits = ~uint64_t(0);
+    for (uint32_t i = 0; i < count; i++) {
+        anyBits |= keys[i];
+        allBits &= keys[i];
+    }
+    uint64_t differing = anyBits ^ allBits;
+    int bytes[8];
+    int byteCount = 0;
+    for (int b = 0; b < 8; b++) {
+        if ((differing >> (b * 8)) & 0xFF)
+            bytes[byteCount++] = b;
+    }
+
+    // the histograms of those bytes in one pass over the keys
+    uint32_t histograms[8][256];
+    std::memset(histograms, 0, byteCount * sizeof(histograms[0]));
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t k = keys[i];
+        for (int n = 0; n < byteCount; n++)
+            histograms[n][(k >> (bytes[n] * 8)) & 0xFF]++;
+    }
+
+    uint64_t* srcKeys = keys;
+    uint32_t* srcValues = values;
+    uint64_t* dstKeys = tmpKeys;
+    uint32_t* dstValues = tmpValues;
+    for (int n = 0; n < byteCount; n++) {
+        uint32_t* h = histograms[n];
+        int shift = bytes[n] * 8;
+
+        uint32_t offset = 0;
+        for (int d = 0; d < 256; d++) {
+            uint32_t c = h[d];
+            h[d] = offset;
+            offset += c;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t slot = h[(srcKeys[i] >> shift) & 0xFF]++;
+            dstKeys[slot] = srcKeys[i];
+            dstValues[slot] = srcValues[i];
+        }
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    if (srcKeys != keys) {
+        std::memcpy(keys, srcKeys, count * sizeof(uint64_t));
+        std::memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+}
+
+CommandBuffer::CommandBuffer()
+    : packets(capacity), keys(capacity), order(capacity), tmpKeys(capacity),
+      tmpOrder(capacity), count(0) {
+}
+
+void CommandBuffer::clear() {
+    count = 0;
+}
+
+bool CommandBuffer::add(uint64_t key, const DrawPacket& packet) {
+    if (count == capacity)
+        return false;
+    packets[count] = packet;
+    keys[count] = key;
+    order[count] = count;
+    count++;
+    return true;
+}
+
+void CommandBuffer::sort() {
+    radixSort(keys.data(), order.data(), count, tmpKeys.data(), tmpOrder.data());
+}
+
+uint32_t CommandBuffer::passBegin(RenderPass pass) const {
+    return static_cast<uint32_t>(
+        std::lower_bound(keys.begin(), keys.begin() + count, passBits(pass)) - keys.begin());
+}
@@ -0,0 +1,109 @@
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <cstdint>
+#include <vector>
+
+// Draw submission by sort key.
+//
+// Renderers don't draw directly. Each one records draw packets into a
+// CommandBuffer, tagged with a 64-bit key, and once everything for the frame
+// is recorded the keys are radix sorted and the packets run in that order
+// (see GlState::execute in glstate.h). The key decides the order:
+//
+//   63..60  pass: opaque, then blended, then composite, then overlay
+//   59..48  program, so draws sharing a shader run together
+//   47..32  material (texture, buffer or whatever the renderer sorts by)
+//   31..0   depth: near to far for opaque draws so early-z can reject
+//           hidden pixels, far to near for blended ones
+//
+// Blended draws put depth above program and material instead, since
+// drawing them back to front matters more than saving a program switch.
+// Composite and overlay draws use a plain sequence number in place of
+// depth. Composite draws put the finished scene on screen (see
+// SceneTarget in scenetarget.h); the caller switches framebuffers before
+// running them, so the overlay lands on top at full resolution.
+
+enum class RenderPass : uint8_t {
+    Opaque,
+    Blended,
+    Composite,
+    Overlay
+};
+
+// Fixed-function state a packet needs; anything not set is off.
+enum RenderState : uint8_t {
+    RENDER_DEPTH_TEST = 1,
+    RENDER_DEPTH_WRITE = 2,
+    // src + dst * (1 - src alpha), for premultiplied colours
+    RENDER_BLEND_PREMULTIPLIED = 4,
+    // src + dst
+    RENDER_BLEND_ADDITIVE = 8
+};
+
+// One draw call and the state it runs with. setUniforms, if given, is called
+// after the program is bound and before the draw, for uniforms that change
+// between packets of the same program.
+struct DrawPacket {
+    unsigned int program;
+    unsigned int vao;
+    // bound to texture unit 0 when non-zero
+    unsigned int texture;
+    // GL primitive type, e.g. GL_TRIANGLE_STRIP
+    uint32_t mode;
+    uint32_t first;
+    uint32_t count;
+    // 0 for a non-instanced draw
+    uint32_t instances;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT to draw count indices from the
+    // vertex array's index buffer, starting at index first; 0 to draw the
+    // vertices in order
+    uint32_t indexType;
+    uint8_t state;
+    void (*setUniforms)(void* context);
+    void* context;
+};
+
+uint64_t opaqueKey(unsigned int program, uint32_t material, float depth);
+uint64_t blendedKey(unsigned int program, uint32_t material, float depth);
+uint64_t compositeKey(uint32_t order);
+uint64_t overlayKey(uint32_t order);
+
+// Stable sort of count key/value pairs by key. Large sorts go least
+// significant byte first, with a pass only for the bytes where the keys
+// differ, which with the key layout above is a few of them. Below about 1500
+// keys a merge sort is quicker, and short runs are insertion sorted. tmpKeys
+// and tmpValues need room for count entries.
+void radixSort(uint64_t* keys, uint32_t* values, uint32_t count,
+               uint64_t* tmpKeys, uint32_t* tmpValues);
+
+class CommandBuffer {
+public:
+    static constexpr uint32_t capacity = 4096;
+
+    CommandBuffer();
+
+    void clear();
+    // false (and the packet is dropped) when the buffer is full
+    bool add(uint64_t key, const DrawPacket& packet);
+    // Order the packets by key. Packets with equal keys keep the order they
+    // were added in.
+    void sort();
+
+    uint32_t size() const { return count; }
+    // i-th packet in sorted order, after sort()
+    const DrawPacket& operator[](uint32_t i) const { return packets[order[i]]; }
+    uint64_t key(uint32_t i) const { return keys[i]; }
+    // index of the first sorted packet in `pass` or a later one, after sort()
+    uint32_t passBegin(RenderPass pass) const;
+
+private:
+    std::vector<DrawPacket> packets;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;
+    std::vector<uint64_t> tmpKeys;
+    std::vector<uint32_t> tmpOrder;
+    uint32_t count;
+};
+
+#endif
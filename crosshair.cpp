@@ -0,0 +1,173 @@
+#include <GL/glew.h>
+
+#include "crosshair.h"
+#include "shader.h"
+
+#include <algorithm>
+
+namespace {
+
+// A square `extent` pixels either side of the screen's centre; the corners
+// come from gl_VertexID.
+const char* crosshairVertexSource =
+    "#version 330 core\n"
+    "uniform vec2 viewport;\n"
+    "uniform float extent;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+    "    gl_Position = vec4(corner * extent * 2.0 / viewport, 0.0, 1.0);\n"
+    "}\0";
+
+// Distances are in pixels from the screen's centre. The shape is the same in
+// every quadrant, so everything is folded into the first one: one arm along
+// each axis, plus the dot. A pixel is covered by how far inside the edge its
+// centre is, which antialiases the edges without any multisampling. Output
+// is premultiplied, the shape over its outline.
+const char* crosshairFragmentSource =
+    "#version 330 core\n"
+    "out vec4 FragColor;\n"
+    "uniform vec2 viewport;\n"
+    "uniform vec2 arm;\n"
+    "uniform float gap;\n"
+    "uniform float dotRadius;\n"
+    "uniform float outline;\n"
+    "uniform vec4 color;\n"
+    "uniform vec4 outlineColor;\n"
+    "float box(vec2 p, vec2 halfSize)\n"
+    "{\n"
+    "    vec2 d = abs(p) - halfSize;\n"
+    "    return length(max(d, 0.0)) + min(max(d.x, d.y), 0.0);\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 p = abs(gl_FragCoord.xy - 0.5 * viewport);\n"
+    "    float d = 1e6;\n"
+    "    if (arm.x > 0.0) {\n"
+    "        vec2 halfArm = 0.5 * arm;\n"
+    "        vec2 armCentre = vec2(gap + halfArm.x, 0.0);\n"
+    "        d = min(box(p - armCentre, halfArm), box(p.yx - armCentre, halfArm));\n"
+    "    }\n"
+    "    if (dotRadius > 0.0)\n"
+    "        d = min(d, length(p) - dotRadius);\n"
+    "    float fill = clamp(0.5 - d, 0.0, 1.0) * color.a;\n"
+    "    float border = clamp(0.5 - d + outline, 0.0, 1.0) * outlineColor.a;\n"
+    "    if (outline <= 0.0)\n"
+    "        border = 0.0;\n"
+    "    vec3 rgb = color.rgb * fill + outlineColor.rgb * border * (1.0 - fill);\n"
+    "    FragColor = vec4(rgb, fill + border * (1.0 - fill));\n"
+    "}\0";
+
+void setColor(int location, const uint8_t color[4]) {
+    glUniform4f(location, color[0] / 255.0f, color[1] / 255.0f, color[2] / 255.0f,
+                color[3] / 255.0f);
+}
+
+// over the HUD
+const uint32_t crosshairOrder = 1;
+
+}
+
+CrosshairStyle defaultCrosshairStyle() {
+    CrosshairStyle style;
+    style.length = 7.0f;
+    style.thickness = 2.0f;
+    style.gap = 4.0f;
+    style.dotRadius = 0.0f;
+    style.outline = 1.0f;
+    style.spreadDistance = 6.0f;
+    const uint8_t color[4] = {80, 255, 120, 255};
+    const uint8_t outlineColor[4] = {0, 0, 0, 200};
+    std::copy(color, color + 4, style.color);
+    std::copy(outlineColor, outlineColor + 4, style.outlineColor);
+    return style;
+}
+
+Crosshair::Crosshair()
+    : style(defaultCrosshairStyle()), spread(0.0f), width(0), height(0),
+      styleDirty(true), spreadDirty(true), viewportDirty(true), program(0), vao(0),
+      viewportLocation(-1), extentLocation(-1), armLocation(-1), dotLocation(-1),
+      outlineLocation(-1), gapLocation(-1), colorLocation(-1),
+      outlineColorLocation(-1) {
+}
+
+Crosshair::~Crosshair() {
+    if (program) {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+    }
+}
+
+bool Crosshair::setup(const CrosshairStyle& initial) {
+    program = buildShaderProgram(crosshairVertexSource, crosshairFragmentSource);
+    if (!program)
+        return false;
+    viewportLocation = glGetUniformLocation(program, "viewport");
+    extentLocation = glGetUniformLocation(program, "extent");
+    armLocation = glGetUniformLocation(program, "arm");
+    dotLocation = glGetUniformLocation(program, "dotRadius");
+    outlineLocation = glGetUniformLocation(program, "outline");
+    gapLocation = glGetUniformLocation(program, "gap");
+    colorLocation = glGetUniformLocation(program, "color");
+    outlineColorLocation = glGetUniformLocation(program, "outlineColor");
+
+    // core profile still wants a vertex array bound to draw, even an empty one
+    glGenVertexArrays(1, &vao);
+    setStyle(initial);
+    return true;
+}
+
+void Crosshair::setStyle(const CrosshairStyle& newStyle) {
+    style = newStyle;
+    styleDirty = true;
+    spreadDirty = true;
+}
+
+void Crosshair::setSpread(float newSpread) {
+    newSpread = std::min(std::max(newSpread, 0.0f), 1.0f);
+    if (newSpread != spread) {
+        spread = newSpread;
+        spreadDirty = true;
+    }
+}
+
+void Crosshair::record(CommandBuffer& commands, int newWidth, int newHeight) {
+    if (!program)
+        return;
+    if (newWidth != width || newHeight != height) {
+        width = newWidth;
+        height = newHeight;
+        viewportDirty = true;
+    }
+    DrawPacket packet = {program, vao, 0, GL_TRIANGLE_STRIP, 0, 4, 0, 0,
+                         RENDER_BLEND_PREMULTIPLIED, &Crosshair::setUniforms, this};
+    commands.add(overlayKey(crosshairOrder), packet);
+}
+
+void Crosshair::setUniforms(void* context) {
+    Crosshair* self = static_cast<Crosshair*>(context);
+    const CrosshairStyle& style = self->style;
+
+    // Uniforms stay with the program, so only what changed is sent.
+    if (self->viewportDirty) {
+        glUniform2f(self->viewportLocation, static_cast<float>(self->width),
+                    static_cast<float>(self->height));
+        self->viewportDirty = false;
+    }
+    if (self->styleDirty) {
+        // big enough for the arms at full spread, plus a pixel of edge
+        float reach = std::max(style.gap + style.spreadDistance + style.length,
+                               style.dotRadius);
+        glUniform1f(self->extentLocation, reach + style.outline + 2.0f);
+        glUniform2f(self->armLocation, style.length, style.thickness);
+        glUniform1f(self->dotLocation, style.dotRadius);
+        glUniform1f(self->outlineLocation, style.outline);
+        setColor(self->colorLocation, style.color);
+        setColor(self->outlineColorLocation, style.outlineColor);
+        self->styleDirty = false;
+    }
+    if (self->spreadDirty) {
+        glUniform1f(self->gapLocation, style.gap + self->spread * style.spreadDistance);
+        self->spreadDirty = false;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef CROSSHAIR_H
+#define CROSSHAIR_H
+
+#include "commandbuffer.h"
+
+#include <cstdint>
+
+// The crosshair, drawn as signed distance shapes in a fragment shader.
+//
+// It's one small quad in the middle of the screen with no vertex buffer at
+// all. The shader works out each pixel's distance to the arms and the dot
+// from a handful of uniforms and shades by that, so every design costs the
+// same single draw, edges are antialiased for free, and changing a setting
+// only means changing a uniform. Uniforms are only sent when something
+// changed, so a frame where nothing did uploads nothing.
+
+// Lengths are in pixels.
+struct CrosshairStyle {
+    // each of the four arms; 0 for none (a dot only)
+    float length;
+    float thickness;
+    // from the centre to where the arms start
+    float gap;
+    // 0 for no centre dot
+    float dotRadius;
+    // dark border around everything; 0 for none
+    float outline;
+    // how far the arms move out at full spread (see Crosshair::setSpread)
+    float spreadDistance;
+    uint8_t color[4];
+    uint8_t outlineColor[4];
+};
+
+CrosshairStyle defaultCrosshairStyle();
+
+class Crosshair {
+public:
+    Crosshair();
+    ~Crosshair();
+
+    Crosshair(const Crosshair&) = delete;
+    Crosshair& operator=(const Crosshair&) = delete;
+
+    // Needs a current GL context.
+    bool setup(const CrosshairStyle& style);
+    void setStyle(const CrosshairStyle& style);
+    // 0 is at rest, 1 opens the arms by the style's spreadDistance.
+    void setSpread(float spread);
+
+    // Framebuffer size in pixels. Goes in the overlay pass, over the HUD.
+    void record(CommandBuffer& commands, int width, int height);
+
+private:
+    static void setUniforms(void* context);
+
+    CrosshairStyle style;
+    float spread;
+    int width, height;
+    bool styleDirty;
+    bool spreadDirty;
+    bool viewportDirty;
+
+    unsigned int program;
+    unsigned int vao;
+    int viewportLocation;
+    int extentLocation;
+    int armLocation;
+    int dotLocation;
+    int outlineLocation;
+    int gapLocation;
+    int colorLocation;
+    int outlineColorLocation;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "cull.h"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULL_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULL_SSE 1
+#endif
+
+namespace {
+
+bool sphereVisible(const Frustum& f, float maxDistance, float x, float y, float z, float r) {
+    for (int p = 0; p < 6; p++) {
+        if (f.nx[p] * x + f.ny[p] * y + f.nz[p] * z + f.d[p] < -r)
+            return false;
+    }
+    float reach = maxDistance + r;
+    return x * x + y * y + z * z <= reach * reach;
+}
+
+// Append the set lanes of an 8-bit mask as indices from base. Every lane is
+// written and only the visible ones advance, so there are no branches to
+// mispredict; out needs room for eight.
+inline uint32_t appendMask(uint32_t mask, uint32_t base, uint32_t* out) {
+    uint32_t n = 0;
+    for (uint32_t lane = 0; lane < 8; lane++) {
+        out[n] = base + lane;
+        n += (mask >> lane) & 1;
+    }
+    return n;
+}
+
+#if defined(CULL_SSE)
+// The frustum's planes broadcast across all lanes, set up once per call.
+struct Planes4 {
+    __m128 nx[6], ny[6], nz[6], d[6];
+};
+
+// Lanes of four spheres that are inside all six planes and within reach.
+inline int visible4(const Planes4& f, __m128 x, __m128 y, __m128 z, __m128 r,
+                    __m128 maxDistance) {
+    __m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, f.nx[p]), _mm_mul_ps(y, f.ny[p])),
+                                 _mm_add_ps(_mm_mul_ps(z, f.nz[p]), f.d[p]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, negR));
+    }
+    __m128 reach = _mm_add_ps(maxDistance, r);
+    __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    inside = _mm_and_ps(inside, _mm_cmple_ps(len2, _mm_mul_ps(reach, reach)));
+    return _mm_movemask_ps(inside);
+}
+#endif
+
+}
+
+Frustum cameraFrustum(const Camera& c) {
+    // Side planes go through the eye, tilted in from the view direction by
+    // half the field of view.
+    float halfY = 0.5f * c.fovY;
+    float halfX = std::atan(std::tan(halfY) * c.aspect);
+    float cx = std::cos(halfX), sx = std::sin(halfX);
+    float cy = std::cos(halfY), sy = std::sin(halfY);
+
+    float normals[6][3];
+    for (int i = 0; i < 3; i++) {
+        normals[0][i] = c.right[i] * cx + c.forward[i] * sx;    // left
+        normals[1][i] = -c.right[i] * cx + c.forward[i] * sx;   // right
+        normals[2][i] = c.up[i] * cy + c.forward[i] * sy;       // bottom
+        normals[3][i] = -c.up[i] * cy + c.forward[i] * sy;      // top
+        normals[4][i] = c.forward[i];                            // near
+        normals[5][i] = -c.forward[i];                           // far
+    }
+    Frustum f;
+    for (int p = 0; p < 6; p++) {
+        f.nx[p] = normals[p][0];
+        f.ny[p] = normals[p][1];
+        f.nz[p] = normals[p][2];
+        f.d[p] = 0.0f;
+    }
+    f.d[4] = -c.nearPlane;
+    f.d[5] = c.farPlane;
+    return f;
+}
+
+uint32_t cullSpheres(const Frustum& f, float maxDistance, const CullSpheres& s,
+                     uint32_t begin, uint32_t end, uint32_t* out) {
+    uint32_t n = 0;
+    uint32_t i = begin;
+#if defined(CULL_AVX)
+    const __m256 limit = _mm256_set1_ps(maxDistance);
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(s.x + i);
+        __m256 y = _mm256_loadu_ps(s.y + i);
+        __m256 z = _mm256_loadu_ps(s.z + i);
+        __m256 r = _mm256_loadu_ps(s.radius + i);
+        __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), r);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 dist = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(f.nx[p])),
+                              _mm256_mul_ps(y, _mm256_set1_ps(f.ny[p]))),
+                _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(f.nz[p])),
+                              _mm256_set1_ps(f.d[p])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, negR, _CMP_GE_OQ));
+        }
+        __m256 reach = _mm256_add_ps(limit, r);
+        __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)),
+                                    _mm256_mul_ps(z, z));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(len2, _mm256_mul_ps(reach, reach),
+                                                     _CMP_LE_OQ));
+        n += appendMask(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, out + n);
+    }
+#elif defined(CULL_SSE)
+    // eight at a time as two halves, to match the AVX loop's bookkeeping
+    const __m128 limit = _mm_set1_ps(maxDistance);
+    Planes4 planes;
+    for (int p = 0; p < 6; p++) {
+        planes.nx[p] = _mm_set1_ps(f.nx[p]);
+        planes.ny[p] = _mm_set1_ps(f.ny[p]);
+        planes.nz[p] = _mm_set1_ps(f.nz[p]);
+        planes.d[p] = _mm_set1_ps(f.d[p]);
+    }
+    for (; i + 8 <= end; i += 8) {
+        int lo = visible4(planes, _mm_loadu_ps(s.x + i), _mm_loadu_ps(s.y + i),
+                          _mm_loadu_ps(s.z + i), _mm_loadu_ps(s.radius + i), limit);
+        int hi = visible4(planes, _mm_loadu_ps(s.x + i + 4), _mm_loadu_ps(s.y + i + 4),
+                          _mm_loadu_ps(s.z + i + 4), _mm_loadu_ps(s.radius + i + 4), limit);
+        n += appendMask(static_cast<uint32_t>(lo | (hi << 4)), i, out + n);
+    }
+#endif
+    for (; i < end; i++) {
+        if (sphereVisible(f, maxDistance, s.x[i], s.y[i], s.z[i], s.radius[i]))
+            out[n++] = i;
+    }
+    return n;
+}
@@ -0,0 +1,99 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include "arena.h"
+#include "camera.h"
+#include "jobs.h"
+
+#include <cstdint>
+
+// Visibility culling for instanced draws: which bounding spheres are at
+// least partly inside the view frustum and within draw distance.
+//
+// Spheres come in structure-of-arrays form and are tested eight at a time
+// against all six planes (one AVX register, or two SSE2 ones where AVX isn't
+// enabled). The parallel version splits the spheres into chunks across the
+// job system. Each chunk compacts its survivors, a prefix sum over the chunk
+// counts gives every chunk its place in the output, and then the chunks hand
+// their survivors over in parallel. The output therefore comes out in the
+// input order and can be written straight into a mapped instance buffer.
+
+// Planes point inwards: a sphere is outside a plane when
+// nx*x + ny*y + nz*z + d < -radius.
+struct Frustum {
+    float nx[6], ny[6], nz[6], d[6];
+};
+
+Frustum cameraFrustum(const Camera& camera);
+
+struct CullSpheres {
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* radius;
+    uint32_t count;
+};
+
+struct CullStats {
+    uint32_t total;
+    uint32_t visible;
+};
+
+// Write the indices in [begin, end) of spheres that are visible and no
+// further than maxDistance from the eye (at the origin) into out, in order.
+// Returns how many there were.
+uint32_t cullSpheres(const Frustum& frustum, float maxDistance, const CullSpheres& spheres,
+                     uint32_t begin, uint32_t end, uint32_t* out);
+
+constexpr uint32_t CULL_CHUNK = 1024;
+
+// Cull across the job system, then call emit(offset, indices, count) once
+// per chunk, from worker threads, with that chunk's survivors and where they
+// start in the compacted output. Scratch space comes from frameArena; if it
+// runs out, nothing is visible this frame.
+template <typename F>
+CullStats cullSpheresParallel(const Frustum& frustum, float maxDistance,
+                              const CullSpheres& spheres, JobSystem* jobs,
+                              FrameArena& frameArena, F&& emit) {
+    CullStats stats = {spheres.count, 0};
+    uint32_t chunks = (spheres.count + CULL_CHUNK - 1) / CULL_CHUNK;
+    uint32_t* indices = frameArena.allocateArray<uint32_t>(spheres.count);
+    uint32_t* counts = frameArena.allocateArray<uint32_t>(chunks + 1);
+    if (chunks == 0 || !indices || !counts)
+        return stats;
+
+    auto cull = [&](uint32_t first, uint32_t last) {
+        for (uint32_t c = first; c < last; c++) {
+            uint32_t begin = c * CULL_CHUNK;
+            uint32_t end = begin + CULL_CHUNK < spheres.count ? begin + CULL_CHUNK : spheres.count;
+            counts[c] = cullSpheres(frustum, maxDistance, spheres, begin, end, indices + begin);
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(chunks, 1, cull);
+    else
+        cull(0, chunks);
+
+    // counts becomes each chunk's offset, with the total at the end
+    uint32_t offset = 0;
+    for (uint32_t c = 0; c <= chunks; c++) {
+        uint32_t n = c < chunks ? counts[c] : 0;
+        counts[c] = offset;
+        offset += n;
+    }
+    stats.visible = offset;
+
+    auto hand = [&](uint32_t first, uint32_t last) {
+        for (uint32_t c = first; c < last; c++) {
+            if (counts[c + 1] > counts[c])
+                emit(counts[c], indices + c * CULL_CHUNK, counts[c + 1] - counts[c]);
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(chunks, 1, hand);
+    else
+        hand(0, chunks);
+    return stats;
+}
+
+#endif
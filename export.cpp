@@ -0,0 +1,410 @@
+#include "export.h"
+#include "codec.h"
+#include "sim.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+namespace {
+
+const char* const sessionColumnNames[SESSION_EXPORT_COLUMNS] = {
+    "time", "tick", "type", "subject", "value0", "value1", "value2"
+};
+
+const uint32_t allColumns = 0xFFFFFFFFu;
+
+// Writes the framing around fields (header, separators, JSON keys), so the
+// exporters only say which column comes next and what goes in it.
+class RowFormatter {
+public:
+    RowFormatter(ExportWriter& out, ExportFormat format, const char* const* names,
+                 uint32_t count, uint32_t mask)
+        : out(out), format(format), names(names), count(count), mask(mask),
+          rows(0), fields(0) {}
+
+    bool wants(uint32_t column) const { return (mask >> column) & 1u; }
+    const char* empty() const { return format == ExportFormat::Json ? "null" : ""; }
+
+    void begin() {
+        if (format == ExportFormat::Json) {
+            out.put('[');
+            return;
+        }
+        bool first = true;
+        for (uint32_t c = 0; c < count; c++) {
+            if (!wants(c))
+                continue;
+            if (!first)
+                out.put(',');
+            out.put(names[c]);
+            first = false;
+        }
+        out.put('\n');
+    }
+
+    void end() {
+        if (format == ExportFormat::Json)
+            out.put(rows ? "\n]\n" : "]\n");
+    }
+
+    void beginRow() {
+        fields = 0;
+        if (format == ExportFormat::Json)
+            out.put(rows ? ",\n{" : "\n{");
+    }
+
+    void endRow() {
+        out.put(format == ExportFormat::Json ? '}' : '\n');
+        rows++;
+    }
+
+    // Separator, then the key for JSON. The caller writes the value.
+    void key(uint32_t column) {
+        if (fields++)
+            out.put(',');
+        if (format == ExportFormat::Json) {
+            out.put('"');
+            out.put(names[column]);
+            out.put("\":");
+        }
+    }
+
+    void text(const char* value) {
+        if (format == ExportFormat::Json)
+            out.put('"');
+        out.put(value);
+        if (format == ExportFormat::Json)
+            out.put('"');
+    }
+
+    int64_t rowCount() const { return static_cast<int64_t>(rows); }
+
+private:
+    ExportWriter& out;
+    ExportFormat format;
+    const char* const* names;
+    uint32_t count;
+    uint32_t mask;
+    uint64_t rows;
+    uint32_t fields;
+};
+
+bool parseColumns(const char* list, const char* const* names, uint32_t count,
+                  uint32_t& mask) {
+    mask = 0;
+    while (*list) {
+        const char* end = std::strchr(list, ',');
+        std::size_t length = end ? static_cast<std::size_t>(end - list) : std::strlen(list);
+        uint32_t c = 0;
+        while (c < count && !(std::strlen(names[c]) == length &&
+                              std::strncmp(names[c], list, length) == 0))
+            c++;
+        if (c == count) {
+            std::cout << "ERROR::EXPORT::UNKNOWN_COLUMN\n" << list << std::endl;
+            return false;
+        }
+        mask |= 1u << c;
+        list += length;
+        if (*list == ',')
+            list++;
+    }
+    return mask != 0;
+}
+
+// integer bounds for [from, to) over whole seconds
+int64_t lowerBound(double t) {
+    if (!(t > -9.0e18))
+        return std::numeric_limits<int64_t>::min();
+    return static_cast<int64_t>(std::ceil(t));
+}
+
+int64_t upperBound(double t) {
+    if (!(t < 9.0e18))
+        return std::numeric_limits<int64_t>::max();
+    return static_cast<int64_t>(std::ceil(t));
+}
+
+void writeRecord(RowFormatter& row, ExportWriter& out, const SessionRecord& r,
+                 double time) {
+    row.beginRow();
+    for (uint32_t c = 0; c < SESSION_EXPORT_COLUMNS; c++) {
+        if (!row.wants(c))
+            continue;
+        row.key(c);
+        switch (static_cast<SessionExportColumn>(c)) {
+        case SessionExportColumn::Time:
+            out.putFloat(static_cast<float>(time), row.empty());
+            break;
+        case SessionExportColumn::Tick:    out.putUint(r.tick);                   break;
+        case SessionExportColumn::Type:    row.text(recordTypeName(r.type));      break;
+        case SessionExportColumn::Subject: out.putUint(r.subject);                break;
+        case SessionExportColumn::Value0:  out.putFloat(r.values[0], row.empty()); break;
+        case SessionExportColumn::Value1:  out.putFloat(r.values[1], row.empty()); break;
+        case SessionExportColumn::Value2:  out.putFloat(r.values[2], row.empty()); break;
+        case SessionExportColumn::Count:   break;
+        }
+    }
+    row.endRow();
+}
+
+}
+
+/// ~~~ ExportWriter ~~~
+
+ExportWriter::ExportWriter()
+    : file(nullptr), ownsFile(false), error(false), used(0), written(0) {
+}
+
+ExportWriter::~ExportWriter() {
+    close();
+}
+
+bool ExportWriter::open(const char* path) {
+    close();
+    error = false;
+    used = 0;
+    written = 0;
+    if (std::strcmp(path, "-") == 0) {
+        file = stdout;
+        ownsFile = false;
+        return true;
+    }
+    file = std::fopen(path, "wb");
+    ownsFile = file != nullptr;
+    if (!file) {
+        std::cout << "ERROR::EXPORT::OPEN_FAILED\n" << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ExportWriter::close() {
+    if (!file)
+        return !error;
+    flush();
+    if (ownsFile) {
+        if (std::fclose(file) != 0)
+            error = true;
+    } else if (std::fflush(file) != 0) {
+        error = true;
+    }
+    file = nullptr;
+    if (error)
+        std::cout << "ERROR::EXPORT::WRITE_FAILED" << std::endl;
+    return !error;
+}
+
+void ExportWriter::flush() {
+    if (used && file && std::fwrite(buffer, 1, used, file) != used)
+        error = true;
+    written += used;
+    used = 0;
+}
+
+void ExportWriter::put(const char* text, std::size_t size) {
+    while (size) {
+        if (used == bufferSize)
+            flush();
+        std::size_t n = std::min(size, bufferSize - used);
+        std::memcpy(buffer + used, text, n);
+        used += n;
+        text += n;
+        size -= n;
+    }
+}
+
+void ExportWriter::put(const char* text) {
+    put(text, std::strlen(text));
+}
+
+// Numbers are formatted in place, so make sure the longest one fits first.
+void ExportWriter::putInt(int64_t value) {
+    if (bufferSize - used < 24)
+        flush();
+    used = std::to_chars(buffer + used, buffer + bufferSize, value).ptr - buffer;
+}
+
+void ExportWriter::putUint(uint64_t value) {
+    if (bufferSize - used < 24)
+        flush();
+    used = std::to_chars(buffer + used, buffer + bufferSize, value).ptr - buffer;
+}
+
+void ExportWriter::putFloat(float value, const char* empty) {
+    if (!std::isfinite(value)) {
+        put(empty);
+        return;
+    }
+    if (bufferSize - used < 32)
+        flush();
+    used = std::to_chars(buffer + used, buffer + bufferSize, value).ptr - buffer;
+}
+
+/// ~~~ Options ~~~
+
+const char* recordTypeName(RecordType type) {
+    switch (type) {
+    case RecordType::InputSample:   return "input";
+    case RecordType::Shot:          return "shot";
+    case RecordType::TargetSpawned: return "target_spawned";
+    case RecordType::TargetHit:     return "target_hit";
+    case RecordType::TargetExpired: return "target_expired";
+    case RecordType::ShotMissed:    return "shot_missed";
+    case RecordType::FrameTiming:   return "frame_timing";
+    case RecordType::ShotAim:       return "shot_aim";
+    }
+    return "unknown";
+}
+
+ExportOptions defaultExportOptions(ExportFormat format) {
+    ExportOptions options;
+    options.format = format;
+    options.columns = allColumns;
+    options.fromTime = -INFINITY;
+    options.toTime = INFINITY;
+    return options;
+}
+
+bool parseHistoryColumns(const char* list, uint32_t& mask) {
+    const char* names[HISTORY_COLUMNS];
+    for (uint32_t c = 0; c < HISTORY_COLUMNS; c++)
+        names[c] = historyColumnName(static_cast<HistoryColumn>(c));
+    return parseColumns(list, names, HISTORY_COLUMNS, mask);
+}
+
+bool parseSessionColumns(const char* list, uint32_t& mask) {
+    return parseColumns(list, sessionColumnNames, SESSION_EXPORT_COLUMNS, mask);
+}
+
+/// ~~~ Exporters ~~~
+
+int64_t exportHistory(const HistoryDb& db, const ExportOptions& options, ExportWriter& out) {
+    const char* names[HISTORY_COLUMNS];
+    for (uint32_t c = 0; c < HISTORY_COLUMNS; c++)
+        names[c] = historyColumnName(static_cast<HistoryColumn>(c));
+    RowFormatter row(out, options.format, names, HISTORY_COLUMNS, options.columns);
+
+    HistoryFilter filter = {lowerBound(options.fromTime), upperBound(options.toTime), true, 0};
+    // one block's worth of rows, reused for every block
+    std::unique_ptr<SessionSummary[]> rows(new SessionSummary[HistoryDb::blockRows]);
+
+    row.begin();
+    for (uint32_t b = 0; b < db.blocks(); b++) {
+        uint32_t n = db.readRows(b, filter, rows.get());
+        for (uint32_t i = 0; i < n; i++) {
+            const SessionSummary& s = rows[i];
+            row.beginRow();
+            for (uint32_t c = 0; c < HISTORY_COLUMNS; c++) {
+                if (!row.wants(c))
+                    continue;
+                row.key(c);
+                if (c == 0)
+                    out.putInt(s.startTime);
+                else if (c == 1)
+                    out.putUint(s.scenario);
+                else
+                    out.putFloat(s.values[c - 2], row.empty());
+            }
+            row.endRow();
+        }
+    }
+    row.end();
+    return row.rowCount();
+}
+
+int64_t exportSession(const char* path, const ExportOptions& options, ExportWriter& out) {
+    RowFormatter row(out, options.format, sessionColumnNames, SESSION_EXPORT_COLUMNS,
+                     options.columns);
+    auto inRange = [&](const SessionRecord& r, double& time) {
+        time = static_cast<double>(r.tick) / SIM_TICK_RATE;
+        return time >= options.fromTime && time < options.toTime;
+    };
+    double time;
+
+    if (isCompressedReplay(path)) {
+        ReplayDecoder decoder;
+        if (!decoder.open(path))
+            return -1;
+        SessionRecord record;
+        LogSnapshot snapshot;
+        row.begin();
+        for (;;) {
+            ReplayDecoder::Item item = decoder.next(record, snapshot);
+            if (item == ReplayDecoder::End)
+                break;
+            if (item == ReplayDecoder::Error)
+                return -1;
+            if (item == ReplayDecoder::Record && inRange(record, time))
+                writeRecord(row, out, record, time);
+        }
+        row.end();
+        return row.rowCount();
+    }
+
+    SessionLogReader reader;
+    if (!reader.open(path))
+        return -1;
+    SessionRecord record;
+    LogSnapshot snapshot;
+    row.begin();
+    for (;;) {
+        SessionLogReader::Item item = reader.next(record, snapshot);
+        if (item == SessionLogReader::End)
+            break;
+        if (item == SessionLogReader::Record && inRange(record, time))
+            writeRecord(row, out, record, time);
+    }
+    row.end();
+    return row.rowCount();
+}
+
+int exportFiles(int argc, char** argv) {
+    if (argc < 2 || argc % 2 != 0) {
+        std::cout << "usage: maxaim --export <history or session> <output> "
+                     "[--columns a,b,...] [--from t] [--to t]" << std::endl;
+        return 1;
+    }
+    const char* input = argv[0];
+    const char* output = argv[1];
+    bool history = isHistoryFile(input);
+
+    std::size_t length = std::strlen(output);
+    bool json = length >= 5 && std::strcmp(output + length - 5, ".json") == 0;
+    ExportOptions options = defaultExportOptions(json ? ExportFormat::Json : ExportFormat::Csv);
+    for (int i = 2; i + 1 < argc; i += 2) {
+        const char* value = argv[i + 1];
+        if (std::strcmp(argv[i], "--columns") == 0) {
+            bool ok = history ? parseHistoryColumns(value, options.columns)
+                              : parseSessionColumns(value, options.columns);
+            if (!ok)
+                return 1;
+        } else if (std::strcmp(argv[i], "--from") == 0) {
+            options.fromTime = std::strtod(value, nullptr);
+        } else if (std::strcmp(argv[i], "--to") == 0) {
+            options.toTime = std::strtod(value, nullptr);
+        } else {
+            std::cout << "ERROR::EXPORT::UNKNOWN_OPTION\n" << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    ExportWriter out;
+    if (!out.open(output))
+        return 1;
+    int64_t rows;
+    if (history) {
+        HistoryDb db;
+        rows = db.open(input) ? exportHistory(db, options, out) : -1;
+    } else {
+        rows = exportSession(input, options, out);
+    }
+    bool ok = out.close() && rows >= 0;
+    if (std::strcmp(output, "-") != 0)
+        std::cout << output << ": " << (ok ? rows : 0) << " rows" << std::endl;
+    return ok ? 0 : 1;
+}
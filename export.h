@@ -0,0 +1,113 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "history.h"
+#include "recorder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Exporting history and sessions as CSV or JSON for spreadsheets and
+// notebooks.
+//
+// Nothing is built up in memory: rows are formatted straight into a
+// fixed-size output buffer that is written out whenever it fills. History
+// and sessions are read one block at a time, so memory use doesn't grow with
+// the number of sessions or the length of one. Numbers are formatted with
+// std::to_chars, which gives the shortest text that reads back to the same
+// float.
+
+enum class ExportFormat : uint32_t {
+    Csv,
+    // one array of objects
+    Json
+};
+
+// Buffered output file. Write errors are remembered and reported by close().
+class ExportWriter {
+public:
+    static constexpr std::size_t bufferSize = 64 * 1024;
+
+    ExportWriter();
+    ~ExportWriter();
+
+    ExportWriter(const ExportWriter&) = delete;
+    ExportWriter& operator=(const ExportWriter&) = delete;
+
+    // "-" writes to stdout
+    bool open(const char* path);
+    // Flush and close; false if anything failed to write.
+    bool close();
+
+    void put(char c) {
+        if (used == bufferSize)
+            flush();
+        buffer[used++] = c;
+    }
+    void put(const char* text, std::size_t size);
+    void put(const char* text);
+    void putInt(int64_t value);
+    void putUint(uint64_t value);
+    // NaN and infinities come out as `empty` (which may be "")
+    void putFloat(float value, const char* empty);
+
+    uint64_t bytesWritten() const { return written + used; }
+
+private:
+    void flush();
+
+    std::FILE* file;
+    bool ownsFile;
+    bool error;
+    std::size_t used;
+    uint64_t written;
+    char buffer[bufferSize];
+};
+
+// Columns of a session export, one row per record.
+enum class SessionExportColumn : uint32_t {
+    Time,     // seconds since the session started, from the tick
+    Tick,
+    Type,     // record type name, see recordTypeName()
+    Subject,
+    Value0,   // meaning depends on the type, see recorder.h
+    Value1,
+    Value2,
+    Count
+};
+
+constexpr uint32_t SESSION_EXPORT_COLUMNS = static_cast<uint32_t>(SessionExportColumn::Count);
+
+const char* recordTypeName(RecordType type);
+
+struct ExportOptions {
+    ExportFormat format;
+    // one bit per column (HistoryColumn or SessionExportColumn)
+    uint32_t columns;
+    // Only rows with from <= time < to. For history that's the session's
+    // start time in Unix seconds; for a session, seconds since it started.
+    double fromTime;
+    double toTime;
+};
+
+// All columns, no time limits.
+ExportOptions defaultExportOptions(ExportFormat format);
+
+// Parse a comma-separated list of column names into a mask. Prints the
+// offending name and returns false if one isn't known.
+bool parseHistoryColumns(const char* list, uint32_t& mask);
+bool parseSessionColumns(const char* list, uint32_t& mask);
+
+// Return the number of rows written, or -1 if something failed.
+int64_t exportHistory(const HistoryDb& db, const ExportOptions& options, ExportWriter& out);
+// path is a session log or a compressed replay. Either is read as a stream,
+// a block at a time.
+int64_t exportSession(const char* path, const ExportOptions& options, ExportWriter& out);
+
+// `maxaim --export <history or session> <output> [--columns a,b,...]
+// [--from t] [--to t]`. The format is JSON if the output name ends in
+// .json, CSV otherwise. Returns 0 on success.
+int exportFiles(int argc, char** argv);
+
+#endif
@@ -0,0 +1,98 @@
+#include <GL/glew.h>
+
+#include "glstate.h"
+
+namespace {
+
+const uint8_t blendMask = RENDER_BLEND_PREMULTIPLIED | RENDER_BLEND_ADDITIVE;
+
+}
+
+GlState::GlState()
+    : known(false), program(0), vao(0), texture(0), state(0) {
+}
+
+void GlState::invalidate() {
+    known = false;
+}
+
+void GlState::setState(uint8_t wanted, RenderStats& stats) {
+    uint8_t changed = known ? static_cast<uint8_t>(state ^ wanted) : 0xFF;
+    if (!changed)
+        return;
+    stats.stateChanges++;
+    if (changed & RENDER_DEPTH_TEST) {
+        if (wanted & RENDER_DEPTH_TEST)
+            glEnable(GL_DEPTH_TEST);
+        else
+            glDisable(GL_DEPTH_TEST);
+    }
+    if (changed & RENDER_DEPTH_WRITE)
+        glDepthMask(wanted & RENDER_DEPTH_WRITE ? GL_TRUE : GL_FALSE);
+    if (changed & blendMask) {
+        if (wanted & blendMask) {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, wanted & RENDER_BLEND_ADDITIVE ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+        } else {
+            glDisable(GL_BLEND);
+        }
+    }
+    state = wanted;
+}
+
+RenderStats GlState::execute(const CommandBuffer& commands) {
+    return execute(commands, 0, commands.size());
+}
+
+RenderStats GlState::execute(const CommandBuffer& commands, uint32_t begin, uint32_t end) {
+    RenderStats stats = {0, 0, 0, 0};
+    if (!known) {
+        glDepthFunc(GL_LESS);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    for (uint32_t i = begin; i < end && i < commands.size(); i++) {
+        const DrawPacket& p = commands[i];
+        // after invalidate() the cached bindings may be stale, so the first
+        // packet binds everything it uses
+        bool forced = !known;
+        setState(p.state, stats);
+        known = true;
+
+        if (forced || p.program != program) {
+            glUseProgram(p.program);
+            program = p.program;
+            stats.programChanges++;
+        }
+        if (p.setUniforms)
+            p.setUniforms(p.context);
+        if (forced || p.vao != vao) {
+            glBindVertexArray(p.vao);
+            vao = p.vao;
+            stats.bindChanges++;
+        }
+        if (p.texture && (forced || p.texture != texture)) {
+            glBindTexture(GL_TEXTURE_2D, p.texture);
+            texture = p.texture;
+            stats.bindChanges++;
+        }
+
+        if (p.indexType) {
+            uintptr_t offset = p.first * (p.indexType == GL_UNSIGNED_SHORT ? 2u : 4u);
+            const void* indices = reinterpret_cast<const void*>(offset);
+            if (p.instances)
+                glDrawElementsInstanced(p.mode, p.count, p.indexType, indices, p.instances);
+            else
+                glDrawElements(p.mode, p.count, p.indexType, indices);
+        } else if (p.instances) {
+            glDrawArraysInstanced(p.mode, p.first, p.count, p.instances);
+        } else {
+            glDrawArrays(p.mode, p.first, p.count);
+        }
+        stats.draws++;
+    }
+
+    RenderStats ignored = stats;
+    setState(RENDER_DEPTH_WRITE, ignored);
+    known = true;
+    return stats;
+}
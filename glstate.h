@@ -0,0 +1,47 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include "commandbuffer.h"
+
+#include <cstdint>
+
+// What executing a command buffer cost in GL calls.
+struct RenderStats {
+    uint32_t draws;
+    uint32_t programChanges;
+    // vertex array and texture binds
+    uint32_t bindChanges;
+    // depth and blend state
+    uint32_t stateChanges;
+};
+
+// The GL side of draw submission. Runs a sorted CommandBuffer and remembers
+// what is bound, so each packet only changes what differs from the packet
+// before it.
+class GlState {
+public:
+    GlState();
+
+    // Forget what's bound, for after something drew outside the command
+    // buffer. The next packet executed rebinds its program, vertex array
+    // and texture even if they match the last ones this bound.
+    void invalidate();
+
+    // Needs a current GL context. Leaves depth writes on and everything
+    // else off, so the next frame's clear works.
+    RenderStats execute(const CommandBuffer& commands);
+    // Only sorted packets [begin, end), e.g. one pass (see
+    // CommandBuffer::passBegin).
+    RenderStats execute(const CommandBuffer& commands, uint32_t begin, uint32_t end);
+
+private:
+    void setState(uint8_t wanted, RenderStats& stats);
+
+    bool known;
+    unsigned int program;
+    unsigned int vao;
+    unsigned int texture;
+    uint8_t state;
+};
+
+#endif
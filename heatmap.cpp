@@ -0,0 +1,195 @@
+#include "heatmap.h"
+#include "codec.h"
+#include "history.h"
+#include "recorder.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+const float toDegrees = 57.2957795f;
+const float twoPi = 6.28318531f;
+
+// Chunks per thread. More than one so a thread that draws a run of long
+// sessions doesn't hold everyone up.
+const uint32_t chunksPerThread = 4;
+
+bool loadSession(const std::string& path, SessionLog& log) {
+    return isCompressedReplay(path.c_str()) ? readCompressedReplay(path.c_str(), log)
+                                            : readSessionLog(path.c_str(), log);
+}
+
+bool sessionScenario(const SessionLog& log, uint32_t& scenario) {
+    if (log.header.sessionInfoSize != sizeof(SimConfig))
+        return false;
+    SimConfig config;
+    std::memcpy(&config, log.header.sessionInfo, sizeof(config));
+    scenario = scenarioId(config);
+    return true;
+}
+
+// Only the game thread records shots, and per tick it writes the shot, then
+// its aim, then the outcome, so one pass in record order pairs them up.
+void binSession(const SessionLog& log, HeatmapSet& maps) {
+    bool pending = false, aimed = false;
+    uint32_t shotTick = 0;
+    float yaw = 0.0f, pitch = 0.0f;
+    float aimX = 0.0f, aimY = 0.0f;
+    for (const SessionRecord& r : log.records) {
+        switch (r.type) {
+        case RecordType::Shot:
+            pending = true;
+            aimed = false;
+            shotTick = r.tick;
+            // Yaw keeps accumulating as the player turns; the map wants it
+            // as a direction, within half a turn of straight ahead.
+            yaw = std::remainder(r.values[0], twoPi);
+            pitch = r.values[1];
+            break;
+        case RecordType::ShotAim:
+            if (pending && r.tick == shotTick && r.values[2] > 0.0f) {
+                aimed = true;
+                aimX = r.values[0] / r.values[2];
+                aimY = r.values[1] / r.values[2];
+            }
+            break;
+        case RecordType::TargetHit:
+        case RecordType::ShotMissed:
+            if (pending && r.tick == shotTick) {
+                HeatmapLayer layer = r.type == RecordType::TargetHit
+                    ? HeatmapLayer::Hits : HeatmapLayer::Misses;
+                maps.view.add(layer, yaw * toDegrees, pitch * toDegrees);
+                if (aimed)
+                    maps.target.add(layer, aimX, aimY);
+                pending = false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+}
+
+/// ~~~ Heatmap ~~~
+
+void Heatmap::clear(float x0, float x1, float y0, float y1) {
+    minX = x0;
+    maxX = x1;
+    minY = y0;
+    maxY = y1;
+    std::memset(bins, 0, sizeof(bins));
+    std::memset(total, 0, sizeof(total));
+    std::memset(outside, 0, sizeof(outside));
+}
+
+void Heatmap::add(HeatmapLayer layer, float x, float y) {
+    uint32_t l = static_cast<uint32_t>(layer);
+    total[l]++;
+    float u = (x - minX) / (maxX - minX) * HEATMAP_SIZE;
+    float v = (y - minY) / (maxY - minY) * HEATMAP_SIZE;
+    if (!(u >= 0.0f && u < HEATMAP_SIZE && v >= 0.0f && v < HEATMAP_SIZE)) {
+        outside[l]++;
+        return;
+    }
+    bins[l][static_cast<uint32_t>(v) * HEATMAP_SIZE + static_cast<uint32_t>(u)]++;
+}
+
+void Heatmap::merge(const Heatmap& other) {
+    for (uint32_t l = 0; l < HEATMAP_LAYERS; l++) {
+        uint32_t* into = bins[l];
+        const uint32_t* from = other.bins[l];
+        for (uint32_t i = 0; i < HEATMAP_SIZE * HEATMAP_SIZE; i++)
+            into[i] += from[i];
+        total[l] += other.total[l];
+        outside[l] += other.outside[l];
+    }
+}
+
+uint32_t Heatmap::peak(HeatmapLayer layer) const {
+    const uint32_t* b = bins[static_cast<uint32_t>(layer)];
+    return *std::max_element(b, b + HEATMAP_SIZE * HEATMAP_SIZE);
+}
+
+void HeatmapSet::clear() {
+    // two target radii each way, so near misses show up around the target
+    target.clear(-2.0f, 2.0f, -2.0f, 2.0f);
+    // degrees; wide enough for every spawn area we have
+    view.clear(-45.0f, 45.0f, -30.0f, 30.0f);
+}
+
+void HeatmapSet::merge(const HeatmapSet& other) {
+    target.merge(other.target);
+    view.merge(other.view);
+}
+
+/// ~~~ Building ~~~
+
+bool buildHeatmaps(const std::vector<std::string>& paths, bool anyScenario,
+                   uint32_t scenario, JobSystem* jobs, HeatmapSet& out,
+                   HeatmapStats* stats) {
+    out.clear();
+    HeatmapStats total = {0, 0, 0};
+    const uint32_t count = static_cast<uint32_t>(paths.size());
+
+    if (anyScenario) {
+        SessionLog log;
+        uint32_t i = 0;
+        while (i < count && !(loadSession(paths[i], log) && sessionScenario(log, scenario)))
+            i++;
+        if (i == count) {
+            std::cout << "ERROR::HEATMAP::NO_SESSIONS" << std::endl;
+            return false;
+        }
+    }
+
+    uint32_t threads = jobs ? jobs->threadCount() : 1;
+    uint32_t chunks = std::max(1u, std::min(count, threads * chunksPerThread));
+    uint32_t perChunk = count ? (count + chunks - 1) / chunks : 0;
+
+    // one set of histograms and counters per chunk, so binning never shares
+    std::unique_ptr<HeatmapSet[]> maps(new HeatmapSet[chunks]);
+    std::vector<HeatmapStats> chunkStats(chunks, HeatmapStats{0, 0, 0});
+    auto bin = [&](uint32_t begin, uint32_t end) {
+        SessionLog log;
+        for (uint32_t c = begin; c < end; c++) {
+            HeatmapSet& m = maps[c];
+            HeatmapStats& s = chunkStats[c];
+            m.clear();
+            uint32_t last = std::min(count, (c + 1) * perChunk);
+            for (uint32_t i = c * perChunk; i < last; i++) {
+                uint32_t id;
+                if (!loadSession(paths[i], log) || !sessionScenario(log, id)) {
+                    s.failed++;
+                    continue;
+                }
+                if (id != scenario) {
+                    s.skipped++;
+                    continue;
+                }
+                binSession(log, m);
+                s.sessions++;
+            }
+        }
+    };
+    if (jobs)
+        jobs->parallelFor(chunks, 1, bin);
+    else
+        bin(0, chunks);
+
+    for (uint32_t c = 0; c < chunks; c++) {
+        out.merge(maps[c]);
+        total.sessions += chunkStats[c].sessions;
+        total.failed += chunkStats[c].failed;
+        total.skipped += chunkStats[c].skipped;
+    }
+    if (stats)
+        *stats = total;
+    return true;
+}
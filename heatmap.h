@@ -0,0 +1,71 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "jobs.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where shots land, built from recorded sessions.
+//
+// Two maps per scenario:
+//   - on the target: where the shot went from the centre of the target it
+//     was judged against, in target radii (1 is the edge, and a hit is
+//     always inside it)
+//   - in view: the direction the shot was fired in, as yaw and pitch
+// Each map counts hits and misses separately.
+//
+// Sessions are binned in parallel. Each job gets its own run of sessions and
+// its own histograms, so there is no sharing while binning; the histograms
+// are summed once at the end.
+
+constexpr uint32_t HEATMAP_SIZE = 64;
+
+enum class HeatmapLayer : uint32_t {
+    Hits,
+    Misses,
+    Count
+};
+
+constexpr uint32_t HEATMAP_LAYERS = static_cast<uint32_t>(HeatmapLayer::Count);
+
+struct Heatmap {
+    // range covered by the bins; shots outside it are counted in `outside`
+    float minX, maxX;
+    float minY, maxY;
+    // row-major, row 0 at minY
+    uint32_t bins[HEATMAP_LAYERS][HEATMAP_SIZE * HEATMAP_SIZE];
+    uint32_t total[HEATMAP_LAYERS];
+    uint32_t outside[HEATMAP_LAYERS];
+
+    void clear(float minX, float maxX, float minY, float maxY);
+    void add(HeatmapLayer layer, float x, float y);
+    void merge(const Heatmap& other);
+    uint32_t peak(HeatmapLayer layer) const;
+};
+
+struct HeatmapSet {
+    Heatmap target;
+    Heatmap view;
+
+    void clear();
+    void merge(const HeatmapSet& other);
+};
+
+struct HeatmapStats {
+    uint32_t sessions;
+    // didn't load, or were played with a different scenario
+    uint32_t failed;
+    uint32_t skipped;
+};
+
+// Bin every shot in the given session logs or compressed replays played
+// with `scenario` (see scenarioId()) into out. If anyScenario is set, the
+// scenario of the first session that loads is used. jobs may be null to
+// bin on the calling thread.
+bool buildHeatmaps(const std::vector<std::string>& paths, bool anyScenario,
+                   uint32_t scenario, JobSystem* jobs, HeatmapSet& out,
+                   HeatmapStats* stats = nullptr);
+
+#endif
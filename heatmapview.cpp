@@ -0,0 +1,189 @@
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "heatmapview.h"
+#include "shader.h"
+#include "vertexformat.h"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// A unit quad; the vertex shader places it with the `rect` uniform (x0, y0,
+// x1, y1 in normalized device coordinates).
+const char* heatmapVertexSource =
+    "#version 330 core\n"
+    "layout (location = 0) in vec2 aCorner;\n"
+    "uniform vec4 rect;\n"
+    "out vec2 uv;\n"
+    "void main()\n"
+    "{\n"
+    "    uv = aCorner;\n"
+    "    gl_Position = vec4(mix(rect.xy, rect.zw, aCorner), 0.0, 1.0);\n"
+    "}\0";
+
+// Density comes in as red (hits) and green (misses), already scaled to
+// [0, 1]. It goes through a black-red-yellow-white heat ramp. `ring` draws
+// a circle of that radius in map units (the target's edge) when non-zero.
+const char* heatmapFragmentSource =
+    "#version 330 core\n"
+    "in vec2 uv;\n"
+    "out vec4 FragColor;\n"
+    "uniform sampler2D density;\n"
+    "uniform int layer;\n"
+    "uniform float ring;\n"
+    "uniform vec4 extent;\n"
+    "vec3 colormap(float t)\n"
+    "{\n"
+    "    const vec3 stops[5] = vec3[5](vec3(0.0, 0.0, 0.0), vec3(0.35, 0.05, 0.45),\n"
+    "                                  vec3(0.85, 0.15, 0.1), vec3(1.0, 0.75, 0.1),\n"
+    "                                  vec3(1.0, 1.0, 1.0));\n"
+    "    float x = clamp(t, 0.0, 1.0) * 4.0;\n"
+    "    int i = min(int(x), 3);\n"
+    "    return mix(stops[i], stops[i + 1], x - float(i));\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 d = texture(density, uv).rg;\n"
+    "    vec3 color = colormap(layer == 0 ? d.r : d.g);\n"
+    "    if (ring > 0.0) {\n"
+    "        vec2 p = mix(extent.xy, extent.zw, uv);\n"
+    "        float edge = abs(length(p) - ring);\n"
+    "        color = mix(color, vec3(0.3, 0.8, 1.0), 1.0 - smoothstep(0.0, fwidth(length(p)) * 1.5, edge));\n"
+    "    }\n"
+    "    FragColor = vec4(color, 1.0);\n"
+    "}\0";
+
+// Scale counts to [0, 1] on a log curve, so a few hot bins don't wash out
+// everything else.
+void fillDensity(const Heatmap& map, std::vector<float>& texels) {
+    texels.assign(HEATMAP_SIZE * HEATMAP_SIZE * 2, 0.0f);
+    for (uint32_t l = 0; l < HEATMAP_LAYERS; l++) {
+        uint32_t peak = map.peak(static_cast<HeatmapLayer>(l));
+        if (!peak)
+            continue;
+        float scale = 1.0f / std::log1p(static_cast<float>(peak));
+        for (uint32_t i = 0; i < HEATMAP_SIZE * HEATMAP_SIZE; i++)
+            texels[i * 2 + l] = std::log1p(static_cast<float>(map.bins[l][i])) * scale;
+    }
+}
+
+// corner of the unit square a map is drawn on
+struct Corner {
+    float x, y;
+};
+
+}
+
+template <>
+struct VertexLayout<Corner> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(Corner, x, 0, 2, AttribType::Float),
+    };
+};
+
+HeatmapView::HeatmapView()
+    : program(0), vao(0), vbo(0), textures{0, 0}, rectLocation(-1),
+      layerLocation(-1), ringLocation(-1), extentLocation(-1), extents{} {
+}
+
+HeatmapView::~HeatmapView() {
+    if (program) {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteTextures(2, textures);
+    }
+}
+
+bool HeatmapView::setup(const HeatmapSet& maps) {
+    program = buildShaderProgram(heatmapVertexSource, heatmapFragmentSource);
+    if (!program)
+        return false;
+    rectLocation = glGetUniformLocation(program, "rect");
+    layerLocation = glGetUniformLocation(program, "layer");
+    ringLocation = glGetUniformLocation(program, "ring");
+    extentLocation = glGetUniformLocation(program, "extent");
+
+    // two triangles covering the unit square
+    const Corner corners[] = {
+        {0.0f, 0.0f},  {1.0f, 0.0f},  {1.0f, 1.0f},
+        {0.0f, 0.0f},  {1.0f, 1.0f},  {0.0f, 1.0f}
+    };
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    applyVertexLayout<Corner>();
+    glBindVertexArray(0);
+
+    // The maps don't change while they're on screen, so this is the only
+    // upload.
+    const Heatmap* sources[2] = {&maps.target, &maps.view};
+    std::vector<float> texels;
+    glGenTextures(2, textures);
+    for (int i = 0; i < 2; i++) {
+        const Heatmap& map = *sources[i];
+        fillDensity(map, texels);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, HEATMAP_SIZE, HEATMAP_SIZE, 0, GL_RG,
+                     GL_FLOAT, texels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        extents[i][0] = map.minX;
+        extents[i][1] = map.minY;
+        extents[i][2] = map.maxX;
+        extents[i][3] = map.maxY;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void HeatmapView::draw(HeatmapLayer layer) const {
+    // target map square on the left, view map on the right
+    const float rects[2][4] = {
+        {-0.95f, -0.6f, -0.05f, 0.6f},
+        {0.05f, -0.45f, 0.95f, 0.45f}
+    };
+    glUseProgram(program);
+    glBindVertexArray(vao);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(layerLocation, static_cast<int>(layer));
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glUniform4fv(rectLocation, 1, rects[i]);
+        glUniform4fv(extentLocation, 1, extents[i]);
+        glUniform1f(ringLocation, i == 0 ? 1.0f : 0.0f);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    glBindVertexArray(0);
+}
+
+void runHeatmapViewer(GLFWwindow* window, const HeatmapSet& maps) {
+    HeatmapView view;
+    if (!view.setup(maps))
+        return;
+
+    HeatmapLayer layer = HeatmapLayer::Hits;
+    bool wasPressed = false;
+    while (!glfwWindowShouldClose(window)) {
+        bool pressed = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+        if (pressed && !wasPressed)
+            layer = layer == HeatmapLayer::Hits ? HeatmapLayer::Misses : HeatmapLayer::Hits;
+        wasPressed = pressed;
+
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        glViewport(0, 0, width, height);
+        glClearColor(0.08f, 0.08f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        view.draw(layer);
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+}
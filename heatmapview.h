@@ -0,0 +1,40 @@
+#ifndef HEATMAPVIEW_H
+#define HEATMAPVIEW_H
+
+#include "heatmap.h"
+
+struct GLFWwindow;
+
+// Draws a HeatmapSet: the on-target map on the left, the in-view map on the
+// right. The counts are uploaded once as textures at setup; drawing is just
+// two quads through a colormap shader.
+class HeatmapView {
+public:
+    HeatmapView();
+    ~HeatmapView();
+
+    HeatmapView(const HeatmapView&) = delete;
+    HeatmapView& operator=(const HeatmapView&) = delete;
+
+    // Needs a current GL context.
+    bool setup(const HeatmapSet& maps);
+    void draw(HeatmapLayer layer) const;
+
+private:
+    unsigned int program;
+    unsigned int vao;
+    unsigned int vbo;
+    // target, view
+    unsigned int textures[2];
+    int rectLocation;
+    int layerLocation;
+    int ringLocation;
+    int extentLocation;
+    float extents[2][4];
+};
+
+// Show the maps until the window is closed. M switches between hits and
+// misses.
+void runHeatmapViewer(GLFWwindow* window, const HeatmapSet& maps);
+
+#endif
@@ -0,0 +1,510 @@
+#include "history.h"
+#include "recorder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char fileMagic[8] = {'M', 'A', 'X', 'A', 'I', 'M', 'H', 'D'};
+const uint32_t historyVersion = 1;
+const uint32_t blockMagic = 0x4B4C4248;  // "HBLK"
+
+struct HistoryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t columns;
+    uint32_t blockRows;
+    uint32_t reserved[3];
+};
+
+struct ZoneMap {
+    double min, max;
+};
+
+struct HistoryBlockHeader {
+    uint32_t magic;
+    uint32_t rowCount;
+    ZoneMap zones[HISTORY_COLUMNS];
+};
+
+// Column data starts on a cache line boundary so scans begin on aligned
+// loads. The time column is 8 bytes per row, the rest 4.
+const std::size_t blockHeaderBytes = 256;
+static_assert(sizeof(HistoryBlockHeader) <= blockHeaderBytes,
+              "history block header outgrew its space");
+
+const std::size_t rows = HistoryDb::blockRows;
+const std::size_t blockBytes = blockHeaderBytes + rows * 8 + (HISTORY_COLUMNS - 1) * rows * 4;
+
+std::size_t columnOffset(uint32_t column) {
+    if (column == 0)
+        return blockHeaderBytes;
+    return blockHeaderBytes + rows * 8 + (column - 1) * rows * 4;
+}
+
+std::size_t columnWidth(uint32_t column) {
+    return column == 0 ? 8 : 4;
+}
+
+long blockOffset(uint32_t index) {
+    return static_cast<long>(sizeof(HistoryFileHeader) + index * blockBytes);
+}
+
+double columnValue(const SessionSummary& row, uint32_t column) {
+    if (column == 0)
+        return static_cast<double>(row.startTime);
+    if (column == 1)
+        return row.scenario;
+    return row.values[column - 2];
+}
+
+// Zone maps: false if no row in the block can pass the filter.
+bool blockCanMatch(const HistoryBlockHeader& header, const HistoryFilter& filter) {
+    const ZoneMap& times = header.zones[0];
+    const ZoneMap& scenarios = header.zones[1];
+    const double want = filter.scenario;
+    return header.rowCount != 0 &&
+           times.max >= static_cast<double>(filter.fromTime) &&
+           times.min < static_cast<double>(filter.toTime) &&
+           (filter.anyScenario || (want >= scenarios.min && want <= scenarios.max));
+}
+
+int64_t bucketOf(int64_t time, const HistoryFilter& filter, int64_t bucketSeconds) {
+    return (time - filter.fromTime) / bucketSeconds;
+}
+
+/// ~~~ Scans ~~~
+
+// These loops are branch-free over fixed-size lanes, which is what lets the
+// compiler turn them into SIMD code: one compare-and-mask pass over the
+// filter columns, then one masked reduction over the value column.
+
+const uint32_t lanes = 8;
+
+uint32_t selectRows(const int64_t* time, const uint32_t* scenario, uint32_t count,
+                    const HistoryFilter& filter, uint8_t* selected) {
+    int64_t from = filter.fromTime, to = filter.toTime;
+    uint8_t any = filter.anyScenario;
+    uint32_t want = filter.scenario;
+    uint32_t hits = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t keep = (time[i] >= from) & (time[i] < to) & (any | (scenario[i] == want));
+        selected[i] = keep;
+        hits += keep;
+    }
+    return hits;
+}
+
+// Every selected row lands in the same bucket.
+void reduceSelected(const float* values, const uint8_t* selected, uint32_t count,
+                    HistoryBucket& bucket) {
+    // Seed every lane with a selected value so unselected rows can't leak
+    // into min/max. The caller guarantees at least one row is selected.
+    uint32_t first = 0;
+    while (!selected[first])
+        first++;
+    float seedMin = bucket.count ? std::min(bucket.min, values[first]) : values[first];
+    float seedMax = bucket.count ? std::max(bucket.max, values[first]) : values[first];
+    float sums[lanes] = {};
+    float mins[lanes], maxs[lanes];
+    for (uint32_t j = 0; j < lanes; j++) {
+        mins[j] = seedMin;
+        maxs[j] = seedMax;
+    }
+
+    uint32_t i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        for (uint32_t j = 0; j < lanes; j++) {
+            float v = values[i + j];
+            bool keep = selected[i + j] != 0;
+            sums[j] += keep ? v : 0.0f;
+            mins[j] = keep ? std::min(mins[j], v) : mins[j];
+            maxs[j] = keep ? std::max(maxs[j], v) : maxs[j];
+        }
+    }
+    for (; i < count; i++) {
+        if (selected[i]) {
+            sums[0] += values[i];
+            mins[0] = std::min(mins[0], values[i]);
+            maxs[0] = std::max(maxs[0], values[i]);
+        }
+    }
+
+    double sum = 0.0;
+    float lo = mins[0], hi = maxs[0];
+    for (uint32_t j = 0; j < lanes; j++) {
+        sum += sums[j];
+        lo = std::min(lo, mins[j]);
+        hi = std::max(hi, maxs[j]);
+    }
+    bucket.sum += sum;
+    bucket.min = lo;
+    bucket.max = hi;
+}
+
+void addToBucket(HistoryBucket& bucket, float value) {
+    if (bucket.count == 0 || value < bucket.min)
+        bucket.min = value;
+    if (bucket.count == 0 || value > bucket.max)
+        bucket.max = value;
+    bucket.sum += value;
+    bucket.count++;
+}
+
+} // namespace
+
+/// ~~~ Summaries ~~~
+
+namespace {
+
+const char* const columnNames[HISTORY_COLUMNS] = {
+    "start_time", "scenario", "duration", "shots", "hits", "accuracy",
+    "time_to_kill", "reaction_time", "on_target", "overshoot"
+};
+
+}
+
+const char* historyColumnName(HistoryColumn column) {
+    uint32_t c = static_cast<uint32_t>(column);
+    return c < HISTORY_COLUMNS ? columnNames[c] : "";
+}
+
+HistoryColumn findHistoryColumn(const char* name) {
+    for (uint32_t c = 0; c < HISTORY_COLUMNS; c++) {
+        if (std::strcmp(columnNames[c], name) == 0)
+            return static_cast<HistoryColumn>(c);
+    }
+    return HistoryColumn::Count;
+}
+
+uint32_t scenarioId(const SimConfig& config) {
+    // everything but the seed: replaying a scenario with a new seed is still
+    // the same scenario
+    SimConfig c = config;
+    c.seed = 0;
+    return crc32(&c, sizeof(c));
+}
+
+SessionSummary summarizeSession(const SessionStats& stats,
+                                const SimConfig& config, int64_t startTime) {
+    SessionSummary row = {};
+    row.startTime = startTime;
+    row.scenario = scenarioId(config);
+    float* v = row.values;
+    v[static_cast<uint32_t>(HistoryColumn::Duration) - 2] = stats.ticks * SIM_DT;
+    v[static_cast<uint32_t>(HistoryColumn::Shots) - 2] = static_cast<float>(stats.shots);
+    v[static_cast<uint32_t>(HistoryColumn::Hits) - 2] = static_cast<float>(stats.hits);
+    v[static_cast<uint32_t>(HistoryColumn::Accuracy) - 2] = statsAccuracy(stats);
+    v[static_cast<uint32_t>(HistoryColumn::TimeToKill) - 2] = stats.timeToKill.quantile(0.5f);
+    v[static_cast<uint32_t>(HistoryColumn::ReactionTime) - 2] = stats.reactionTime.quantile(0.5f);
+    v[static_cast<uint32_t>(HistoryColumn::OnTarget) - 2] = statsOnTargetFraction(stats);
+    v[static_cast<uint32_t>(HistoryColumn::Overshoot) - 2] = statsMeanOvershoot(stats);
+    return row;
+}
+
+/// ~~~ HistoryDb ~~~
+
+bool isHistoryFile(const char* path) {
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f)
+        return false;
+    char magic[8] = {};
+    bool match = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                 std::memcmp(magic, fileMagic, sizeof(magic)) == 0;
+    std::fclose(f);
+    return match;
+}
+
+HistoryDb::HistoryDb()
+    : file(nullptr), mapping(nullptr), mappingSize(0),
+#ifdef _WIN32
+      mappingHandle(nullptr),
+#endif
+      blockCount(0), rowCount(0) {
+}
+
+HistoryDb::~HistoryDb() {
+    close();
+}
+
+bool HistoryDb::open(const char* path) {
+    close();
+
+    file = std::fopen(path, "r+b");
+    if (!file) {
+        file = std::fopen(path, "w+b");
+        if (!file) {
+            std::cout << "ERROR::HISTORY::OPEN_FAILED\n" << path << std::endl;
+            return false;
+        }
+        HistoryFileHeader header = {};
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.version = historyVersion;
+        header.columns = HISTORY_COLUMNS;
+        header.blockRows = blockRows;
+        std::fwrite(&header, sizeof(header), 1, file);
+        std::fflush(file);
+    }
+
+    HistoryFileHeader header;
+    std::fseek(file, 0, SEEK_SET);
+    if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+        std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 ||
+        header.version != historyVersion || header.columns != HISTORY_COLUMNS ||
+        header.blockRows != blockRows) {
+        std::cout << "ERROR::HISTORY::BAD_HEADER\n" << path << std::endl;
+        close();
+        return false;
+    }
+
+    if (!map()) {
+        close();
+        return false;
+    }
+
+    // Count whole blocks. A block whose header never got written (we died
+    // while adding it) ends the file; the next append overwrites it.
+    blockCount = 0;
+    rowCount = 0;
+    std::size_t available = (mappingSize - sizeof(HistoryFileHeader)) / blockBytes;
+    for (std::size_t i = 0; i < available; i++) {
+        HistoryBlockHeader h;
+        std::memcpy(&h, mapping + blockOffset(static_cast<uint32_t>(i)), sizeof(h));
+        if (h.magic != blockMagic || h.rowCount > blockRows)
+            break;
+        blockCount++;
+        rowCount += h.rowCount;
+    }
+    return true;
+}
+
+void HistoryDb::close() {
+    unmap();
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+    blockCount = 0;
+    rowCount = 0;
+}
+
+bool HistoryDb::map() {
+    unmap();
+    std::fflush(file);
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    if (size <= 0)
+        return false;
+    mappingSize = static_cast<std::size_t>(size);
+
+#ifdef _WIN32
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+    mappingHandle = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle)
+        mapping = static_cast<const unsigned char*>(
+            MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+    void* p = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fileno(file), 0);
+    mapping = p == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(p);
+#endif
+    if (!mapping) {
+        std::cout << "ERROR::HISTORY::MAP_FAILED" << std::endl;
+        mappingSize = 0;
+        return false;
+    }
+    return true;
+}
+
+void HistoryDb::unmap() {
+#ifdef _WIN32
+    if (mapping)
+        UnmapViewOfFile(mapping);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    mappingHandle = nullptr;
+#else
+    if (mapping)
+        munmap(const_cast<unsigned char*>(mapping), mappingSize);
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+const unsigned char* HistoryDb::block(uint32_t index) const {
+    return mapping + blockOffset(index);
+}
+
+bool HistoryDb::append(const SessionSummary& row) {
+    if (!file)
+        return false;
+
+    HistoryBlockHeader header;
+    uint32_t index = blockCount ? blockCount - 1 : 0;
+    if (blockCount)
+        std::memcpy(&header, block(index), sizeof(header));
+
+    if (!blockCount || header.rowCount == blockRows) {
+        // start a new block: zero-filled, with an empty header
+        index = blockCount;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = blockMagic;
+        static const unsigned char zeros[4096] = {};
+        std::fseek(file, blockOffset(index), SEEK_SET);
+        for (std::size_t left = blockBytes; left > 0;) {
+            std::size_t n = std::min(left, sizeof(zeros));
+            if (std::fwrite(zeros, 1, n, file) != n) {
+                std::cout << "ERROR::HISTORY::WRITE_FAILED" << std::endl;
+                return false;
+            }
+            left -= n;
+        }
+        std::fseek(file, blockOffset(index), SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, file);
+        if (!map())
+            return false;
+        blockCount++;
+    }
+
+    // values first, then the header that makes them count
+    uint32_t r = header.rowCount;
+    for (uint32_t c = 0; c < HISTORY_COLUMNS; c++) {
+        std::size_t width = columnWidth(c);
+        std::fseek(file, blockOffset(index) + static_cast<long>(columnOffset(c) + r * width),
+                   SEEK_SET);
+        if (c == 0) {
+            std::fwrite(&row.startTime, width, 1, file);
+        } else if (c == 1) {
+            std::fwrite(&row.scenario, width, 1, file);
+        } else {
+            std::fwrite(&row.values[c - 2], width, 1, file);
+        }
+    }
+    std::fflush(file);
+
+    for (uint32_t c = 0; c < HISTORY_COLUMNS; c++) {
+        double v = columnValue(row, c);
+        ZoneMap& zone = header.zones[c];
+        zone.min = r == 0 ? v : std::min(zone.min, v);
+        zone.max = r == 0 ? v : std::max(zone.max, v);
+    }
+    header.rowCount = r + 1;
+    std::fseek(file, blockOffset(index), SEEK_SET);
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    std::fflush(file);
+    if (!ok) {
+        std::cout << "ERROR::HISTORY::WRITE_FAILED" << std::endl;
+        return false;
+    }
+    rowCount++;
+    return true;
+}
+
+bool HistoryDb::aggregate(HistoryColumn column, const HistoryFilter& filter,
+                          int64_t bucketSeconds, HistoryBucket* buckets,
+                          uint32_t bucketCount, HistoryScanStats* scan) const {
+    uint32_t c = static_cast<uint32_t>(column);
+    if (!mapping || c < 2 || c >= HISTORY_COLUMNS || bucketSeconds <= 0) {
+        std::cout << "ERROR::HISTORY::BAD_QUERY" << std::endl;
+        return false;
+    }
+    for (uint32_t i = 0; i < bucketCount; i++)
+        buckets[i] = HistoryBucket{0, 0.0, 0.0f, 0.0f};
+    if (scan)
+        *scan = HistoryScanStats{0, 0};
+
+    uint8_t selected[blockRows];
+
+    for (uint32_t b = 0; b < blockCount; b++) {
+        const unsigned char* data = block(b);
+        HistoryBlockHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        uint32_t count = header.rowCount;
+
+        const ZoneMap& times = header.zones[0];
+        if (!blockCanMatch(header, filter)) {
+            if (scan)
+                scan->blocksSkipped++;
+            continue;
+        }
+        if (scan)
+            scan->blocksScanned++;
+
+        const int64_t* time = reinterpret_cast<const int64_t*>(data + columnOffset(0));
+        const uint32_t* scenario = reinterpret_cast<const uint32_t*>(data + columnOffset(1));
+        const float* values = reinterpret_cast<const float*>(data + columnOffset(c));
+        uint32_t hits = selectRows(time, scenario, count, filter, selected);
+        if (hits == 0)
+            continue;
+
+        // If the block's time range falls in one bucket, reduce it in one
+        // vectorized pass; otherwise route rows to buckets one by one.
+        int64_t first = std::max(static_cast<int64_t>(times.min), filter.fromTime);
+        int64_t last = std::min(static_cast<int64_t>(times.max), filter.toTime - 1);
+        int64_t firstBucket = bucketOf(first, filter, bucketSeconds);
+        if (firstBucket == bucketOf(last, filter, bucketSeconds)) {
+            if (firstBucket < 0 || firstBucket >= bucketCount)
+                continue;
+            HistoryBucket& bucket = buckets[firstBucket];
+            reduceSelected(values, selected, count, bucket);
+            bucket.count += hits;
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (!selected[i])
+                continue;
+            int64_t k = bucketOf(time[i], filter, bucketSeconds);
+            if (k >= 0 && k < bucketCount)
+                addToBucket(buckets[k], values[i]);
+        }
+    }
+    return true;
+}
+
+uint32_t HistoryDb::readRows(uint32_t index, const HistoryFilter& filter,
+                             SessionSummary* rows) const {
+    if (!mapping || index >= blockCount)
+        return 0;
+    const unsigned char* data = block(index);
+    HistoryBlockHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    uint32_t count = header.rowCount;
+
+    if (!blockCanMatch(header, filter))
+        return 0;
+
+    const int64_t* time = reinterpret_cast<const int64_t*>(data + columnOffset(0));
+    const uint32_t* scenario = reinterpret_cast<const uint32_t*>(data + columnOffset(1));
+    uint8_t selected[blockRows];
+    if (selectRows(time, scenario, count, filter, selected) == 0)
+        return 0;
+
+    // gather column by column, so each column is read front to back
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (selected[i]) {
+            rows[n].startTime = time[i];
+            rows[n].scenario = scenario[i];
+            n++;
+        }
+    }
+    for (uint32_t c = 2; c < HISTORY_COLUMNS; c++) {
+        const float* values = reinterpret_cast<const float*>(data + columnOffset(c));
+        uint32_t k = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (selected[i])
+                rows[k++].values[c - 2] = values[i];
+        }
+    }
+    return n;
+}
@@ -0,0 +1,131 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "sim.h"
+#include "stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Local history of every session played, for progress charts.
+//
+// One row per session, stored column by column so a query only reads the
+// columns it uses. Rows are grouped into fixed-size blocks. Each block header
+// keeps a zone map (the min and max of every column in the block), so whole
+// blocks that can't match a filter are skipped without reading their data.
+//
+// The file is append-only: a new row is written into unused space at the end
+// of the last block (or a new block) and only then counted in the block's
+// header, so a crash mid-append loses that row and nothing else. Queries read
+// the file through a read-only memory mapping and never build per-row objects.
+
+enum class HistoryColumn : uint32_t {
+    StartTime,     // int64 seconds since the Unix epoch
+    Scenario,      // uint32 scenario id, see scenarioId()
+    Duration,      // everything from here on is a float
+    Shots,
+    Hits,
+    Accuracy,
+    TimeToKill,    // median, seconds
+    ReactionTime,  // median, seconds
+    OnTarget,      // fraction of ticks
+    Overshoot,     // mean, radians
+    Count
+};
+
+constexpr uint32_t HISTORY_COLUMNS = static_cast<uint32_t>(HistoryColumn::Count);
+
+struct SessionSummary {
+    int64_t startTime;
+    uint32_t scenario;
+    // indexed by HistoryColumn, starting at Duration
+    float values[HISTORY_COLUMNS - 2];
+};
+
+// snake_case names, for exports
+const char* historyColumnName(HistoryColumn column);
+// HistoryColumn::Count if there's no column by that name
+HistoryColumn findHistoryColumn(const char* name);
+
+// Sessions played with the same config count as the same scenario.
+uint32_t scenarioId(const SimConfig& config);
+
+SessionSummary summarizeSession(const SessionStats& stats,
+                                const SimConfig& config, int64_t startTime);
+
+// Rows whose start time is in [fromTime, toTime), optionally only one
+// scenario.
+struct HistoryFilter {
+    int64_t fromTime;
+    int64_t toTime;
+    bool anyScenario;
+    uint32_t scenario;
+};
+
+struct HistoryBucket {
+    uint32_t count;
+    double sum;
+    float min, max;
+
+    double mean() const { return count ? sum / count : 0.0; }
+};
+
+// What a query touched, for benchmarks.
+struct HistoryScanStats {
+    uint32_t blocksScanned;
+    uint32_t blocksSkipped;
+};
+
+// true if path is a history file (checks the magic only)
+bool isHistoryFile(const char* path);
+
+class HistoryDb {
+public:
+    static constexpr uint32_t blockRows = 4096;
+
+    HistoryDb();
+    ~HistoryDb();
+
+    HistoryDb(const HistoryDb&) = delete;
+    HistoryDb& operator=(const HistoryDb&) = delete;
+
+    // Opens the file, creating it if it doesn't exist.
+    bool open(const char* path);
+    void close();
+
+    bool append(const SessionSummary& row);
+
+    uint64_t rows() const { return rowCount; }
+    uint32_t blocks() const { return blockCount; }
+
+    // Aggregate one float column over the rows that pass the filter, bucketed
+    // by start time: row t goes in bucket (t - filter.fromTime) / bucketSeconds.
+    // Buckets past bucketCount are ignored. Fills `buckets` (zeroed first).
+    bool aggregate(HistoryColumn column, const HistoryFilter& filter,
+                   int64_t bucketSeconds, HistoryBucket* buckets,
+                   uint32_t bucketCount, HistoryScanStats* scan = nullptr) const;
+
+    // Copy the rows of one block that pass the filter into rows (room for
+    // blockRows) and return how many there were. Blocks the zone maps rule
+    // out are skipped without reading their columns. Reading a block at a
+    // time lets callers walk any amount of history in fixed memory.
+    uint32_t readRows(uint32_t block, const HistoryFilter& filter,
+                      SessionSummary* rows) const;
+
+private:
+    bool map();
+    void unmap();
+    const unsigned char* block(uint32_t index) const;
+
+    std::FILE* file;
+    const unsigned char* mapping;
+    std::size_t mappingSize;
+#ifdef _WIN32
+    void* mappingHandle;
+#endif
+    uint32_t blockCount;
+    uint64_t rowCount;
+};
+
+#endif
@@ -0,0 +1,395 @@
+#include <GL/glew.h>
+
+#include "hud.h"
+#include "shader.h"
+#include "vertexformat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// 5x7 pixel font for printable ASCII (' ' to '~'). One byte per row, top row
+// first, bit 4 is the leftmost pixel.
+const uint32_t fontWidth = 5;
+const uint32_t fontHeight = 7;
+const char firstChar = ' ';
+const char lastChar = '~';
+const uint8_t fontRows[lastChar - firstChar + 1][fontHeight] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // space
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04},  // !
+    {0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00},  // "
+    {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A},  // #
+    {0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04},  // $
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03},  // %
+    {0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D},  // &
+    {0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00},  // quote
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02},  // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08},  // )
+    {0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00},  // *
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00},  // +
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08},  // ,
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00},  // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C},  // .
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},  // /
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},  // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},  // 1
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},  // 2
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},  // 3
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},  // 4
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},  // 5
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},  // 6
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},  // 7
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},  // 8
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},  // 9
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00},  // :
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08},  // ;
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02},  // <
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00},  // =
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08},  // >
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04},  // ?
+    {0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E},  // @
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},  // A
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},  // B
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},  // C
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},  // D
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},  // E
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},  // F
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},  // G
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},  // H
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},  // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},  // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},  // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},  // L
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},  // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},  // N
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},  // O
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},  // P
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},  // Q
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},  // R
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},  // S
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},  // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},  // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},  // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},  // W
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},  // X
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},  // Y
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F},  // Z
+    {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E},  // [
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00},  // backslash
+    {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E},  // ]
+    {0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00},  // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F},  // _
+    {0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00},  // `
+    {0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F},  // a
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E},  // b
+    {0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E},  // c
+    {0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F},  // d
+    {0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E},  // e
+    {0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08},  // f
+    {0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E},  // g
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11},  // h
+    {0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E},  // i
+    {0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C},  // j
+    {0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12},  // k
+    {0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},  // l
+    {0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11},  // m
+    {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11},  // n
+    {0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E},  // o
+    {0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10},  // p
+    {0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01},  // q
+    {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10},  // r
+    {0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E},  // s
+    {0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06},  // t
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D},  // u
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04},  // v
+    {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A},  // w
+    {0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11},  // x
+    {0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E},  // y
+    {0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F},  // z
+    {0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02},  // {
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},  // |
+    {0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08},  // }
+    {0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00},  // ~
+};
+
+// Glyphs sit one font pixel apart.
+const float fontAdvance = fontWidth + 1.0f;
+
+// The distance field reaches this many font pixels either side of a glyph's
+// edge, which leaves room for the outline. Each font pixel gets
+// atlasScale x atlasScale texels.
+const float fieldSpread = 2.0f;
+const uint32_t atlasScale = 6;
+const uint32_t atlasColumns = 16;
+const uint32_t atlasRows = 6;
+const uint32_t cellWidth = static_cast<uint32_t>((fontWidth + 2 * fieldSpread) * atlasScale);
+const uint32_t cellHeight = static_cast<uint32_t>((fontHeight + 2 * fieldSpread) * atlasScale);
+const uint32_t atlasWidth = cellWidth * atlasColumns;
+const uint32_t atlasHeight = cellHeight * atlasRows;
+
+// under the crosshair
+const uint32_t hudOrder = 0;
+
+// Each glyph is an instance of a four-vertex strip; the corner comes from
+// gl_VertexID, so there are no per-vertex attributes at all.
+const char* hudVertexSource =
+    "#version 330 core\n"
+    "layout (location = 0) in vec4 aRect;\n"
+    "layout (location = 1) in vec2 aCell;\n"
+    "layout (location = 2) in vec2 aAnchor;\n"
+    "layout (location = 3) in vec4 aColor;\n"
+    "uniform vec2 viewport;\n"
+    "uniform vec2 cellSize;\n"
+    "out vec2 uv;\n"
+    "out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    vec2 p = aAnchor * viewport + aRect.xy + corner * aRect.zw;\n"
+    "    uv = aCell + corner * cellSize;\n"
+    "    color = aColor;\n"
+    "    gl_Position = vec4(p.x / viewport.x * 2.0 - 1.0, 1.0 - p.y / viewport.y * 2.0, 0.0, 1.0);\n"
+    "}\0";
+
+// The field is 0.5 on the glyph's edge. Output is premultiplied: the glyph
+// in its colour over a dark outline that fades out a little way outside.
+const char* hudFragmentSource =
+    "#version 330 core\n"
+    "in vec2 uv;\n"
+    "in vec4 color;\n"
+    "out vec4 FragColor;\n"
+    "uniform sampler2D atlas;\n"
+    "void main()\n"
+    "{\n"
+    "    float d = texture(atlas, uv).r;\n"
+    "    float w = max(fwidth(d) * 0.75, 1e-4);\n"
+    "    float fill = smoothstep(0.5 - w, 0.5 + w, d);\n"
+    "    float outline = smoothstep(0.3 - w, 0.3 + w, d) * 0.75;\n"
+    "    float alpha = (fill + (1.0 - fill) * outline) * color.a;\n"
+    "    FragColor = vec4(color.rgb * fill * color.a, alpha);\n"
+    "}\0";
+
+bool fontPixel(const uint8_t* rows, int x, int y) {
+    if (x < 0 || y < 0 || x >= int(fontWidth) || y >= int(fontHeight))
+        return false;
+    return (rows[y] >> (fontWidth - 1 - x)) & 1;
+}
+
+// Distance from (x, y) to the font pixel square at (px, py).
+float squareDistance(float x, float y, int px, int py) {
+    float dx = std::max({px - x, 0.0f, x - (px + 1)});
+    float dy = std::max({py - y, 0.0f, y - (py + 1)});
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+// Signed distance field of one glyph into its atlas cell: brute force over
+// the 35 pixels, which is plenty fast for something done once.
+void rasterizeGlyph(const uint8_t* rows, uint8_t* cell, uint32_t pitch) {
+    for (uint32_t ty = 0; ty < cellHeight; ty++) {
+        for (uint32_t tx = 0; tx < cellWidth; tx++) {
+            // texel centre in font pixels from the glyph's top left
+            float x = (tx + 0.5f) / atlasScale - fieldSpread;
+            float y = (ty + 0.5f) / atlasScale - fieldSpread;
+            bool inside = fontPixel(rows, int(std::floor(x)), int(std::floor(y)));
+            // Outside the 5x7 box counts as empty, so inside a glyph the
+            // box's edge is as far as the nearest empty space can be.
+            float nearest = inside
+                ? std::min({x, y, fontWidth - x, fontHeight - y})
+                : 1e9f;
+            for (int py = 0; py < int(fontHeight); py++) {
+                for (int px = 0; px < int(fontWidth); px++) {
+                    if (fontPixel(rows, px, py) != inside)
+                        nearest = std::min(nearest, squareDistance(x, y, px, py));
+                }
+            }
+            float signedDistance = inside ? nearest : -nearest;
+            float value = 0.5f + 0.5f * signedDistance / fieldSpread;
+            value = std::min(std::max(value, 0.0f), 1.0f);
+            cell[ty * pitch + tx] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+        }
+    }
+}
+
+}
+
+template <>
+struct VertexLayout<HudGlyph> {
+    static constexpr VertexAttrib attribs[] = {
+        // quad position and size
+        VERTEX_ATTRIB(HudGlyph, x, 0, 4, AttribType::Float),
+        VERTEX_ATTRIB(HudGlyph, u, 1, 2, AttribType::Float),
+        VERTEX_ATTRIB(HudGlyph, anchorX, 2, 2, AttribType::Float),
+        VERTEX_ATTRIB(HudGlyph, color, 3, 4, AttribType::UByteNorm),
+    };
+};
+
+Hud::Hud()
+    : glyphs(maxGlyphs), glyphCount(0), anyDirty(false), uploaded(0),
+      viewportWidth(0), viewportHeight(0), program(0), vao(0), vbo(0), atlas(0),
+      viewportLocation(-1), cellSizeLocation(-1) {
+    text.resize(maxGlyphs);
+}
+
+Hud::~Hud() {
+    if (program) {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteTextures(1, &atlas);
+    }
+}
+
+bool Hud::setup() {
+    program = buildShaderProgram(hudVertexSource, hudFragmentSource);
+    if (!program)
+        return false;
+    viewportLocation = glGetUniformLocation(program, "viewport");
+    cellSizeLocation = glGetUniformLocation(program, "cellSize");
+
+    // the atlas is built once and never touched again
+    std::vector<uint8_t> texels(atlasWidth * atlasHeight);
+    for (char c = firstChar; c <= lastChar; c++) {
+        uint32_t index = static_cast<uint32_t>(c - firstChar);
+        uint32_t column = index % atlasColumns, row = index / atlasColumns;
+        rasterizeGlyph(fontRows[index],
+                       texels.data() + row * cellHeight * atlasWidth + column * cellWidth,
+                       atlasWidth);
+    }
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, atlasHeight, 0, GL_RED,
+                 GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Room for every glyph up front; draw() only ever updates part of it.
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, maxGlyphs * sizeof(HudGlyph), NULL, GL_DYNAMIC_DRAW);
+    applyVertexLayout<HudGlyph>(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // anything added before setup still needs uploading
+    for (TextItem& item : items)
+        item.dirty = true;
+    anyDirty = !items.empty();
+    return true;
+}
+
+uint32_t Hud::addText(const HudTextStyle& style, uint32_t capacity, const char* initial) {
+    if (capacity == 0 || capacity > maxGlyphs - glyphCount)
+        return noText;
+    uint32_t id = static_cast<uint32_t>(items.size());
+    items.push_back(TextItem{style, glyphCount, capacity, 0, false});
+    glyphCount += capacity;
+    // never shown until setText, so force the first one through
+    items[id].length = capacity + 1;
+    setText(id, initial);
+    return id;
+}
+
+void Hud::setText(uint32_t id, const char* newText) {
+    if (id >= items.size())
+        return;
+    TextItem& item = items[id];
+    uint32_t length = static_cast<uint32_t>(strnlen(newText, item.capacity));
+    char* current = text.data() + item.first;
+    if (length == item.length && std::memcmp(current, newText, length) == 0)
+        return;
+    std::memcpy(current, newText, length);
+    item.length = length;
+    shape(id);
+}
+
+void Hud::shape(uint32_t id) {
+    const TextItem& item = items[id];
+    const HudTextStyle& style = item.style;
+    const char* chars = text.data() + item.first;
+
+    // one font pixel in screen pixels
+    float pixel = style.size / fontHeight;
+    float width = (item.length * fontAdvance - 1.0f) * pixel;
+    float x = style.x;
+    if (style.align == HudAlign::Right)
+        x -= width;
+    else if (style.align == HudAlign::Center)
+        x -= 0.5f * width;
+    // whole pixels keep small text from smearing
+    x = std::round(x);
+    float y = std::round(style.y);
+
+    const float cellU = 1.0f / atlasColumns, cellV = 1.0f / atlasRows;
+    for (uint32_t i = 0; i < item.capacity; i++) {
+        HudGlyph& g = glyphs[item.first + i];
+        g = HudGlyph{0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, style.anchorX, style.anchorY,
+                     {style.color[0], style.color[1], style.color[2], style.color[3]}};
+        if (i >= item.length || chars[i] == ' ')
+            continue;
+        char c = chars[i];
+        if (c < firstChar || c > lastChar)
+            c = '?';
+        uint32_t index = static_cast<uint32_t>(c - firstChar);
+        g.x = x + (i * fontAdvance - fieldSpread) * pixel;
+        g.y = y - fieldSpread * pixel;
+        g.width = (fontWidth + 2 * fieldSpread) * pixel;
+        g.height = (fontHeight + 2 * fieldSpread) * pixel;
+        g.u = (index % atlasColumns) * cellU;
+        g.v = (index / atlasColumns) * cellV;
+    }
+
+    items[id].dirty = true;
+    anyDirty = true;
+}
+
+void Hud::record(CommandBuffer& commands, int width, int height) {
+    if (!program || glyphCount == 0)
+        return;
+
+    // Items sit in the buffer in the order they were added, so runs of
+    // neighbouring changed items go up in one call, and unchanged ones in
+    // between are left alone.
+    if (anyDirty) {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        uint32_t i = 0;
+        while (i < items.size()) {
+            if (!items[i].dirty) {
+                i++;
+                continue;
+            }
+            uint32_t begin = items[i].first, end = begin;
+            for (; i < items.size() && items[i].dirty; i++) {
+                end = items[i].first + items[i].capacity;
+                items[i].dirty = false;
+            }
+            GLsizeiptr bytes = (end - begin) * sizeof(HudGlyph);
+            glBufferSubData(GL_ARRAY_BUFFER, begin * sizeof(HudGlyph), bytes,
+                            glyphs.data() + begin);
+            uploaded += bytes;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        anyDirty = false;
+    }
+
+    viewportWidth = width;
+    viewportHeight = height;
+    DrawPacket packet = {program, vao, atlas, GL_TRIANGLE_STRIP, 0, 4, glyphCount, 0,
+                         RENDER_BLEND_PREMULTIPLIED, &Hud::setUniforms, this};
+    commands.add(overlayKey(hudOrder), packet);
+}
+
+void Hud::setUniforms(void* context) {
+    const Hud* self = static_cast<const Hud*>(context);
+    glUniform2f(self->viewportLocation, static_cast<float>(self->viewportWidth),
+                static_cast<float>(self->viewportHeight));
+    glUniform2f(self->cellSizeLocation, 1.0f / atlasColumns, 1.0f / atlasRows);
+}
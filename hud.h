@@ -0,0 +1,105 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "commandbuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+// Text over the scene: score, timer, fps counters and their labels.
+//
+// Glyphs come from a small built-in 5x7 pixel font. At setup every glyph is
+// turned into a signed distance field in one atlas texture, so text is sharp
+// at any size and the shader can draw an outline around it for free.
+//
+// Each text item owns a fixed run of glyph slots in a single instance buffer.
+// setText() only reshapes an item when its text actually changed, and only
+// the items that changed are uploaded, so static labels go to the GPU once.
+// The whole HUD is then a single instanced draw.
+
+enum class HudAlign : uint8_t {
+    Left,
+    Right,
+    Center
+};
+
+struct HudTextStyle {
+    // Point of the window the text hangs off, from (0, 0) at the top left to
+    // (1, 1) at the bottom right, so text stays in its corner on resize.
+    float anchorX, anchorY;
+    // offset from the anchor in pixels, to the top of the text
+    float x, y;
+    // height of a capital letter in pixels
+    float size;
+    HudAlign align;
+    uint8_t color[4];
+};
+
+// One glyph quad, as it goes to the vertex shader (one instance each).
+struct HudGlyph {
+    // pixels from the anchor; a zero size draws nothing
+    float x, y, width, height;
+    // top left of the glyph's cell in the atlas
+    float u, v;
+    float anchorX, anchorY;
+    uint8_t color[4];
+};
+
+class Hud {
+public:
+    static constexpr uint32_t maxGlyphs = 2048;
+    static constexpr uint32_t noText = 0xFFFFFFFF;
+
+    Hud();
+    ~Hud();
+
+    Hud(const Hud&) = delete;
+    Hud& operator=(const Hud&) = delete;
+
+    // Builds the atlas and buffers. Needs a current GL context.
+    bool setup();
+
+    // Reserve room for `capacity` characters. Returns the item's id, or
+    // noText if the glyph buffer is full. Meant for setup time.
+    uint32_t addText(const HudTextStyle& style, uint32_t capacity, const char* text = "");
+    // Text past the item's capacity is cut off. Doesn't allocate.
+    void setText(uint32_t id, const char* text);
+
+    // Upload whatever changed and record one draw for every item, in the
+    // overlay pass. Framebuffer size in pixels.
+    void record(CommandBuffer& commands, int width, int height);
+
+    // total bytes sent to the instance buffer so far
+    uint64_t bytesUploaded() const { return uploaded; }
+
+private:
+    struct TextItem {
+        HudTextStyle style;
+        uint32_t first;
+        uint32_t capacity;
+        uint32_t length;
+        // reshaped since the last upload
+        bool dirty;
+    };
+
+    void shape(uint32_t id);
+    static void setUniforms(void* context);
+
+    std::vector<TextItem> items;
+    // each item's current text, `capacity` chars starting at its `first`
+    std::vector<char> text;
+    std::vector<HudGlyph> glyphs;
+    uint32_t glyphCount;
+    bool anyDirty;
+    uint64_t uploaded;
+    int viewportWidth, viewportHeight;
+
+    unsigned int program;
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int atlas;
+    int viewportLocation;
+    int cellSizeLocation;
+};
+
+#endif
@@ -0,0 +1,299 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+// which JobSystem (if any) the current thread works for, and its slot
+thread_local const JobSystem* currentSystem = nullptr;
+thread_local uint32_t currentIndex = 0;
+
+void pinToCore(std::thread::native_handle_type handle, uint32_t core) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(handle, sizeof(set), &set);
+#elif defined(_WIN32)
+    SetThreadAffinityMask(handle, DWORD_PTR(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#else
+    (void)handle;
+    (void)core;
+#endif
+}
+
+}
+
+/// ~~~ Chase-Lev deque ~~~
+//
+// Memory orderings follow Le, Pop, Cohen and Zappa Nardelli, "Correct and
+// Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013). The buffer
+// doesn't grow; when it's full the caller just runs the job itself.
+
+bool JobDeque::push(Job* job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity)
+        return false;
+
+    buffer[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+    // release publishes the job's contents to thieves that acquire bottom
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+Job* JobDeque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // last item: race any thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobDeque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Job* job = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+/// ~~~ Job system ~~~
+
+JobSystem::JobSystem(const JobSystemConfig& config) {
+    uint32_t count = config.threadCount;
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (uint32_t i = 0; i < count; i++) {
+        workers.push_back(new Worker());
+        workers[i]->rng = 0x9E3779B9u * (i + 1);
+    }
+
+    // the constructing thread is worker 0
+    currentSystem = this;
+    currentIndex = 0;
+
+    for (uint32_t i = 1; i < count; i++) {
+        threads.emplace_back(&JobSystem::workerLoop, this, i);
+        if (config.pinThreads)
+            pinToCore(threads.back().native_handle(), i);
+    }
+#ifdef __linux__
+    if (config.pinThreads)
+        pinToCore(pthread_self(), 0);
+#endif
+}
+
+JobSystem::~JobSystem() {
+    running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_all();
+    }
+    for (std::thread& t : threads)
+        t.join();
+    for (Worker* w : workers)
+        delete w;
+    if (currentSystem == this)
+        currentSystem = nullptr;
+}
+
+uint32_t JobSystem::currentWorker() const {
+    return currentSystem == this ? currentIndex : UINT32_MAX;
+}
+
+Job* JobSystem::allocateJob(JobFunction function, void* context,
+                            uint32_t begin, uint32_t end,
+                            JobCounter* counter) {
+    // A worker's ring is only ever touched by that worker, so threads that
+    // aren't workers get rings of their own.
+    static thread_local Job outsideRing[outsideRingSize];
+    static thread_local uint32_t outsideNext = 0;
+
+    uint32_t index = currentWorker();
+    Job* job;
+    if (index == UINT32_MAX) {
+        job = &outsideRing[outsideNext++ & (outsideRingSize - 1)];
+    } else {
+        Worker& w = *workers[index];
+        job = &w.jobs[w.nextJob++ & (jobRingSize - 1)];
+    }
+    job->function = function;
+    job->context = context;
+    job->begin = begin;
+    job->end = end;
+    job->counter = counter;
+    job->unfinishedDependencies.store(0, std::memory_order_relaxed);
+    job->successorCount = 0;
+
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    return job;
+}
+
+bool JobSystem::addDependency(Job* before, Job* after) {
+    if (before->successorCount >= MAX_JOB_SUCCESSORS) {
+        std::cout << "ERROR::JOBS::TOO_MANY_SUCCESSORS\n" << MAX_JOB_SUCCESSORS
+                  << std::endl;
+        assert(!"job has no room for another successor");
+        return false;
+    }
+    before->successors[before->successorCount++] = after;
+    after->unfinishedDependencies.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void JobSystem::submit(Job* job) {
+    // held back until its prerequisites release it
+    if (job->unfinishedDependencies.load(std::memory_order_acquire) != 0)
+        return;
+
+    uint32_t index = currentWorker();
+    if (index == UINT32_MAX) {
+        execute(job, index);
+        return;
+    }
+    enqueue(job, index);
+}
+
+void JobSystem::enqueue(Job* job, uint32_t index) {
+    // an outside thread doesn't own a deque to push to
+    if (index == UINT32_MAX || !workers[index]->deque.push(job)) {
+        execute(job, index);
+        return;
+    }
+    if (sleepers.load(std::memory_order_relaxed) > 0)
+        sleepCondition.notify_one();
+}
+
+void JobSystem::execute(Job* job, uint32_t index) {
+    job->function(job->context, job->begin, job->end);
+
+    // release successors whose last dependency this was
+    for (int i = 0; i < job->successorCount; i++) {
+        Job* next = job->successors[i];
+        if (next->unfinishedDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            enqueue(next, index);
+    }
+
+    if (job->counter)
+        job->counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+Job* JobSystem::findJob(uint32_t index) {
+    Worker& self = *workers[index];
+    if (Job* job = self.deque.pop())
+        return job;
+
+    // pick a random victim to start from so thieves spread out
+    uint32_t count = threadCount();
+    self.rng ^= self.rng << 13;
+    self.rng ^= self.rng >> 17;
+    self.rng ^= self.rng << 5;
+    uint32_t start = self.rng % count;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t victim = (start + i) % count;
+        if (victim == index)
+            continue;
+        if (Job* job = workers[victim]->deque.steal())
+            return job;
+    }
+    return nullptr;
+}
+
+bool JobSystem::runOne(uint32_t index) {
+    Job* job = findJob(index);
+    if (!job)
+        return false;
+    execute(job, index);
+    return true;
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    uint32_t index = currentWorker();
+    while (!counter.done()) {
+        if (index == UINT32_MAX || !runOne(index))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+    currentSystem = this;
+    currentIndex = index;
+
+    int idleSpins = 0;
+    while (running.load(std::memory_order_relaxed)) {
+        if (runOne(index)) {
+            idleSpins = 0;
+            continue;
+        }
+
+        // spin briefly since more work usually arrives within the same
+        // frame, then go to sleep until someone pushes a job
+        if (++idleSpins < 256) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepers.fetch_add(1);
+        sleepCondition.wait_for(lock, std::chrono::milliseconds(1));
+        sleepers.fetch_sub(1);
+        idleSpins = 0;
+    }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grainSize,
+                            JobFunction function, void* context) {
+    if (count == 0)
+        return;
+    if (grainSize == 0)
+        grainSize = 1;
+
+    // a few chunks per thread so stealing can even out uneven work
+    uint32_t chunk = std::max(grainSize, count / (threadCount() * 4) + 1);
+    if (chunk >= count || currentWorker() == UINT32_MAX) {
+        function(context, 0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (uint32_t begin = 0; begin < count; begin += chunk) {
+        uint32_t end = std::min(count, begin + chunk);
+        submit(allocateJob(function, context, begin, end, &counter));
+    }
+    wait(counter);
+}
@@ -0,0 +1,147 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A job is a plain function pointer plus a context pointer and an index range,
+// so scheduling one never allocates. Jobs that belong to a graph also carry
+// a count of prerequisites that haven't finished yet and a list of successors
+// to release when they finish.
+using JobFunction = void (*)(void* context, uint32_t begin, uint32_t end);
+
+constexpr int MAX_JOB_SUCCESSORS = 8;
+
+// Counts outstanding jobs. Whoever submitted them can wait() on it, and the
+// waiting thread helps run jobs instead of sleeping.
+struct JobCounter {
+    std::atomic<int> pending{0};
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+struct Job {
+    JobFunction function = nullptr;
+    void* context = nullptr;
+    uint32_t begin = 0;
+    uint32_t end = 0;
+
+    // decremented when this job finishes; may be null
+    JobCounter* counter = nullptr;
+
+    // graph bookkeeping, see JobSystem::addDependency()
+    std::atomic<int> unfinishedDependencies{0};
+    Job* successors[MAX_JOB_SUCCESSORS] = {};
+    int successorCount = 0;
+};
+
+// Chase-Lev work-stealing deque of fixed capacity. The owning worker pushes
+// and pops at the bottom; any other worker may steal from the top.
+class JobDeque {
+public:
+    static constexpr int64_t capacity = 4096;
+
+    bool push(Job* job);
+    Job* pop();
+    Job* steal();
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    alignas(64) std::atomic<Job*> buffer[capacity] = {};
+};
+
+struct JobSystemConfig {
+    // total threads including the one that creates the JobSystem; 0 means
+    // one per hardware thread
+    uint32_t threadCount = 0;
+    // pin worker N to core N
+    bool pinThreads = false;
+};
+
+class JobSystem {
+public:
+    explicit JobSystem(const JobSystemConfig& config = JobSystemConfig());
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    // Hand out a Job from the calling thread's ring of job storage. Slots are
+    // recycled after jobRingSize allocations (outsideRingSize for threads
+    // that aren't workers), which is far more than can be in flight at once.
+    // If counter is given it is incremented here, so a wait() can't return
+    // before jobs held back by dependencies have run.
+    Job* allocateJob(JobFunction function, void* context,
+                     uint32_t begin = 0, uint32_t end = 0,
+                     JobCounter* counter = nullptr);
+
+    // Make `after` wait for `before`. Both must be unsubmitted. A job has
+    // room for MAX_JOB_SUCCESSORS; past that the edge can't be added, which
+    // is reported (and asserts in debug builds) and returns false. The
+    // caller must not submit `after` expecting the order to hold.
+    bool addDependency(Job* before, Job* after);
+
+    // Schedule a job. Jobs with unfinished dependencies are held back until
+    // their last prerequisite finishes, so a whole graph can be submitted in
+    // any order. Only workers may push to the deques, so calls from threads
+    // that aren't part of this JobSystem run the job inline, along with any
+    // successors it releases.
+    void submit(Job* job);
+
+    // Run jobs until counter reaches zero.
+    void wait(JobCounter& counter);
+
+    // Split [0, count) into chunks of at least grainSize items and run
+    // function on each chunk across all threads. Blocks until done.
+    void parallelFor(uint32_t count, uint32_t grainSize,
+                     JobFunction function, void* context);
+
+    // Convenience wrapper for lambdas taking (begin, end). The lambda lives on
+    // the caller's stack, which is fine because parallelFor blocks.
+    template <typename F>
+    void parallelFor(uint32_t count, uint32_t grainSize, F&& f) {
+        using Fn = std::remove_reference_t<F>;
+        parallelFor(count, grainSize,
+                    [](void* context, uint32_t begin, uint32_t end) {
+                        (*static_cast<Fn*>(context))(begin, end);
+                    },
+                    const_cast<void*>(static_cast<const void*>(&f)));
+    }
+
+private:
+    static constexpr uint32_t jobRingSize = 8192;
+    static constexpr uint32_t outsideRingSize = 256;
+
+    struct Worker {
+        JobDeque deque;
+        Job jobs[jobRingSize];
+        uint32_t nextJob = 0;
+        uint32_t rng = 0;
+    };
+
+    void workerLoop(uint32_t index);
+    bool runOne(uint32_t index);
+    Job* findJob(uint32_t index);
+    void execute(Job* job, uint32_t index);
+    void enqueue(Job* job, uint32_t index);
+    uint32_t currentWorker() const;
+
+    std::vector<Worker*> workers;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{true};
+
+    // idle workers sleep here instead of spinning
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<int> sleepers{0};
+};
+
+#endif
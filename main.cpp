@@ -1,8 +1,137 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
-int main()
+#include "alloccount.h"
+#include "arena.h"
+#include "bench.h"
+#include "camera.h"
+#include "codec.h"
+#include "commandbuffer.h"
+#include "crosshair.h"
+#include "export.h"
+#include "glstate.h"
+#include "heatmap.h"
+#include "heatmapview.h"
+#include "history.h"
+#include "hud.h"
+#include "jobs.h"
+#include "mapview.h"
+#include "mesh.h"
+#include "motion.h"
+#include "particles.h"
+#include "particleview.h"
+#include "recorder.h"
+#include "replay.h"
+#include "resolution.h"
+#include "scenetarget.h"
+#include "sim.h"
+#include "stats.h"
+#include "targetview.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// radians of view rotation per pixel of mouse movement
+const float mouseSensitivity = 0.0015f;
+
+// vertical field of view in radians (about 69 degrees)
+const float fieldOfView = 1.2f;
+
+// targets further away than this aren't drawn
+const float drawDistance = 150.0f;
+
+// Instances go out with half-float positions while rounding moves them no
+// more than this many pixels on screen.
+const float maxHalfErrorPixels = 1.0f;
+
+// how fast the crosshair closes back up after a shot, per second
+const float crosshairRecovery = 12.0f;
+
+// most hit and miss particles alive at once; plenty for a burst per shot
+const uint32_t particleBudget = 4096;
+
+// GPU time the 3D scene may take, in milliseconds, before it's drawn at a
+// lower resolution; leaves room in a 144 Hz frame for the rest
+const float sceneBudgetMs = 5.0f;
+
+// number of frames to run before we expect gameplay to stop allocating
+const int warmupFrames = 120;
+
+// ticks between full sim snapshots in the session log (for replay seeking)
+const uint32_t snapshotInterval = 5 * SIM_TICK_RATE;
+
+// The simulation state holds fixed-size pools and the stats hold per-target
+// tables, so both are much too large for the stack.
+static SimState sim;
+static SessionStats stats;
+
+static void recordFrameTiming(SessionRecorder& recorder, uint32_t tick,
+                              uint64_t timeUs, float dt)
+{
+    SessionRecord r = {};
+    r.type = RecordType::FrameTiming;
+    r.tick = tick;
+    r.timeUs = timeUs;
+    r.values[0] = dt * 1000.0f;
+    recorder.record(r);
+}
+
+int main(int argc, char** argv)
 {
+    // `maxaim --replay a.mlog b.mlog ...` re-simulates recorded sessions
+    // without opening a window and checks their results
+    if (argc >= 2 && std::strcmp(argv[1], "--replay") == 0)
+        return replayFiles(argc - 2, argv + 2) == 0 ? 0 : 1;
+
+    // `maxaim --encode session.mlog replay.mrz` writes a compact replay
+    if (argc == 4 && std::strcmp(argv[1], "--encode") == 0)
+    {
+        SessionLog log;
+        BlockCompression compression = blockCompressionAvailable()
+            ? BlockCompression::Zstd : BlockCompression::None;
+        return readSessionLog(argv[2], log) &&
+               writeCompressedReplay(argv[3], log, compression) ? 0 : 1;
+    }
+
+    // `maxaim --analyze a.mlog ...` splits the aim movement before each shot
+    // into flicks and corrections and prints a summary per session
+    if (argc >= 2 && std::strcmp(argv[1], "--analyze") == 0)
+        return analyzeFiles(argc - 2, argv + 2) == 0 ? 0 : 1;
+
+    // `maxaim --export history.db out.csv ...` writes history or a session
+    // as CSV or JSON
+    if (argc >= 2 && std::strcmp(argv[1], "--export") == 0)
+        return exportFiles(argc - 2, argv + 2);
+
+    // `maxaim --bench` runs the offline benchmarks
+    if (argc >= 2 && std::strcmp(argv[1], "--bench") == 0)
+        return runBenchmarks();
+
+    // `maxaim --heatmap a.mlog ...` shows where shots landed, over every
+    // session played with the same scenario as the first one
+    static HeatmapSet heatmaps;
+    bool showHeatmaps = argc >= 3 && std::strcmp(argv[1], "--heatmap") == 0;
+    if (showHeatmaps)
+    {
+        JobSystem binningJobs;
+        HeatmapStats heatmapStats;
+        std::vector<std::string> paths(argv + 2, argv + argc);
+        if (!buildHeatmaps(paths, true, 0, &binningJobs, heatmaps, &heatmapStats))
+            return 1;
+        std::printf("%u sessions, %u other scenarios, %u failed; %u hits, %u misses\n",
+                    heatmapStats.sessions, heatmapStats.skipped, heatmapStats.failed,
+                    heatmaps.view.total[0], heatmaps.view.total[1]);
+    }
+
+    // `maxaim --map room.obj` plays in the given map instead of the built-in
+    // room
+    const char* mapPath =
+        argc == 3 && std::strcmp(argv[1], "--map") == 0 ? argv[2] : nullptr;
+
     // Initialize GLFW
     if (!glfwInit())
         return -1;
@@ -23,15 +152,283 @@ int main()
         return -1;
     }
 
+    if (showHeatmaps)
+    {
+        runHeatmapViewer(window, heatmaps);
+        glfwTerminate();
+        return 0;
+    }
+
+    // Renderers record their draws into this each frame; it's sorted and
+    // run in one go at the end.
+    CommandBuffer commands;
+    GlState glState;
+    // The 3D scene is drawn offscreen at whatever scale keeps its GPU time
+    // in budget, then stretched over the window under the HUD.
+    SceneTarget sceneTarget;
+    sceneTarget.setup();
+    GpuTimer sceneTimer;
+    sceneTimer.setup();
+    ResolutionController resolution(defaultResolutionConfig(sceneBudgetMs));
+    TargetView targetView;
+    targetView.setup();
+    ParticleSystem particles;
+    particles.setBudget(particleBudget);
+    ParticleView particleView;
+    particleView.setup();
+    const ParticleBurst hitEffect = hitBurst();
+    const ParticleBurst missEffect = missBurst();
+    Crosshair crosshair;
+    crosshair.setup(defaultCrosshairStyle());
+    float crosshairSpread = 0.0f;
+
+    // Score, accuracy and timer on the left and middle, fps on the right.
+    // Labels are set once here; only the numbers change from frame to frame.
+    Hud hud;
+    hud.setup();
+    const HudTextStyle labelStyle = {0.0f, 0.0f, 16.0f, 14.0f, 8.0f, HudAlign::Left,
+                                     {170, 175, 190, 255}};
+    const HudTextStyle valueStyle = {0.0f, 0.0f, 16.0f, 28.0f, 24.0f, HudAlign::Left,
+                                     {255, 255, 255, 255}};
+    HudTextStyle style = labelStyle;
+    hud.addText(style, 5, "SCORE");
+    style.x = 180.0f;
+    hud.addText(style, 3, "ACC");
+    style.anchorX = 0.5f;
+    style.x = 0.0f;
+    style.align = HudAlign::Center;
+    hud.addText(style, 4, "TIME");
+    style.anchorX = 1.0f;
+    style.x = -16.0f;
+    style.align = HudAlign::Right;
+    hud.addText(style, 3, "FPS");
+
+    style = valueStyle;
+    uint32_t scoreText = hud.addText(style, 7, "0");
+    style.x = 180.0f;
+    uint32_t accuracyText = hud.addText(style, 4, "-");
+    style.anchorX = 0.5f;
+    style.x = 0.0f;
+    style.align = HudAlign::Center;
+    uint32_t timeText = hud.addText(style, 6, "0:00");
+    style.anchorX = 1.0f;
+    style.x = -16.0f;
+    style.align = HudAlign::Right;
+    uint32_t fpsText = hud.addText(style, 5, "");
+    style = labelStyle;
+    style.anchorX = 1.0f;
+    style.x = -16.0f;
+    style.y = 60.0f;
+    style.align = HudAlign::Right;
+    uint32_t drawnText = hud.addText(style, 18, "");
+    style.y = 74.0f;
+    uint32_t resolutionText = hud.addText(style, 18, "");
+    char hudBuffer[24];
+    // fps is averaged over a quarter second so it's readable
+    int fpsFrames = 0;
+    float fpsTime = 0.0f;
+
+    // Hide the cursor and capture it so mouse movement turns the view
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    // Scratch memory for everything that only lives for one frame
+    FrameArena frameArena(4 << 20);
+
+    // Worker threads for data-parallel work (one per hardware thread)
+    JobSystem jobs;
+
+    SimConfig config = defaultSimConfig();
+    simInit(sim, config);
+    sim.sweptAim = true;
+    statsInit(stats);
+
+    // The map goes through the indexed mesh import either way; it only
+    // happens once, so report what it did.
+    MapView mapView;
+    {
+        std::vector<MeshVertex> soup;
+        if (!mapPath || !loadObjMesh(mapPath, soup))
+            buildArenaMesh(config.bounds, soup);
+        Mesh mesh;
+        MeshImportStats importStats =
+            importMesh(soup.data(), static_cast<uint32_t>(soup.size()), mesh);
+        mapView.setup(mesh);
+        std::printf("map: %u triangles, %u vertices (%u unindexed), ACMR %.2f -> %.2f, "
+                    "%u KB vertices + %u KB %s-bit indices\n",
+                    importStats.triangles, importStats.vertices, importStats.soupVertices,
+                    importStats.acmrBefore, importStats.acmrAfter,
+                    mapView.vertexBytes() / 1024, mapView.indexBytes() / 1024,
+                    meshFitsShortIndices(mesh) ? "16" : "32");
+    }
+    int64_t sessionStart = static_cast<int64_t>(std::time(nullptr));
+
+    // Everything that happens this session goes to an append-only log,
+    // written by a background thread. The sim config goes in the header so
+    // the session can be replayed.
+    SessionRecorder recorder;
+    recorder.open("session.mlog", 0, &config, sizeof(config));
+
+    SimInput input = {};
+    double lastX, lastY;
+    glfwGetCursorPos(window, &lastX, &lastY);
+    bool wasFiring = false;
+    bool pendingFire = false;
+    double fireTime = 0.0;
+    float fireYaw = 0.0f, firePitch = 0.0f;
+    double lastTime = glfwGetTime();
+    double accumulator = 0.0;
+    int frame = 0;
+
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
+        uint64_t frameAllocations = allocationCount();
+        frameArena.reset();
+
+        double now = glfwGetTime();
+        float dt = static_cast<float>(now - lastTime);
+        lastTime = now;
+        uint64_t nowUs = static_cast<uint64_t>(now * 1e6);
+
+        double x, y;
+        glfwGetCursorPos(window, &x, &y);
+        input.yaw += static_cast<float>(x - lastX) * mouseSensitivity;
+        input.pitch -= static_cast<float>(y - lastY) * mouseSensitivity;
+        lastX = x;
+        lastY = y;
+
+        // The sim runs at a fixed tick rate no matter the frame rate, which
+        // is what makes recorded sessions replayable. After a long stall
+        // (window drag, breakpoint) we drop time rather than fast-forward.
+        accumulator += dt;
+        if (accumulator > 0.25)
+            accumulator = 0.25;
+
+        // A click is held until the tick it falls in, with the sim time it
+        // happened at and where the view pointed, so the sim can judge it
+        // as of that moment instead of at the end of the tick
+        bool firing = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (firing && !wasFiring && !pendingFire)
+        {
+            pendingFire = true;
+            fireTime = sim.tick * static_cast<double>(SIM_DT) + accumulator;
+            fireYaw = input.yaw;
+            firePitch = input.pitch;
+        }
+        wasFiring = firing;
+
+        while (accumulator >= SIM_DT)
+        {
+            double tickEnd = (sim.tick + 1) * static_cast<double>(SIM_DT);
+            input.fire = pendingFire && tickEnd >= fireTime;
+            if (input.fire)
+            {
+                input.fireAge = static_cast<float>(tickEnd - fireTime);
+                input.fireYaw = fireYaw;
+                input.firePitch = firePitch;
+                pendingFire = false;
+                crosshairSpread = 1.0f;
+            }
+
+            uint32_t tick = sim.tick;
+            simUpdate(sim, input, frameArena, &jobs);
+            for (uint32_t i = 0; i < sim.eventCount; i++)
+            {
+                const SimEvent& e = sim.events[i];
+                if (e.type == SimEventType::TargetHit)
+                    particles.emit(hitEffect, e.x, e.y, e.z);
+                else if (e.type == SimEventType::ShotMissed)
+                    particles.emit(missEffect, e.x, e.y, e.z);
+            }
+            statsUpdate(stats, sim, input, tick);
+            recordTick(recorder, sim, input, tick, nowUs);
+            recordSnapshot(recorder, sim, snapshotInterval);
+            accumulator -= SIM_DT;
+        }
+        recordFrameTiming(recorder, sim.tick, nowUs, dt);
+        particles.update(dt);
+
+        crosshairSpread *= std::exp(-crosshairRecovery * dt);
+        crosshair.setSpread(crosshairSpread < 0.01f ? 0.0f : crosshairSpread);
+
+        std::snprintf(hudBuffer, sizeof(hudBuffer), "%u", stats.hits);
+        hud.setText(scoreText, hudBuffer);
+        if (stats.shots)
+        {
+            std::snprintf(hudBuffer, sizeof(hudBuffer), "%.0f%%", statsAccuracy(stats) * 100.0f);
+            hud.setText(accuracyText, hudBuffer);
+        }
+        uint32_t seconds = sim.tick / SIM_TICK_RATE;
+        std::snprintf(hudBuffer, sizeof(hudBuffer), "%u:%02u", seconds / 60, seconds % 60);
+        hud.setText(timeText, hudBuffer);
+        fpsFrames++;
+        fpsTime += dt;
+        if (fpsTime >= 0.25f)
+        {
+            std::snprintf(hudBuffer, sizeof(hudBuffer), "%.0f", fpsFrames / fpsTime);
+            hud.setText(fpsText, hudBuffer);
+            fpsFrames = 0;
+            fpsTime = 0.0f;
+        }
+        CullStats cullStats = targetView.cullStats();
+        std::snprintf(hudBuffer, sizeof(hudBuffer), "DRAWN %u/%u", cullStats.visible,
+                      cullStats.total);
+        hud.setText(drawnText, hudBuffer);
+        std::snprintf(hudBuffer, sizeof(hudBuffer), "RES %.0f%% %.1fMS",
+                      resolution.scale() * 100.0f, resolution.averageMs());
+        hud.setText(resolutionText, hudBuffer);
+
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        sceneTarget.begin(width, height, resolution.scale());
+        commands.clear();
+        if (width > 0 && height > 0)
+        {
+            Camera camera = makeCamera(input.yaw, input.pitch, fieldOfView,
+                                       static_cast<float>(width) / height, 0.05f, 200.0f);
+            bool halfPositions =
+                halfPositionsFit(camera, sceneTarget.sceneHeight(), maxHalfErrorPixels);
+            targetView.record(commands, sim, camera, drawDistance, halfPositions, &jobs,
+                              frameArena);
+            mapView.record(commands, camera);
+            particleView.record(commands, particles, camera, halfPositions);
+        }
+        sceneTarget.record(commands);
+        crosshair.record(commands, width, height);
+        hud.record(commands, width, height);
+        commands.sort();
+
+        // Everything above, simulation through recording and sorting the
+        // draws, is ours and must run allocation-free once warmed up.
+        // Executing the draws and presenting are driver and windowing calls,
+        // outside our control.
+        if (++frame > warmupFrames)
+            assertNoAllocationsSince(frameAllocations);
+
+        // Only the scene is timed and scaled; the HUD is always drawn at
+        // full resolution over it.
+        uint32_t composite = commands.passBegin(RenderPass::Composite);
+        sceneTimer.begin();
+        glState.execute(commands, 0, composite);
+        sceneTimer.end();
+        sceneTarget.end();
+        glState.execute(commands, composite, commands.size());
+        float sceneMs;
+        if (sceneTimer.poll(sceneMs))
+            resolution.update(sceneMs);
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
     // Cleanup
+    recorder.close();
+    statsPrint(stats);
+
+    // Add this session to the local history for progress charts
+    HistoryDb history;
+    if (history.open("history.db"))
+        history.append(summarizeSession(stats, config, sessionStart));
     glfwTerminate();
     return 0;
 }
-
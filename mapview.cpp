@@ -0,0 +1,132 @@
+#include <GL/glew.h>
+
+#include "mapview.h"
+#include "shader.h"
+#include "vertexformat.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char* mapVertexSource =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 aPos;\n"
+    "layout (location = 1) in vec3 aNormal;\n"
+    "uniform mat4 view;\n"
+    "uniform mat4 projection;\n"
+    "out vec3 position;\n"
+    "out vec3 normal;\n"
+    "void main()\n"
+    "{\n"
+    "    position = aPos;\n"
+    "    normal = aNormal;\n"
+    "    gl_Position = projection * view * vec4(aPos, 1.0);\n"
+    "}\0";
+
+// Flat grey lit from above and behind the player's right shoulder (the same
+// light as the targets), with faint lines on every metre so distances read,
+// and fading into the clear colour with distance from the eye at the origin.
+const char* mapFragmentSource =
+    "#version 330 core\n"
+    "in vec3 position;\n"
+    "in vec3 normal;\n"
+    "out vec4 FragColor;\n"
+    "const vec3 light = vec3(0.32, 0.84, 0.44);\n"
+    "const vec3 background = vec3(0.08, 0.08, 0.1);\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 n = normalize(normal);\n"
+    "    float diffuse = max(dot(n, light), 0.0);\n"
+    "    vec3 color = vec3(0.2, 0.21, 0.25) * (0.35 + 0.65 * diffuse);\n"
+    "    vec3 pixels = abs(fract(position + 0.5) - 0.5) / fwidth(position);\n"
+    "    pixels += step(0.5, abs(n)) * 1e3;\n"
+    "    float line = 1.0 - clamp(min(min(pixels.x, pixels.y), pixels.z), 0.0, 1.0);\n"
+    "    color += line * 0.05;\n"
+    "    float fog = clamp(length(position) / 90.0, 0.0, 1.0);\n"
+    "    FragColor = vec4(mix(color, background, fog * fog), 1.0);\n"
+    "}\0";
+
+}
+
+template <>
+struct VertexLayout<MapVertex> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(MapVertex, x, 0, 3, AttribType::Float),
+        VERTEX_ATTRIB(MapVertex, normal, 1, 4, AttribType::Int2_10_10_10Norm),
+    };
+};
+
+MapView::MapView()
+    : program(0), vao(0), vbo(0), ibo(0), viewLocation(-1), projectionLocation(-1),
+      indexCount(0), indexType(0), vertexSize(0), indexSize(0), view{}, projection{} {
+}
+
+MapView::~MapView() {
+    if (program) {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ibo);
+    }
+}
+
+bool MapView::setup(const Mesh& mesh) {
+    program = buildShaderProgram(mapVertexSource, mapFragmentSource);
+    if (!program)
+        return false;
+    viewLocation = glGetUniformLocation(program, "view");
+    projectionLocation = glGetUniformLocation(program, "projection");
+
+    std::vector<MapVertex> vertices(mesh.vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const MeshVertex& v = mesh.vertices[i];
+        vertices[i] = MapVertex{v.x, v.y, v.z, packNormal(v.nx, v.ny, v.nz)};
+    }
+    vertexSize = static_cast<uint32_t>(vertices.size() * sizeof(MapVertex));
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexSize, vertices.data(), GL_STATIC_DRAW);
+    applyVertexLayout<MapVertex>();
+
+    // The index buffer binding belongs to the vertex array, so it stays
+    // bound until the vertex array isn't.
+    glGenBuffers(1, &ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    indexCount = static_cast<uint32_t>(mesh.indices.size());
+    if (meshFitsShortIndices(mesh)) {
+        std::vector<uint16_t> indices(mesh.indices.begin(), mesh.indices.end());
+        indexType = GL_UNSIGNED_SHORT;
+        indexSize = indexCount * sizeof(uint16_t);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize, indices.data(), GL_STATIC_DRAW);
+    } else {
+        indexType = GL_UNSIGNED_INT;
+        indexSize = indexCount * sizeof(uint32_t);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize, mesh.indices.data(),
+                     GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void MapView::setUniforms(void* context) {
+    const MapView* self = static_cast<const MapView*>(context);
+    glUniformMatrix4fv(self->viewLocation, 1, GL_FALSE, self->view);
+    glUniformMatrix4fv(self->projectionLocation, 1, GL_FALSE, self->projection);
+}
+
+void MapView::record(CommandBuffer& commands, const Camera& camera) {
+    if (!program || indexCount == 0)
+        return;
+    std::memcpy(view, camera.view, sizeof(view));
+    std::memcpy(projection, camera.projection, sizeof(projection));
+    // The map is behind everything else in the scene.
+    DrawPacket packet = {program, vao, 0, GL_TRIANGLES, 0, indexCount, 0, indexType,
+                         RENDER_DEPTH_TEST | RENDER_DEPTH_WRITE, &MapView::setUniforms, this};
+    commands.add(opaqueKey(program, vao, camera.farPlane), packet);
+}
@@ -0,0 +1,56 @@
+#ifndef MAPVIEW_H
+#define MAPVIEW_H
+
+#include "camera.h"
+#include "commandbuffer.h"
+#include "mesh.h"
+
+#include <cstdint>
+
+// Draws the arena's static geometry: one indexed mesh (see mesh.h), uploaded
+// once at setup and drawn in a single opaque packet. Vertices go up as a
+// float position and a 10:10:10:2 normal, and indices as 16 bits when the
+// mesh is small enough for them.
+
+// One map vertex, as it goes to the vertex shader.
+struct MapVertex {
+    float x, y, z;
+    uint32_t normal;
+};
+
+class MapView {
+public:
+    MapView();
+    ~MapView();
+
+    MapView(const MapView&) = delete;
+    MapView& operator=(const MapView&) = delete;
+
+    // Needs a current GL context. The mesh can go once this returns.
+    bool setup(const Mesh& mesh);
+    void record(CommandBuffer& commands, const Camera& camera);
+
+    // sizes of what setup uploaded
+    uint32_t vertexBytes() const { return vertexSize; }
+    uint32_t indexBytes() const { return indexSize; }
+
+private:
+    static void setUniforms(void* context);
+
+    unsigned int program;
+    unsigned int vao;
+    unsigned int vbo;
+    unsigned int ibo;
+    int viewLocation;
+    int projectionLocation;
+    uint32_t indexCount;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t indexType;
+    uint32_t vertexSize;
+    uint32_t indexSize;
+    // the camera as of the last record, for the packet's uniforms
+    float view[16];
+    float projection[16];
+};
+
+#endif
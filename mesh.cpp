@@ -0,0 +1,457 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Cache and scoring parameters from Forsyth's article. The modelled cache is
+// LRU and a little bigger than real ones, which works out well in practice
+// for hardware with anywhere from 12 to 32 entries.
+const uint32_t modelCacheSize = 32;
+const float cacheDecayPower = 1.5f;
+const float lastTriangleScore = 0.75f;
+const float valenceBoostScale = 2.0f;
+const float valenceBoostPower = 0.5f;
+// valence scores past this are all the same, near enough
+const uint32_t maxScoredValence = 32;
+
+// FIFO size vertexCacheMissRatio is reported with; a common stand-in for
+// real GPUs, which aren't LRU and don't say how big their caches are
+const uint32_t reportCacheSize = 16;
+
+// world units per tile in buildArenaMesh
+const float arenaTile = 2.0f;
+
+struct ScoreTables {
+    float cache[modelCacheSize];
+    float valence[maxScoredValence + 1];
+};
+
+ScoreTables makeScoreTables() {
+    ScoreTables t;
+    for (uint32_t i = 0; i < modelCacheSize; i++) {
+        // The three vertices of the triangle just drawn get a fixed score,
+        // so the next triangle doesn't simply reuse the same edge.
+        if (i < 3) {
+            t.cache[i] = lastTriangleScore;
+        } else {
+            float scaler = 1.0f / (modelCacheSize - 3);
+            t.cache[i] = std::pow(1.0f - (i - 3) * scaler, cacheDecayPower);
+        }
+    }
+    // Boost vertices with few triangles left, to finish them off rather
+    // than leave lone triangles behind.
+    t.valence[0] = 0.0f;
+    for (uint32_t i = 1; i <= maxScoredValence; i++)
+        t.valence[i] = valenceBoostScale * std::pow(float(i), -valenceBoostPower);
+    return t;
+}
+
+float vertexScore(const ScoreTables& t, int cachePosition, uint32_t remaining) {
+    if (remaining == 0)
+        return -1.0f;
+    float score = cachePosition >= 0 ? t.cache[cachePosition] : 0.0f;
+    return score + t.valence[std::min(remaining, maxScoredValence)];
+}
+
+uint32_t hashVertex(const MeshVertex& v) {
+    uint32_t words[6];
+    std::memcpy(words, &v, sizeof(words));
+    // FNV-1a over the words, then a final mix so the low bits are good
+    uint32_t h = 2166136261u;
+    for (uint32_t w : words)
+        h = (h ^ w) * 16777619u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+void emitQuad(std::vector<MeshVertex>& soup, const float* corner, const float* u,
+              const float* v, const float* normal) {
+    MeshVertex q[4];
+    for (int i = 0; i < 4; i++) {
+        float su = (i == 1 || i == 2) ? 1.0f : 0.0f;
+        float sv = i >= 2 ? 1.0f : 0.0f;
+        q[i].x = corner[0] + u[0] * su + v[0] * sv;
+        q[i].y = corner[1] + u[1] * su + v[1] * sv;
+        q[i].z = corner[2] + u[2] * su + v[2] * sv;
+        q[i].nx = normal[0];
+        q[i].ny = normal[1];
+        q[i].nz = normal[2];
+    }
+    const int order[6] = {0, 1, 2, 0, 2, 3};
+    for (int i : order)
+        soup.push_back(q[i]);
+}
+
+// A rectangle from origin along u and v, split into tiles about arenaTile
+// across and written out row by row. Counterclockwise seen from the side
+// u x v points to.
+void emitTiled(std::vector<MeshVertex>& soup, const float* origin, const float* u,
+               const float* v) {
+    float normal[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                       u[0] * v[1] - u[1] * v[0]};
+    float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                             normal[2] * normal[2]);
+    for (float& n : normal)
+        n /= length;
+    float uLength = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    float vLength = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    int nu = std::max(1, static_cast<int>(std::ceil(uLength / arenaTile - 0.01f)));
+    int nv = std::max(1, static_cast<int>(std::ceil(vLength / arenaTile - 0.01f)));
+    float du[3], dv[3];
+    for (int k = 0; k < 3; k++) {
+        du[k] = u[k] / nu;
+        dv[k] = v[k] / nv;
+    }
+    for (int j = 0; j < nv; j++) {
+        for (int i = 0; i < nu; i++) {
+            float corner[3];
+            for (int k = 0; k < 3; k++)
+                corner[k] = origin[k] + du[k] * i + dv[k] * j;
+            emitQuad(soup, corner, du, dv, normal);
+        }
+    }
+}
+
+// The four sides of a box standing on the floor; the top is out of sight.
+void emitPillar(std::vector<MeshVertex>& soup, float x, float z, float halfWidth,
+                float floorY, float height) {
+    float x0 = x - halfWidth, x1 = x + halfWidth;
+    float z0 = z - halfWidth, z1 = z + halfWidth;
+    float up[3] = {0.0f, height, 0.0f};
+    float w = 2.0f * halfWidth;
+    float front[3] = {x0, floorY, z1}, alongX[3] = {w, 0.0f, 0.0f};
+    float right[3] = {x1, floorY, z1}, backZ[3] = {0.0f, 0.0f, -w};
+    float back[3] = {x1, floorY, z0}, backX[3] = {-w, 0.0f, 0.0f};
+    float left[3] = {x0, floorY, z0}, alongZ[3] = {0.0f, 0.0f, w};
+    emitTiled(soup, front, alongX, up);
+    emitTiled(soup, right, backZ, up);
+    emitTiled(soup, back, backX, up);
+    emitTiled(soup, left, alongZ, up);
+}
+
+// Parse one face corner ("v", "v/t", "v//n" or "v/t/n"); OBJ indices start
+// at 1, and negative ones count back from the end.
+bool parseCorner(const char* token, size_t positions, size_t normals, long& position,
+                 long& normal) {
+    char* end;
+    position = std::strtol(token, &end, 10);
+    position = position < 0 ? static_cast<long>(positions) + position : position - 1;
+    if (end == token || position < 0 || position >= static_cast<long>(positions))
+        return false;
+    normal = -1;
+    if (*end == '/') {
+        const char* texcoord = end + 1;
+        std::strtol(texcoord, &end, 10);
+        if (*end == '/') {
+            const char* n = end + 1;
+            long i = std::strtol(n, &end, 10);
+            if (end != n) {
+                normal = i < 0 ? static_cast<long>(normals) + i : i - 1;
+                if (normal < 0 || normal >= static_cast<long>(normals))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+bool loadObjMesh(const char* path, std::vector<MeshVertex>& soup) {
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        std::cout << "ERROR::MESH::OPEN_FAILED\n" << path << std::endl;
+        return false;
+    }
+    std::vector<float> positions, normals;
+    std::vector<long> polygon;
+    soup.clear();
+    char line[1024];
+    uint32_t lineNumber = 0;
+    bool ok = true;
+    while (ok && std::fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        if (line[0] == 'v' && (line[1] == ' ' || line[1] == 'n')) {
+            std::vector<float>& out = line[1] == ' ' ? positions : normals;
+            char* p = line + 2;
+            for (int k = 0; k < 3; k++)
+                out.push_back(std::strtof(p, &p));
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            // pairs of position and normal index
+            polygon.clear();
+            for (char* token = std::strtok(line + 2, " \t\r\n"); token;
+                 token = std::strtok(nullptr, " \t\r\n")) {
+                long position, normal;
+                if (!parseCorner(token, positions.size() / 3, normals.size() / 3, position,
+                                 normal)) {
+                    ok = false;
+                    break;
+                }
+                polygon.push_back(position);
+                polygon.push_back(normal);
+            }
+            size_t corners = polygon.size() / 2;
+            if (!ok || corners < 3) {
+                ok = false;
+                break;
+            }
+            // a fan around the first corner
+            for (size_t i = 1; i + 1 < corners; i++) {
+                size_t tri[3] = {0, i, i + 1};
+                MeshVertex v[3];
+                for (int c = 0; c < 3; c++) {
+                    const float* p = &positions[polygon[tri[c] * 2] * 3];
+                    v[c].x = p[0];
+                    v[c].y = p[1];
+                    v[c].z = p[2];
+                }
+                float e1[3] = {v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z};
+                float e2[3] = {v[2].x - v[0].x, v[2].y - v[0].y, v[2].z - v[0].z};
+                float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                              e1[0] * e2[1] - e1[1] * e2[0]};
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (float& x : n)
+                    x = length > 0.0f ? x / length : 0.0f;
+                for (int c = 0; c < 3; c++) {
+                    long normal = polygon[tri[c] * 2 + 1];
+                    const float* source = normal >= 0 ? &normals[normal * 3] : n;
+                    v[c].nx = source[0];
+                    v[c].ny = source[1];
+                    v[c].nz = source[2];
+                    soup.push_back(v[c]);
+                }
+            }
+        }
+    }
+    std::fclose(f);
+    if (!ok) {
+        std::cout << "ERROR::MESH::BAD_FACE\n" << path << ":" << lineNumber << std::endl;
+        return false;
+    }
+    if (soup.empty()) {
+        std::cout << "ERROR::MESH::NO_FACES\n" << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void buildArenaMesh(const CollisionBounds& bounds, std::vector<MeshVertex>& soup) {
+    soup.clear();
+    // well clear of where targets fly, and reaching behind the player
+    float floorY = bounds.minY - 2.0f;
+    float topY = bounds.maxY + 8.0f;
+    float halfWidth = std::max(std::fabs(bounds.minX), std::fabs(bounds.maxX)) + 14.0f;
+    float backZ = bounds.minZ - 12.0f;
+    float frontZ = 6.0f;
+    float height = topY - floorY;
+    float width = 2.0f * halfWidth;
+    float depth = frontZ - backZ;
+
+    float floorCorner[3] = {-halfWidth, floorY, frontZ};
+    float alongX[3] = {width, 0.0f, 0.0f};
+    float intoZ[3] = {0.0f, 0.0f, -depth};
+    emitTiled(soup, floorCorner, alongX, intoZ);
+
+    float up[3] = {0.0f, height, 0.0f};
+    float backCorner[3] = {-halfWidth, floorY, backZ};
+    emitTiled(soup, backCorner, alongX, up);
+    float leftCorner[3] = {-halfWidth, floorY, frontZ};
+    emitTiled(soup, leftCorner, intoZ, up);
+    float rightCorner[3] = {halfWidth, floorY, backZ};
+    float outZ[3] = {0.0f, 0.0f, depth};
+    emitTiled(soup, rightCorner, outZ, up);
+
+    // pillars either side of the targets and behind them
+    float sideX = std::max(std::fabs(bounds.minX), std::fabs(bounds.maxX)) + 5.0f;
+    float nearZ = bounds.maxZ - 2.0f;
+    float farZ = bounds.minZ - 6.0f;
+    emitPillar(soup, -sideX, nearZ, 0.75f, floorY, height);
+    emitPillar(soup, sideX, nearZ, 0.75f, floorY, height);
+    emitPillar(soup, -sideX, farZ, 0.75f, floorY, height);
+    emitPillar(soup, sideX, farZ, 0.75f, floorY, height);
+    emitPillar(soup, 0.0f, farZ - 3.0f, 1.5f, floorY, height);
+}
+
+void mergeVertices(const MeshVertex* soup, uint32_t count, Mesh& mesh) {
+    mesh.vertices.clear();
+    mesh.indices.resize(count);
+    uint32_t tableSize = 16;
+    while (tableSize < count * 2)
+        tableSize *= 2;
+    // vertex index + 1, 0 for empty
+    std::vector<uint32_t> table(tableSize, 0);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t slot = hashVertex(soup[i]) & (tableSize - 1);
+        while (table[slot] &&
+               std::memcmp(&mesh.vertices[table[slot] - 1], &soup[i], sizeof(MeshVertex)))
+            slot = (slot + 1) & (tableSize - 1);
+        if (!table[slot]) {
+            mesh.vertices.push_back(soup[i]);
+            table[slot] = static_cast<uint32_t>(mesh.vertices.size());
+        }
+        mesh.indices[i] = table[slot] - 1;
+    }
+}
+
+void optimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount) {
+    uint32_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+    static const ScoreTables tables = makeScoreTables();
+
+    // each vertex's triangles, with the ones still to draw first
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t i = 0; i < indexCount; i++)
+        offsets[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    std::vector<uint32_t> remaining(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        remaining[v] = offsets[v + 1] - offsets[v];
+    std::vector<uint32_t> adjacency(indexCount);
+    std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < indexCount; i++)
+        adjacency[filled[indices[i]]++] = i / 3;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(tables, -1, remaining[v]);
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<uint8_t> drawn(triangleCount, 0);
+    for (uint32_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] +
+                           score[indices[t * 3 + 2]];
+
+    std::vector<uint32_t> output(indexCount);
+    uint32_t cache[modelCacheSize + 3];
+    uint32_t cached = 0;
+    // where to look for an undrawn triangle when nothing in the cache has one
+    uint32_t scan = 0;
+    uint32_t best = static_cast<uint32_t>(
+        std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+    for (uint32_t out = 0; out < triangleCount; out++) {
+        if (best == UINT32_MAX) {
+            while (drawn[scan])
+                scan++;
+            best = scan;
+        }
+        const uint32_t* tri = &indices[best * 3];
+        std::memcpy(&output[out * 3], tri, 3 * sizeof(uint32_t));
+        drawn[best] = 1;
+
+        // Take the triangle out of its vertices' lists, and put them at the
+        // front of the cache with everything else moved down.
+        uint32_t next[modelCacheSize + 3];
+        uint32_t nextCount = 0;
+        for (int c = 0; c < 3; c++) {
+            uint32_t v = tri[c];
+            uint32_t* list = &adjacency[offsets[v]];
+            uint32_t live = remaining[v];
+            for (uint32_t k = 0; k < live; k++) {
+                if (list[k] == best) {
+                    std::swap(list[k], list[live - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+            next[nextCount++] = v;
+        }
+        for (uint32_t k = 0; k < cached; k++) {
+            uint32_t v = cache[k];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                next[nextCount++] = v;
+        }
+
+        // Rescore every vertex whose position changed, and the undrawn
+        // triangles around it; the best of those goes next.
+        for (uint32_t k = 0; k < nextCount; k++) {
+            uint32_t v = next[k];
+            int position = k < modelCacheSize ? static_cast<int>(k) : -1;
+            cachePosition[v] = position;
+            float updated = vertexScore(tables, position, remaining[v]);
+            float delta = updated - score[v];
+            score[v] = updated;
+            const uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++)
+                triangleScore[list[j]] += delta;
+        }
+        best = UINT32_MAX;
+        float bestScore = -1.0f;
+        cached = std::min(nextCount, modelCacheSize);
+        for (uint32_t k = 0; k < cached; k++) {
+            uint32_t v = next[k];
+            cache[k] = v;
+            const uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                if (triangleScore[list[j]] > bestScore) {
+                    bestScore = triangleScore[list[j]];
+                    best = list[j];
+                }
+            }
+        }
+    }
+    std::memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+void optimizeVertexFetch(Mesh& mesh) {
+    std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    // anything no triangle uses is dropped
+    mesh.vertices.swap(vertices);
+}
+
+float vertexCacheMissRatio(const uint32_t* indices, uint32_t indexCount,
+                           uint32_t vertexCount, uint32_t cacheSize) {
+    if (indexCount < 3)
+        return 0.0f;
+    // A vertex is still cached if fewer than cacheSize misses have happened
+    // since it went in. The count starts at cacheSize so that stamp 0 means
+    // never seen.
+    std::vector<uint32_t> stamp(vertexCount, 0);
+    uint32_t clock = cacheSize;
+    uint32_t misses = 0;
+    for (uint32_t i = 0; i < indexCount; i++) {
+        uint32_t v = indices[i];
+        if (clock - stamp[v] >= cacheSize) {
+            stamp[v] = clock++;
+            misses++;
+        }
+    }
+    return float(misses) / (indexCount / 3);
+}
+
+MeshImportStats importMesh(const MeshVertex* soup, uint32_t count, Mesh& mesh) {
+    count -= count % 3;
+    mergeVertices(soup, count, mesh);
+    uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    MeshImportStats stats;
+    stats.soupVertices = count;
+    stats.triangles = count / 3;
+    stats.acmrBefore =
+        vertexCacheMissRatio(mesh.indices.data(), count, vertexCount, reportCacheSize);
+
+    optimizeVertexCache(mesh.indices.data(), count, vertexCount);
+    optimizeVertexFetch(mesh);
+    stats.vertices = static_cast<uint32_t>(mesh.vertices.size());
+    stats.acmrAfter = vertexCacheMissRatio(mesh.indices.data(), count, stats.vertices,
+                                           reportCacheSize);
+    return stats;
+}
@@ -0,0 +1,78 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "collision.h"
+
+#include <cstdint>
+#include <vector>
+
+// Static meshes (the arena's walls and floor) from triangle soup to an
+// indexed mesh ready for the GPU.
+//
+// Soup, as exporters and generators tend to write it, repeats every shared
+// corner once per triangle, and the vertex shader runs once per corner. An
+// indexed mesh stores each distinct vertex once, and the GPU keeps the last
+// few transformed vertices in a small post-transform cache, so a vertex
+// reused while it's still there isn't shaded again. importMesh:
+//
+//   1. merges identical vertices and builds the index list,
+//   2. reorders the triangles so vertices get reused while still cached
+//      (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"),
+//   3. renumbers the vertices in the order the triangles first use them,
+//      so vertex fetches walk memory forwards,
+//
+// and reports the average cache miss ratio (ACMR: vertices shaded per
+// triangle) before and after. Soup is 3; a well-ordered grid gets near 0.5.
+
+// One corner as it comes in. Vertices are merged only when every field is
+// bit-for-bit the same.
+struct MeshVertex {
+    float x, y, z;
+    float nx, ny, nz;
+};
+
+struct Mesh {
+    std::vector<MeshVertex> vertices;
+    // three per triangle
+    std::vector<uint32_t> indices;
+};
+
+struct MeshImportStats {
+    uint32_t soupVertices;
+    uint32_t vertices;
+    uint32_t triangles;
+    // ACMR with the triangles as they came in, after merging, and after
+    // reordering
+    float acmrBefore;
+    float acmrAfter;
+};
+
+// Read the triangles of a Wavefront OBJ file into soup (v, vn and f lines;
+// polygons are split into fans). Faces without normals get their face
+// normal. False if the file can't be read or has no faces.
+bool loadObjMesh(const char* path, std::vector<MeshVertex>& soup);
+
+// A room around the targets' bounds: a floor, three walls and a few
+// pillars, as soup tiled in 2 m squares, one surface at a time.
+void buildArenaMesh(const CollisionBounds& bounds, std::vector<MeshVertex>& soup);
+
+// All three steps at the top of the file, from count soup vertices (a
+// multiple of 3) to mesh.
+MeshImportStats importMesh(const MeshVertex* soup, uint32_t count, Mesh& mesh);
+
+// The steps on their own.
+void mergeVertices(const MeshVertex* soup, uint32_t count, Mesh& mesh);
+void optimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+void optimizeVertexFetch(Mesh& mesh);
+
+// Vertices shaded per triangle drawing indices through a FIFO
+// post-transform cache of cacheSize entries.
+float vertexCacheMissRatio(const uint32_t* indices, uint32_t indexCount,
+                           uint32_t vertexCount, uint32_t cacheSize);
+
+// Whether the mesh's indices fit 16 bits.
+inline bool meshFitsShortIndices(const Mesh& mesh) {
+    return mesh.vertices.size() <= 0x10000;
+}
+
+#endif
@@ -0,0 +1,377 @@
+#include "motion.h"
+#include "codec.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MOTION_SSE 1
+#endif
+
+namespace {
+
+// Samples closer together than this are treated as this far apart, so
+// duplicate timestamps don't turn into infinite speeds.
+const float minSampleDt = 1e-5f;
+// widest smoothing window, in samples each side of the centre
+const uint32_t maxSmoothHalf = 32;
+
+/// ~~~ Kernels ~~~
+
+// out[i] = |(dx, dy)| / dt
+void speedKernel(const float* dx, const float* dy, const float* dt, float* out,
+                 uint32_t n) {
+    uint32_t i = 0;
+#ifdef MOTION_SSE
+    const __m128 floorDt = _mm_set1_ps(minSampleDt);
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(dx + i);
+        __m128 y = _mm_loadu_ps(dy + i);
+        __m128 t = _mm_max_ps(_mm_loadu_ps(dt + i), floorDt);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+        _mm_storeu_ps(out + i, _mm_div_ps(length, t));
+    }
+#endif
+    for (; i < n; i++)
+        out[i] = std::sqrt(dx[i] * dx[i] + dy[i] * dy[i]) / std::max(dt[i], minSampleDt);
+}
+
+// Centred moving average over 2 * half + 1 samples. The window is narrowed
+// at the ends of the stream instead of padding.
+void boxFilter(const float* in, float* out, uint32_t n, uint32_t half) {
+    if (n == 0)
+        return;
+    uint32_t edge = std::min(half, n);
+    auto average = [&](uint32_t i) {
+        uint32_t lo = i >= half ? i - half : 0;
+        uint32_t hi = std::min(n - 1, i + half);
+        float sum = 0.0f;
+        for (uint32_t k = lo; k <= hi; k++)
+            sum += in[k];
+        return sum / static_cast<float>(hi - lo + 1);
+    };
+    for (uint32_t i = 0; i < edge; i++)
+        out[i] = average(i);
+    if (n <= 2 * half) {
+        for (uint32_t i = edge; i < n; i++)
+            out[i] = average(i);
+        return;
+    }
+
+    // interior: every tap is in range, so each output is a plain sum of
+    // shifted loads
+    const uint32_t end = n - half;
+    const float scale = 1.0f / static_cast<float>(2 * half + 1);
+    uint32_t i = half;
+#ifdef MOTION_SSE
+    const __m128 scale4 = _mm_set1_ps(scale);
+    for (; i + 4 <= end; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (uint32_t k = i - half; k <= i + half; k++)
+            sum = _mm_add_ps(sum, _mm_loadu_ps(in + k));
+        _mm_storeu_ps(out + i, _mm_mul_ps(sum, scale4));
+    }
+#endif
+    for (; i < end; i++) {
+        float sum = 0.0f;
+        for (uint32_t k = i - half; k <= i + half; k++)
+            sum += in[k];
+        out[i] = sum * scale;
+    }
+    for (i = end; i < n; i++)
+        out[i] = average(i);
+}
+
+// Index of the first largest value in [begin, end), which must not be empty.
+uint32_t argMax(const float* v, uint32_t begin, uint32_t end) {
+    float best = v[begin];
+    uint32_t i = begin;
+#ifdef MOTION_SSE
+    __m128 best4 = _mm_set1_ps(best);
+    for (; i + 4 <= end; i += 4)
+        best4 = _mm_max_ps(best4, _mm_loadu_ps(v + i));
+    float lanes[4];
+    _mm_storeu_ps(lanes, best4);
+    best = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < end; i++)
+        best = std::max(best, v[i]);
+    for (i = begin; v[i] != best; i++) {}
+    return i;
+}
+
+// Number of times the velocity along (ux, uy) changes sign between
+// neighbouring samples in [begin, end). begin must be at least 1.
+uint32_t signChanges(const float* dx, const float* dy, float ux, float uy,
+                     uint32_t begin, uint32_t end) {
+    uint32_t changes = 0;
+    uint32_t i = begin;
+#ifdef MOTION_SSE
+    const __m128 ux4 = _mm_set1_ps(ux);
+    const __m128 uy4 = _mm_set1_ps(uy);
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        __m128 now = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(dx + i), ux4),
+                                _mm_mul_ps(_mm_loadu_ps(dy + i), uy4));
+        __m128 before = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(dx + i - 1), ux4),
+                                   _mm_mul_ps(_mm_loadu_ps(dy + i - 1), uy4));
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_mul_ps(now, before), zero));
+        changes += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+#endif
+    for (; i < end; i++) {
+        float now = dx[i] * ux + dy[i] * uy;
+        float before = dx[i - 1] * ux + dy[i - 1] * uy;
+        changes += now * before < 0.0f;
+    }
+    return changes;
+}
+
+}
+
+/// ~~~ MouseStream ~~~
+
+void MouseStream::clear() {
+    timeUs.clear();
+    dx.clear();
+    dy.clear();
+}
+
+void MouseStream::add(uint64_t time, float x, float y) {
+    timeUs.push_back(time);
+    dx.push_back(x);
+    dy.push_back(y);
+}
+
+MotionConfig defaultMotionConfig() {
+    MotionConfig config;
+    config.smoothSeconds = 0.004f;
+    config.lookbackSeconds = 0.6f;
+    config.stillSpeed = 0.15f;
+    config.edgeFraction = 0.1f;
+    config.settleFraction = 0.05f;
+    config.flickSpeed = 1.0f;
+    config.flickAngle = 0.05f;
+    return config;
+}
+
+/// ~~~ Analysis ~~~
+
+void MotionAnalyzer::analyze(const MouseStream& stream, const uint64_t* shotTimesUs,
+                             uint32_t shotCount, const MotionConfig& config,
+                             std::vector<ShotSegment>& segments) {
+    segments.clear();
+    const uint32_t n = stream.size();
+
+    dt.resize(n);
+    speed.resize(n);
+    smoothSpeed.resize(n);
+    smoothDx.resize(n);
+    smoothDy.resize(n);
+
+    // Size the smoothing window from the average sample rate, so the same
+    // config works for raw mouse events and tick-rate logs.
+    uint32_t half = 0;
+    if (n > 1) {
+        const uint64_t* t = stream.timeUs.data();
+        float span = (t[n - 1] - t[0]) * 1e-6f;
+        float meanDt = std::max(span / (n - 1), minSampleDt);
+        for (uint32_t i = 1; i < n; i++)
+            dt[i] = static_cast<float>(t[i] - t[i - 1]) * 1e-6f;
+        dt[0] = meanDt;
+        half = std::min(static_cast<uint32_t>(config.smoothSeconds / meanDt / 2.0f),
+                        maxSmoothHalf);
+    } else if (n == 1) {
+        dt[0] = minSampleDt;
+    }
+
+    speedKernel(stream.dx.data(), stream.dy.data(), dt.data(), speed.data(), n);
+    boxFilter(speed.data(), smoothSpeed.data(), n, half);
+    boxFilter(stream.dx.data(), smoothDx.data(), n, half);
+    boxFilter(stream.dy.data(), smoothDy.data(), n, half);
+
+    const uint64_t lookbackUs = static_cast<uint64_t>(config.lookbackSeconds * 1e6f);
+    const uint64_t* first = stream.timeUs.data();
+    const uint64_t* last = first + n;
+    uint32_t previousShot = 0;
+    for (uint32_t s = 0; s < shotCount; s++) {
+        uint64_t shotUs = shotTimesUs[s];
+        uint64_t fromUs = shotUs > lookbackUs ? shotUs - lookbackUs : 0;
+        // the movement for a shot is what happened after the previous shot
+        uint32_t begin = static_cast<uint32_t>(std::lower_bound(first, last, fromUs) - first);
+        uint32_t shot = static_cast<uint32_t>(std::upper_bound(first, last, shotUs) - first);
+        begin = std::max(begin, previousShot);
+        segments.push_back(segment(stream, begin, shot, shotUs, config));
+        previousShot = shot;
+    }
+}
+
+ShotSegment MotionAnalyzer::segment(const MouseStream& stream, uint32_t begin,
+                                    uint32_t shot, uint64_t shotUs,
+                                    const MotionConfig& config) const {
+    ShotSegment seg = {};
+    seg.kind = SegmentKind::Still;
+    seg.shotUs = seg.onsetUs = seg.peakUs = seg.endUs = shotUs;
+    if (begin >= shot)
+        return seg;
+
+    const float* v = smoothSpeed.data();
+    uint32_t peak = argMax(v, begin, shot);
+    if (v[peak] < config.stillSpeed)
+        return seg;
+
+    // primary movement: out from the peak until the speed drops off
+    float edge = std::max(v[peak] * config.edgeFraction, config.stillSpeed);
+    uint32_t onset = peak;
+    while (onset > begin && v[onset - 1] >= edge)
+        onset--;
+    uint32_t end = peak;
+    while (end + 1 < shot && v[end + 1] >= edge)
+        end++;
+
+    // the aim settles after the last sample that still moves noticeably
+    float settle = std::max(v[peak] * config.settleFraction, config.stillSpeed);
+    uint32_t lastMove = shot - 1;
+    while (lastMove > end && v[lastMove] < settle)
+        lastMove--;
+
+    const float* dx = stream.dx.data();
+    const float* dy = stream.dy.data();
+    float primaryX = 0.0f, primaryY = 0.0f;
+    for (uint32_t i = onset; i <= end; i++) {
+        primaryX += dx[i];
+        primaryY += dy[i];
+    }
+    float primaryLength = std::sqrt(primaryX * primaryX + primaryY * primaryY);
+    float ux = primaryLength > 0.0f ? primaryX / primaryLength : 1.0f;
+    float uy = primaryLength > 0.0f ? primaryY / primaryLength : 0.0f;
+
+    // walk the path along the primary direction, noting how far it got
+    // before pulling back
+    float along = 0.0f, furthest = 0.0f;
+    float totalX = 0.0f, totalY = 0.0f;
+    for (uint32_t i = onset; i < shot; i++) {
+        along += dx[i] * ux + dy[i] * uy;
+        furthest = std::max(furthest, along);
+        totalX += dx[i];
+        totalY += dy[i];
+    }
+
+    const uint64_t* t = stream.timeUs.data();
+    seg.onsetUs = t[onset];
+    seg.peakUs = t[peak];
+    seg.endUs = t[end];
+    seg.peakSpeed = v[peak];
+    seg.amplitude = std::sqrt(totalX * totalX + totalY * totalY);
+    seg.overshoot = std::max(furthest - along, 0.0f);
+    seg.settleTime = (t[lastMove] - t[peak]) * 1e-6f;
+    seg.reversals = end + 1 < shot
+        ? signChanges(smoothDx.data(), smoothDy.data(), ux, uy, end + 1, shot)
+        : 0;
+    seg.kind = seg.peakSpeed >= config.flickSpeed && seg.amplitude >= config.flickAngle
+        ? SegmentKind::Flick : SegmentKind::Correction;
+    return seg;
+}
+
+MotionSummary summarizeMotion(const std::vector<ShotSegment>& segments) {
+    MotionSummary summary = {};
+    summary.shots = static_cast<uint32_t>(segments.size());
+    for (const ShotSegment& seg : segments) {
+        switch (seg.kind) {
+        case SegmentKind::Still:      summary.still++;       break;
+        case SegmentKind::Correction: summary.corrections++; break;
+        case SegmentKind::Flick:
+            summary.flicks++;
+            summary.flickPeakSpeed += seg.peakSpeed;
+            summary.flickOvershoot += seg.overshoot;
+            summary.flickSettleTime += seg.settleTime;
+            summary.flickReversals += static_cast<float>(seg.reversals);
+            break;
+        }
+    }
+    if (summary.flicks) {
+        float scale = 1.0f / summary.flicks;
+        summary.flickPeakSpeed *= scale;
+        summary.flickOvershoot *= scale;
+        summary.flickSettleTime *= scale;
+        summary.flickReversals *= scale;
+    }
+    return summary;
+}
+
+void mouseStreamFromLog(const SessionLog& log, MouseStream& stream,
+                        std::vector<uint64_t>& shotTimesUs) {
+    stream.clear();
+    shotTimesUs.clear();
+
+    // records from different threads may be out of order, so place the view
+    // angles by tick first
+    uint32_t tickCount = 0;
+    for (const SessionRecord& r : log.records) {
+        if (r.type == RecordType::InputSample)
+            tickCount = std::max(tickCount, r.tick + 1);
+    }
+    std::vector<float> yaw(tickCount, 0.0f), pitch(tickCount, 0.0f);
+    for (const SessionRecord& r : log.records) {
+        if (r.tick >= tickCount)
+            continue;
+        if (r.type == RecordType::InputSample) {
+            yaw[r.tick] = r.values[0];
+            pitch[r.tick] = r.values[1];
+        } else if (r.type == RecordType::Shot) {
+            // the click came fireAge seconds before the end of its tick
+            double at = (r.tick + 1) * 1e6 / SIM_TICK_RATE - double(r.values[2]) * 1e6;
+            shotTimesUs.push_back(static_cast<uint64_t>(std::llround(std::fmax(at, 0.0))));
+        }
+    }
+    std::sort(shotTimesUs.begin(), shotTimesUs.end());
+
+    stream.timeUs.reserve(tickCount);
+    stream.dx.reserve(tickCount);
+    stream.dy.reserve(tickCount);
+    for (uint32_t tick = 0; tick < tickCount; tick++) {
+        float x = tick ? yaw[tick] - yaw[tick - 1] : 0.0f;
+        // pitch looks up, screen y goes down
+        float y = tick ? pitch[tick - 1] - pitch[tick] : 0.0f;
+        // a tick's view angles are where the mouse was at the end of it
+        stream.add(uint64_t(tick + 1) * 1000000 / SIM_TICK_RATE, x, y);
+    }
+}
+
+int analyzeFiles(int count, char** paths) {
+    const float toDegrees = 57.2957795f;
+    int failures = 0;
+    SessionLog log;
+    MouseStream stream;
+    std::vector<uint64_t> shots;
+    std::vector<ShotSegment> segments;
+    MotionAnalyzer analyzer;
+    MotionConfig config = defaultMotionConfig();
+    for (int i = 0; i < count; i++) {
+        bool loaded = isCompressedReplay(paths[i]) ? readCompressedReplay(paths[i], log)
+                                                   : readSessionLog(paths[i], log);
+        if (!loaded) {
+            std::cout << paths[i] << ": FAILED to load" << std::endl;
+            failures++;
+            continue;
+        }
+
+        mouseStreamFromLog(log, stream, shots);
+        analyzer.analyze(stream, shots.data(), static_cast<uint32_t>(shots.size()),
+                         config, segments);
+        MotionSummary s = summarizeMotion(segments);
+        std::cout << paths[i] << ": shots=" << s.shots << " flicks=" << s.flicks
+                  << " corrections=" << s.corrections << " still=" << s.still;
+        if (s.flicks) {
+            std::cout << " | flick peak " << s.flickPeakSpeed * toDegrees << " deg/s"
+                      << ", overshoot " << s.flickOvershoot * toDegrees << " deg"
+                      << ", settle " << s.flickSettleTime * 1000.0f << " ms"
+                      << ", reversals " << s.flickReversals;
+        }
+        std::cout << std::endl;
+    }
+    return failures;
+}
@@ -0,0 +1,122 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include "recorder.h"
+
+#include <cstdint>
+#include <vector>
+
+// Mouse trajectory analysis: splits the aim movement leading up to each shot
+// into phases (onset, velocity peak, overshoot, settling) so we can tell
+// flicks from micro-corrections and give feedback on each.
+//
+// The per-sample work (speed, smoothing, the direction of travel) runs over
+// the whole stream in SIMD batches before any shot is looked at. Per-shot
+// work only scans the window before that shot.
+
+// Mouse movement in structure-of-arrays form, one entry per sample. Deltas
+// are in radians of view rotation; timestamps must not go backwards.
+struct MouseStream {
+    std::vector<uint64_t> timeUs;
+    std::vector<float> dx;
+    std::vector<float> dy;
+
+    void clear();
+    void add(uint64_t time, float x, float y);
+    uint32_t size() const { return static_cast<uint32_t>(timeUs.size()); }
+};
+
+struct MotionConfig {
+    // width of the smoothing window
+    float smoothSeconds;
+    // how far before a shot to look for the movement that led to it
+    float lookbackSeconds;
+    // slower than this (rad/s) counts as not moving
+    float stillSpeed;
+    // the primary movement starts and ends where the speed crosses this
+    // fraction of its peak
+    float edgeFraction;
+    // the aim has settled once the speed stays under this fraction of the
+    // peak until the shot
+    float settleFraction;
+    // movements at least this fast (rad/s) and long (rad) are flicks
+    float flickSpeed;
+    float flickAngle;
+};
+
+MotionConfig defaultMotionConfig();
+
+enum class SegmentKind : uint8_t {
+    // no movement before the shot
+    Still,
+    // small adjustment
+    Correction,
+    // fast, large movement onto the target
+    Flick
+};
+
+// The movement that led up to one shot. Times are in the stream's clock.
+struct ShotSegment {
+    SegmentKind kind;
+    uint64_t shotUs;
+    uint64_t onsetUs;
+    uint64_t peakUs;
+    // end of the primary movement
+    uint64_t endUs;
+    float peakSpeed;   // rad/s, smoothed
+    float amplitude;   // rad, from onset to the shot
+    // how far past its final position the aim went along the direction of
+    // the movement, in rad
+    float overshoot;
+    // from the speed peak until the aim stays still, in seconds
+    float settleTime;
+    // direction reversals after the primary movement
+    uint32_t reversals;
+};
+
+struct MotionSummary {
+    // segments of each kind
+    uint32_t shots;
+    uint32_t flicks;
+    uint32_t corrections;
+    uint32_t still;
+    // means over flicks only
+    float flickPeakSpeed;
+    float flickOvershoot;
+    float flickSettleTime;
+    float flickReversals;
+};
+
+class MotionAnalyzer {
+public:
+    // shotTimesUs must be sorted. Replaces the contents of segments with one
+    // entry per shot. Scratch buffers are kept between calls.
+    void analyze(const MouseStream& stream, const uint64_t* shotTimesUs,
+                 uint32_t shotCount, const MotionConfig& config,
+                 std::vector<ShotSegment>& segments);
+
+private:
+    ShotSegment segment(const MouseStream& stream, uint32_t begin, uint32_t shot,
+                        uint64_t shotUs, const MotionConfig& config) const;
+
+    std::vector<float> dt;
+    std::vector<float> speed;
+    std::vector<float> smoothSpeed;
+    std::vector<float> smoothDx;
+    std::vector<float> smoothDy;
+};
+
+MotionSummary summarizeMotion(const std::vector<ShotSegment>& segments);
+
+// Session logs keep one view angle sample per sim tick rather than raw mouse
+// events, so this rebuilds the stream at the tick rate. Samples are stamped
+// at the end of their tick and shots at their click time within it (the end
+// of the tick less the shot's fire age), so the two line up.
+void mouseStreamFromLog(const SessionLog& log, MouseStream& stream,
+                        std::vector<uint64_t>& shotTimesUs);
+
+// Analyze every file (raw session logs or compressed replays), print one line
+// per session and return the number that failed to load.
+int analyzeFiles(int count, char** paths);
+
+#endif
@@ -0,0 +1,182 @@
+#include "particles.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+
+namespace {
+
+static_assert(MAX_PARTICLES % 4 == 0, "the update runs four particles at a time");
+
+// fraction of velocity lost per second, so sparks slow as they spread
+const float drag = 2.5f;
+
+uint32_t nextRandom(uint32_t& state) {
+    // xorshift32
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float randomUnit(uint32_t& state) {
+    return (nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+uint32_t packColor(const uint8_t color[4]) {
+    uint32_t packed;
+    std::memcpy(&packed, color, sizeof(packed));
+    return packed;
+}
+
+}
+
+ParticleBurst hitBurst() {
+    ParticleBurst b;
+    b.count = 48;
+    b.speed = 9.0f;
+    b.life = 0.6f;
+    b.size = 0.06f;
+    b.gravity = 9.8f;
+    const uint8_t color[4] = {255, 170, 80, 255};
+    std::memcpy(b.color, color, sizeof(b.color));
+    return b;
+}
+
+ParticleBurst missBurst() {
+    // Misses land 100 units out, so the dust is big to be seen at all, and
+    // dim, since a dozen big particles overlapping add up quickly.
+    ParticleBurst b;
+    b.count = 12;
+    b.speed = 4.0f;
+    b.life = 0.4f;
+    b.size = 0.5f;
+    b.gravity = -1.0f;
+    const uint8_t color[4] = {36, 36, 42, 255};
+    std::memcpy(b.color, color, sizeof(b.color));
+    return b;
+}
+
+ParticleSystem::ParticleSystem()
+    : px(MAX_PARTICLES), py(MAX_PARTICLES), pz(MAX_PARTICLES), vx(MAX_PARTICLES),
+      vy(MAX_PARTICLES), vz(MAX_PARTICLES), ages(MAX_PARTICLES), lives(MAX_PARTICLES),
+      sizes(MAX_PARTICLES), gravities(MAX_PARTICLES), colors(MAX_PARTICLES),
+      deadList(MAX_PARTICLES), count(0), limit(MAX_PARTICLES), rng(0x9E3779B9u),
+      droppedTotal(0) {
+}
+
+void ParticleSystem::setBudget(uint32_t budget) {
+    limit = std::min(budget, MAX_PARTICLES);
+}
+
+void ParticleSystem::clear() {
+    count = 0;
+}
+
+uint32_t ParticleSystem::emit(const ParticleBurst& burst, float x, float y, float z) {
+    uint32_t room = count < limit ? limit - count : 0;
+    uint32_t n = std::min(burst.count, room);
+    droppedTotal += burst.count - n;
+
+    uint32_t color = packColor(burst.color);
+    for (uint32_t k = 0; k < n; k++) {
+        // a random direction: pick points in the cube until one lands
+        // inside the unit ball, which also spreads the speeds
+        float dx, dy, dz, d2;
+        do {
+            dx = randomUnit(rng) * 2.0f - 1.0f;
+            dy = randomUnit(rng) * 2.0f - 1.0f;
+            dz = randomUnit(rng) * 2.0f - 1.0f;
+            d2 = dx * dx + dy * dy + dz * dz;
+        } while (d2 > 1.0f);
+
+        uint32_t i = count++;
+        px[i] = x;
+        py[i] = y;
+        pz[i] = z;
+        vx[i] = dx * burst.speed;
+        vy[i] = dy * burst.speed;
+        vz[i] = dz * burst.speed;
+        ages[i] = 0.0f;
+        // a little variety so a burst doesn't vanish all at once
+        lives[i] = burst.life * (0.6f + 0.4f * randomUnit(rng));
+        sizes[i] = burst.size;
+        gravities[i] = burst.gravity;
+        colors[i] = color;
+    }
+    return n;
+}
+
+void ParticleSystem::update(float dt) {
+    const float slow = std::exp(-drag * dt);
+    // Particles that aged out, in index order. Only a few die each frame, so
+    // filling their slots from the end afterwards is much cheaper than
+    // sliding every survivor down.
+    uint32_t deadCount = 0;
+
+    uint32_t i = 0;
+#ifdef PARTICLES_SSE
+    // Slots past count hold stale particles, and the arrays are a whole
+    // number of fours long, so running the last group in full is harmless
+    // and saves a scalar tail.
+    const __m128 step = _mm_set1_ps(dt);
+    const __m128 damping = _mm_set1_ps(slow);
+    for (; i < count; i += 4) {
+        __m128 g = _mm_mul_ps(_mm_loadu_ps(&gravities[i]), step);
+        __m128 vxs = _mm_mul_ps(_mm_loadu_ps(&vx[i]), damping);
+        __m128 vys = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&vy[i]), g), damping);
+        __m128 vzs = _mm_mul_ps(_mm_loadu_ps(&vz[i]), damping);
+        _mm_storeu_ps(&vx[i], vxs);
+        _mm_storeu_ps(&vy[i], vys);
+        _mm_storeu_ps(&vz[i], vzs);
+        _mm_storeu_ps(&px[i], _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_mul_ps(vxs, step)));
+        _mm_storeu_ps(&py[i], _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_mul_ps(vys, step)));
+        _mm_storeu_ps(&pz[i], _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_mul_ps(vzs, step)));
+        __m128 age = _mm_add_ps(_mm_loadu_ps(&ages[i]), step);
+        _mm_storeu_ps(&ages[i], age);
+
+        int dead = _mm_movemask_ps(_mm_cmpge_ps(age, _mm_loadu_ps(&lives[i])));
+        for (uint32_t lane = i; dead; lane++, dead >>= 1) {
+            if ((dead & 1) && lane < count)
+                deadList[deadCount++] = lane;
+        }
+    }
+#else
+    for (; i < count; i++) {
+        vx[i] *= slow;
+        vy[i] = (vy[i] - gravities[i] * dt) * slow;
+        vz[i] *= slow;
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+        pz[i] += vz[i] * dt;
+        ages[i] += dt;
+        if (ages[i] >= lives[i])
+            deadList[deadCount++] = i;
+    }
+#endif
+
+    // Move the last particle into each dead one's slot, highest slot first,
+    // so the last particle is always a live one by the time it moves. This
+    // doesn't keep the order, which nothing needs: particles are drawn
+    // additively.
+    while (deadCount) {
+        uint32_t slot = deadList[--deadCount];
+        uint32_t last = --count;
+        px[slot] = px[last];
+        py[slot] = py[last];
+        pz[slot] = pz[last];
+        vx[slot] = vx[last];
+        vy[slot] = vy[last];
+        vz[slot] = vz[last];
+        ages[slot] = ages[last];
+        lives[slot] = lives[last];
+        sizes[slot] = sizes[last];
+        gravities[slot] = gravities[last];
+        colors[slot] = colors[last];
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <cstdint>
+#include <vector>
+
+// Sparks and dust for hits and misses.
+//
+// Particles are purely visual and never touch the sim, so they run on frame
+// time and their randomness doesn't have to be replayable. They're kept as
+// one array per field rather than one object each, so the update integrates
+// four at a time with SSE and the renderer reads them straight out (see
+// particleview.h). Everything is allocated up front for MAX_PARTICLES; a
+// budget below that caps how many can be alive, and bursts that don't fit
+// are cut short and counted, so a busy moment costs at most the budget.
+
+constexpr uint32_t MAX_PARTICLES = 8192;
+
+// What one burst looks like. Particles fly out in random directions at up
+// to `speed`, fall under gravity and fade out over `life` seconds.
+struct ParticleBurst {
+    uint32_t count;
+    float speed;
+    float life;
+    // billboard half-size in world units
+    float size;
+    float gravity;
+    uint8_t color[4];
+};
+
+ParticleBurst hitBurst();
+ParticleBurst missBurst();
+
+class ParticleSystem {
+public:
+    ParticleSystem();
+
+    // Live particles past a smaller budget are left to age out.
+    void setBudget(uint32_t budget);
+    uint32_t budget() const { return limit; }
+
+    // Add a burst centred on (x, y, z). Returns how many particles fit.
+    uint32_t emit(const ParticleBurst& burst, float x, float y, float z);
+    // Move everything on by dt seconds and drop the particles that aged out.
+    // Doesn't allocate.
+    void update(float dt);
+    void clear();
+
+    uint32_t live() const { return count; }
+    // particles cut from bursts for lack of room, since construction
+    uint64_t dropped() const { return droppedTotal; }
+
+    // Fields of the live particles, `live()` of each, in no particular
+    // order; update() moves particles around as others die. Colour is RGBA,
+    // one byte each, packed into a uint32_t in memory order.
+    const float* x() const { return px.data(); }
+    const float* y() const { return py.data(); }
+    const float* z() const { return pz.data(); }
+    const float* age() const { return ages.data(); }
+    const float* life() const { return lives.data(); }
+    const float* size() const { return sizes.data(); }
+    const uint32_t* color() const { return colors.data(); }
+
+private:
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> ages, lives, sizes, gravities;
+    std::vector<uint32_t> colors;
+    // scratch for update()
+    std::vector<uint32_t> deadList;
+    uint32_t count;
+    uint32_t limit;
+    uint32_t rng;
+    uint64_t droppedTotal;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <GL/glew.h>
+
+#include "particleview.h"
+#include "shader.h"
+#include "vertexformat.h"
+
+#include <cstring>
+
+namespace {
+
+// The quad is built in view space, so it always faces the camera.
+const char* particleVertexSource =
+    "#version 330 core\n"
+    "layout (location = 0) in vec4 aParticle;\n"
+    "layout (location = 1) in vec4 aColor;\n"
+    "uniform mat4 view;\n"
+    "uniform mat4 projection;\n"
+    "out vec2 corner;\n"
+    "flat out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+    "    color = aColor;\n"
+    "    vec4 centre = view * vec4(aParticle.xyz, 1.0);\n"
+    "    gl_Position = projection * (centre + vec4(corner * aParticle.w, 0.0, 0.0));\n"
+    "}\0";
+
+// A soft round blob; colours arrive premultiplied and faded.
+const char* particleFragmentSource =
+    "#version 330 core\n"
+    "in vec2 corner;\n"
+    "flat in vec4 color;\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    float falloff = clamp(1.0 - dot(corner, corner), 0.0, 1.0);\n"
+    "    FragColor = color * (falloff * falloff);\n"
+    "}\0";
+
+}
+
+template <>
+struct VertexLayout<ParticleInstance> {
+    static constexpr VertexAttrib attribs[] = {
+        // position and size
+        VERTEX_ATTRIB(ParticleInstance, x, 0, 4, AttribType::Float),
+        VERTEX_ATTRIB(ParticleInstance, color, 1, 4, AttribType::UByteNorm),
+    };
+};
+
+// Halves read as floats, so the same shader takes either format.
+template <>
+struct VertexLayout<PackedParticleInstance> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(PackedParticleInstance, x, 0, 4, AttribType::Half),
+        VERTEX_ATTRIB(PackedParticleInstance, color, 1, 4, AttribType::UByteNorm),
+    };
+};
+
+ParticleView::ParticleView()
+    : program(0), vao(0), packedVao(0), vbo(0), drawnVao(0), viewLocation(-1),
+      projectionLocation(-1), view{}, projection{}, instances(0) {
+}
+
+ParticleView::~ParticleView() {
+    if (program) {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteVertexArrays(1, &packedVao);
+        glDeleteBuffers(1, &vbo);
+    }
+}
+
+bool ParticleView::setup() {
+    program = buildShaderProgram(particleVertexSource, particleFragmentSource);
+    if (!program)
+        return false;
+    viewLocation = glGetUniformLocation(program, "view");
+    projectionLocation = glGetUniformLocation(program, "projection");
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(ParticleInstance), NULL,
+                 GL_STREAM_DRAW);
+    applyVertexLayout<ParticleInstance>(1);
+    glGenVertexArrays(1, &packedVao);
+    glBindVertexArray(packedVao);
+    applyVertexLayout<PackedParticleInstance>(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void ParticleView::setUniforms(void* context) {
+    const ParticleView* self = static_cast<const ParticleView*>(context);
+    glUniformMatrix4fv(self->viewLocation, 1, GL_FALSE, self->view);
+    glUniformMatrix4fv(self->projectionLocation, 1, GL_FALSE, self->projection);
+}
+
+void ParticleView::record(CommandBuffer& commands, const ParticleSystem& particles,
+                          const Camera& camera, bool halfPositions) {
+    instances = 0;
+    uint32_t count = particles.live();
+    if (!program || count == 0)
+        return;
+
+    drawnVao = halfPositions ? packedVao : vao;
+    size_t stride = halfPositions ? sizeof(PackedParticleInstance) : sizeof(ParticleInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    void* out = glMapBufferRange(GL_ARRAY_BUFFER, 0, count * stride,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    // the farthest particle, for ordering against other blended draws
+    float farthest = 0.0f;
+    if (out) {
+        const float* x = particles.x();
+        const float* y = particles.y();
+        const float* z = particles.z();
+        const float* age = particles.age();
+        const float* life = particles.life();
+        const float* size = particles.size();
+        const uint32_t* colors = particles.color();
+        ParticleInstance* fullOut = static_cast<ParticleInstance*>(out);
+        PackedParticleInstance* packedOut = static_cast<PackedParticleInstance*>(out);
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t color[4];
+            std::memcpy(color, &colors[i], sizeof(color));
+            // premultiplied and faded out over the particle's life
+            float fade = 1.0f - age[i] / life[i];
+            float alpha = color[3] / 255.0f * fade;
+            uint8_t faded[4];
+            for (int c = 0; c < 3; c++)
+                faded[c] = static_cast<uint8_t>(color[c] * alpha);
+            faded[3] = static_cast<uint8_t>(255.0f * alpha);
+
+            if (halfPositions) {
+                PackedParticleInstance& p = packedOut[i];
+                p.x = toHalf(x[i]);
+                p.y = toHalf(y[i]);
+                p.z = toHalf(z[i]);
+                p.size = toHalf(size[i]);
+                std::memcpy(p.color, faded, sizeof(faded));
+            } else {
+                ParticleInstance& p = fullOut[i];
+                p.x = x[i];
+                p.y = y[i];
+                p.z = z[i];
+                p.size = size[i];
+                std::memcpy(p.color, faded, sizeof(faded));
+            }
+
+            float depth = x[i] * camera.forward[0] + y[i] * camera.forward[1] +
+                          z[i] * camera.forward[2];
+            farthest = depth > farthest ? depth : farthest;
+        }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        instances = count;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (instances == 0)
+        return;
+
+    std::memcpy(view, camera.view, sizeof(view));
+    std::memcpy(projection, camera.projection, sizeof(projection));
+    // Depth tested against the targets but not written, so overlapping
+    // particles all add up.
+    DrawPacket packet = {program, drawnVao, 0, GL_TRIANGLE_STRIP, 0, 4, instances, 0,
+                         RENDER_DEPTH_TEST | RENDER_BLEND_ADDITIVE,
+                         &ParticleView::setUniforms, this};
+    commands.add(blendedKey(program, drawnVao, farthest), packet);
+}
@@ -0,0 +1,66 @@
+#ifndef PARTICLEVIEW_H
+#define PARTICLEVIEW_H
+
+#include "camera.h"
+#include "commandbuffer.h"
+#include "particles.h"
+
+#include <cstdint>
+
+// Draws a ParticleSystem as camera-facing quads, one instance each, in the
+// blended pass. The live particles are written to a single instance buffer
+// once per frame, already faded by age, and blended additively so they
+// need no sorting among themselves. When half-float positions are precise
+// enough for the frame they go out packed, in a little over half the bytes.
+
+// One particle, as it goes to the vertex shader.
+struct ParticleInstance {
+    float x, y, z;
+    float size;
+    uint8_t color[4];
+};
+
+// The same with position and size in halves, relative to the arena origin.
+struct PackedParticleInstance {
+    uint16_t x, y, z;
+    uint16_t size;
+    uint8_t color[4];
+};
+
+class ParticleView {
+public:
+    ParticleView();
+    ~ParticleView();
+
+    ParticleView(const ParticleView&) = delete;
+    ParticleView& operator=(const ParticleView&) = delete;
+
+    // Needs a current GL context.
+    bool setup();
+    // Upload the live particles and record the draw for them, packed if
+    // halfPositions is set.
+    void record(CommandBuffer& commands, const ParticleSystem& particles,
+                const Camera& camera, bool halfPositions);
+
+    // particles drawn in the last record
+    uint32_t instanceCount() const { return instances; }
+
+private:
+    static void setUniforms(void* context);
+
+    unsigned int program;
+    unsigned int vao;
+    unsigned int packedVao;
+    // shared by both formats
+    unsigned int vbo;
+    // the vertex array the last record used
+    unsigned int drawnVao;
+    int viewLocation;
+    int projectionLocation;
+    // the camera as of the last record, for the packet's uniforms
+    float view[16];
+    float projection[16];
+    uint32_t instances;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// A handle refers to a slot in a Pool. The generation is bumped every time a
+// slot is freed, so a handle that outlives its object simply stops resolving
+// (get() returns nullptr) instead of pointing at whatever got spawned into the
+// slot afterwards.
+struct Handle {
+    uint32_t index = 0xFFFFFFFFu;
+    uint32_t generation = 0;
+
+    bool valid() const { return index != 0xFFFFFFFFu; }
+};
+
+inline bool operator==(Handle a, Handle b) {
+    return a.index == b.index && a.generation == b.generation;
+}
+
+inline bool operator!=(Handle a, Handle b) {
+    return !(a == b);
+}
+
+// Fixed-capacity pool of T. All storage lives inside the pool object itself,
+// so creating and destroying objects never touches the heap. Free slots are
+// chained together through nextFree[], which makes create() and destroy()
+// O(1). Pools tend to be large, so give them static storage (or put them in a
+// struct with static storage) rather than on the stack.
+template <typename T, uint32_t Capacity>
+class Pool {
+public:
+    static constexpr uint32_t capacity = Capacity;
+
+    Pool() {
+        for (uint32_t i = 0; i < Capacity; i++) {
+            generations[i] = 0;
+            live[i] = false;
+            nextFree[i] = i + 1;
+        }
+        freeHead = 0;
+        liveCount = 0;
+    }
+
+    ~Pool() {
+        clear();
+    }
+
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    // Construct a new object in a free slot. Returns an invalid handle if the
+    // pool is full; callers decide whether that means "drop it" or "recycle
+    // the oldest one".
+    template <typename... Args>
+    Handle create(Args&&... args) {
+        if (freeHead >= Capacity)
+            return Handle{};
+
+        uint32_t index = freeHead;
+        freeHead = nextFree[index];
+
+        new (slot(index)) T{std::forward<Args>(args)...};
+        live[index] = true;
+        liveCount++;
+        return Handle{index, generations[index]};
+    }
+
+    // Destroy the object referenced by h. Returns false if h is stale.
+    bool destroy(Handle h) {
+        if (!get(h))
+            return false;
+
+        slot(h.index)->~T();
+        live[h.index] = false;
+        generations[h.index]++;
+        nextFree[h.index] = freeHead;
+        freeHead = h.index;
+        liveCount--;
+        return true;
+    }
+
+    T* get(Handle h) {
+        if (h.index >= Capacity || !live[h.index] ||
+            generations[h.index] != h.generation)
+            return nullptr;
+        return slot(h.index);
+    }
+
+    const T* get(Handle h) const {
+        return const_cast<Pool*>(this)->get(h);
+    }
+
+    // Direct slot access, for splitting work over index ranges. Returns
+    // nullptr for free slots.
+    T* at(uint32_t index) {
+        return live[index] ? slot(index) : nullptr;
+    }
+
+    // Visit every live object as f(Handle, T&). It is safe to destroy() the
+    // visited object from inside f.
+    template <typename F>
+    void forEach(F&& f) {
+        for (uint32_t i = 0; i < Capacity; i++) {
+            if (live[i])
+                f(Handle{i, generations[i]}, *slot(i));
+        }
+    }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (uint32_t i = 0; i < Capacity; i++) {
+            if (live[i])
+                f(Handle{i, generations[i]},
+                  static_cast<const T&>(*const_cast<Pool*>(this)->slot(i)));
+        }
+    }
+
+    void clear() {
+        forEach([this](Handle h, T&) { destroy(h); });
+    }
+
+    uint32_t size() const { return liveCount; }
+    bool full() const { return liveCount == Capacity; }
+
+private:
+    T* slot(uint32_t index) {
+        return std::launder(reinterpret_cast<T*>(storage + index * sizeof(T)));
+    }
+
+    alignas(T) unsigned char storage[sizeof(T) * Capacity];
+    uint32_t generations[Capacity];
+    uint32_t nextFree[Capacity];
+    bool live[Capacity];
+    uint32_t freeHead;
+    uint32_t liveCount;
+};
+
+#endif
@@ -0,0 +1,545 @@
+#include "recorder.h"
+#include "alloccount.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+const char headerMagic[8] = {'M', 'A', 'X', 'A', 'I', 'M', 'L', 'G'};
+const char footerMagic[8] = {'M', 'A', 'X', 'A', 'I', 'M', 'F', 'T'};
+const uint32_t blockMagic = 0x4B4C4231; // "1BLK"
+const uint32_t snapshotBlockMagic = 0x50534E31; // "1NSP"
+const uint32_t logVersion = 3;
+
+// which ring the current thread writes to, cached per recorder and session
+struct LocalRing {
+    const SessionRecorder* owner = nullptr;
+    uint32_t session = 0;
+    void* ring = nullptr;
+};
+thread_local LocalRing localRingCache;
+
+// Session ids are unique across all recorders, so a cached ring can never be
+// mistaken for one belonging to a recorder that has since been destroyed.
+std::atomic<uint32_t> nextSession{1};
+
+}
+
+uint32_t crc32(const void* data, std::size_t size, uint32_t crc) {
+    // standard reflected CRC-32 (same as zlib), table built on first use
+    static uint32_t table[256];
+    static bool tableReady = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)tableReady;
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+SessionRecorder::SessionRecorder()
+    : file(nullptr), fileOffset(0), rings{}, ringCount(0), session(0),
+      stopping(false), totalRecords(0), snapshotState(0),
+      snapshotBuffer(static_cast<unsigned char*>(std::malloc(snapshotCapacity))),
+      snapshotTick(0), snapshotSize(0), skippedSnapshots(0) {}
+
+SessionRecorder::~SessionRecorder() {
+    close();
+    for (uint32_t i = 0; i < ringCount.load(); i++)
+        delete rings[i];
+    std::free(snapshotBuffer);
+}
+
+bool SessionRecorder::open(const char* path, uint64_t startTimeUs,
+                           const void* sessionInfo, uint32_t sessionInfoSize) {
+    close();
+
+    if (sessionInfoSize > MAX_SESSION_INFO) {
+        std::cout << "ERROR::RECORDER::SESSION_INFO_TOO_LARGE\n" << sessionInfoSize
+                  << std::endl;
+        return false;
+    }
+
+    file = std::fopen(path, "wb");
+    if (!file) {
+        std::cout << "ERROR::RECORDER::OPEN_FAILED\n" << path << std::endl;
+        return false;
+    }
+    // we only ever hand it large blocks, so stdio buffering just adds a copy
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    LogHeader header = {};
+    std::memcpy(header.magic, headerMagic, sizeof(headerMagic));
+    header.version = logVersion;
+    header.recordSize = sizeof(SessionRecord);
+    header.startTimeUs = startTimeUs;
+    header.sessionInfoSize = sessionInfoSize;
+    if (sessionInfoSize)
+        std::memcpy(header.sessionInfo, sessionInfo, sessionInfoSize);
+    std::fwrite(&header, sizeof(header), 1, file);
+    fileOffset = sizeof(header);
+
+    staging.clear();
+    staging.reserve(blockRecords);
+    index.clear();
+    totalRecords.store(0);
+    skippedSnapshots.store(0);
+    snapshotState.store(0);
+    for (uint32_t i = 0; i < ringCount.load(); i++)
+        rings[i]->dropped.store(0);
+
+    session.store(nextSession.fetch_add(1));
+    stopping.store(false);
+    writer = std::thread(&SessionRecorder::writerLoop, this);
+    return true;
+}
+
+void SessionRecorder::close() {
+    if (!file)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping.store(true);
+    }
+    wake.notify_one();
+    writer.join();
+
+    // index and footer go last, so a complete footer means a complete file
+    LogFooter footer = {};
+    std::memcpy(footer.magic, footerMagic, sizeof(footerMagic));
+    footer.indexOffset = fileOffset;
+    footer.recordCount = totalRecords.load();
+    footer.blockCount = static_cast<uint32_t>(index.size());
+    footer.indexCrc = crc32(index.data(), index.size() * sizeof(LogBlockIndex));
+
+    std::fwrite(index.data(), sizeof(LogBlockIndex), index.size(), file);
+    std::fwrite(&footer, sizeof(footer), 1, file);
+    std::fclose(file);
+    file = nullptr;
+}
+
+SessionRecorder::Ring* SessionRecorder::localRing() {
+    LocalRing& cache = localRingCache;
+    uint32_t current = session.load(std::memory_order_relaxed);
+    if (cache.owner == this && cache.session == current)
+        return static_cast<Ring*>(cache.ring);
+
+    // slow path, once per thread per session: find this thread's ring, or
+    // make one
+    std::lock_guard<std::mutex> lock(registerMutex);
+    std::thread::id self = std::this_thread::get_id();
+    uint32_t count = ringCount.load();
+    Ring* ring = nullptr;
+    for (uint32_t i = 0; i < count; i++) {
+        if (ringOwners[i] == self) {
+            ring = rings[i];
+            break;
+        }
+    }
+    if (!ring) {
+        if (count == maxThreads)
+            return nullptr;
+        ring = new Ring();
+        rings[count] = ring;
+        ringOwners[count] = self;
+        ringCount.store(count + 1, std::memory_order_release);
+    }
+
+    cache.owner = this;
+    cache.session = current;
+    cache.ring = ring;
+    return ring;
+}
+
+void SessionRecorder::record(const SessionRecord& r) {
+    if (!file)
+        return;
+    Ring* ring = localRing();
+    if (!ring)
+        return;
+
+    // single producer, single consumer: we own head, the writer owns tail
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    if (head - tail >= ringCapacity) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring->records[head & (ringCapacity - 1)] = r;
+    ring->head.store(head + 1, std::memory_order_release);
+
+    // give the writer a nudge before the ring fills rather than waiting for
+    // its next timed wake-up
+    if (head - tail == ringCapacity / 2)
+        wake.notify_one();
+}
+
+unsigned char* SessionRecorder::beginSnapshot() {
+    uint32_t expected = 0;
+    if (!file || !snapshotBuffer ||
+        !snapshotState.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+        skippedSnapshots.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return snapshotBuffer;
+}
+
+void SessionRecorder::commitSnapshot(uint32_t tick, uint32_t size) {
+    // an abandoned or oversized snapshot is still one the file won't have
+    if (size == 0 || size > snapshotCapacity) {
+        skippedSnapshots.fetch_add(1, std::memory_order_relaxed);
+        snapshotState.store(0, std::memory_order_release);
+        return;
+    }
+    snapshotTick = tick;
+    snapshotSize = size;
+    snapshotState.store(2, std::memory_order_release);
+    wake.notify_one();
+}
+
+uint64_t SessionRecorder::droppedRecords() const {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < ringCount.load(); i++)
+        total += rings[i]->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+void SessionRecorder::writerLoop() {
+    // The block index and snapshots grow as the session goes on; none of it
+    // is part of a frame.
+    excludeThreadFromAllocationCount();
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point lastWrite = Clock::now();
+
+    while (true) {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait_for(lock, std::chrono::milliseconds(10),
+                          [this] { return stopping.load(); });
+            stop = stopping.load();
+        }
+
+        drain();
+
+        if (snapshotState.load(std::memory_order_acquire) == 2) {
+            // flush the records leading up to the snapshot first, so the
+            // file stays roughly in tick order
+            if (!staging.empty())
+                writeBlock();
+            writeSnapshot();
+        }
+
+        // Write full blocks as soon as they fill up, and partial ones every
+        // so often so a crash loses at most a fraction of a second.
+        Clock::time_point now = Clock::now();
+        if (!staging.empty() &&
+            (stop || now - lastWrite > std::chrono::milliseconds(250))) {
+            writeBlock();
+            lastWrite = now;
+        }
+        if (stop)
+            break;
+    }
+}
+
+void SessionRecorder::drain() {
+    uint32_t count = ringCount.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++) {
+        Ring* ring = rings[i];
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while (tail != head) {
+            staging.push_back(ring->records[tail & (ringCapacity - 1)]);
+            tail++;
+            if (staging.size() == blockRecords)
+                writeBlock();
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+void SessionRecorder::writeBlock() {
+    LogBlockHeader header = {};
+    header.magic = blockMagic;
+    header.recordCount = static_cast<uint32_t>(staging.size());
+    header.firstTick = staging.front().tick;
+    header.lastTick = staging.front().tick;
+    for (const SessionRecord& r : staging) {
+        if (r.tick < header.firstTick)
+            header.firstTick = r.tick;
+        if (r.tick > header.lastTick)
+            header.lastTick = r.tick;
+    }
+    header.crc = crc32(staging.data(), staging.size() * sizeof(SessionRecord));
+
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fwrite(staging.data(), sizeof(SessionRecord), staging.size(), file);
+    std::fflush(file);
+
+    index.push_back(LogBlockIndex{fileOffset, header.recordCount,
+                                  header.firstTick, header.lastTick,
+                                  LogBlockKind::Records});
+    fileOffset += sizeof(header) + staging.size() * sizeof(SessionRecord);
+    totalRecords.fetch_add(staging.size());
+    staging.clear();
+}
+
+void SessionRecorder::writeSnapshot() {
+    LogBlockHeader header = {};
+    header.magic = snapshotBlockMagic;
+    header.recordCount = snapshotSize;
+    header.firstTick = snapshotTick;
+    header.lastTick = snapshotTick;
+    header.crc = crc32(snapshotBuffer, snapshotSize);
+
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fwrite(snapshotBuffer, 1, snapshotSize, file);
+    std::fflush(file);
+
+    index.push_back(LogBlockIndex{fileOffset, snapshotSize, snapshotTick,
+                                  snapshotTick, LogBlockKind::Snapshot});
+    fileOffset += sizeof(header) + snapshotSize;
+    snapshotState.store(0, std::memory_order_release);
+}
+
+/// ~~~ Reading ~~~
+
+namespace {
+
+// Read one block at offset, checking its header and checksum.
+bool readBlock(const std::vector<unsigned char>& bytes, uint64_t offset,
+               SessionLog& log, uint64_t* next) {
+    if (offset + sizeof(LogBlockHeader) > bytes.size())
+        return false;
+    LogBlockHeader header;
+    std::memcpy(&header, bytes.data() + offset, sizeof(header));
+    if (header.magic != blockMagic && header.magic != snapshotBlockMagic)
+        return false;
+    bool snapshot = header.magic == snapshotBlockMagic;
+
+    uint64_t payload = snapshot ? header.recordCount
+                                : uint64_t(header.recordCount) * sizeof(SessionRecord);
+    uint64_t start = offset + sizeof(header);
+    if (start + payload > bytes.size())
+        return false;
+    if (crc32(bytes.data() + start, payload) != header.crc)
+        return false;
+
+    if (snapshot) {
+        LogSnapshot s;
+        s.tick = header.firstTick;
+        s.data.assign(bytes.data() + start, bytes.data() + start + payload);
+        log.snapshots.push_back(std::move(s));
+        log.blocks.push_back(LogBlockIndex{offset, header.recordCount, header.firstTick,
+                                           header.lastTick, LogBlockKind::Snapshot});
+        *next = start + payload;
+        return true;
+    }
+
+    std::size_t first = log.records.size();
+    log.records.resize(first + header.recordCount);
+    std::memcpy(log.records.data() + first, bytes.data() + start, payload);
+    log.blocks.push_back(LogBlockIndex{offset, header.recordCount, header.firstTick,
+                                       header.lastTick, LogBlockKind::Records});
+    *next = start + payload;
+    return true;
+}
+
+}
+
+bool readSessionLog(const char* path, SessionLog& log) {
+    log.records.clear();
+    log.blocks.clear();
+    log.snapshots.clear();
+    log.recovered = false;
+
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        std::cout << "ERROR::RECORDER::READ_FAILED\n" << path << std::endl;
+        return false;
+    }
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    std::vector<unsigned char> bytes(size > 0 ? size : 0);
+    std::size_t got = std::fread(bytes.data(), 1, bytes.size(), f);
+    std::fclose(f);
+    bytes.resize(got);
+
+    if (bytes.size() < sizeof(LogHeader)) {
+        std::cout << "ERROR::RECORDER::TRUNCATED\n" << path << std::endl;
+        return false;
+    }
+    std::memcpy(&log.header, bytes.data(), sizeof(LogHeader));
+    if (std::memcmp(log.header.magic, headerMagic, sizeof(headerMagic)) != 0 ||
+        log.header.version != logVersion ||
+        log.header.recordSize != sizeof(SessionRecord)) {
+        std::cout << "ERROR::RECORDER::BAD_HEADER\n" << path << std::endl;
+        return false;
+    }
+
+    // Fast path: trust the index if the footer checks out.
+    if (bytes.size() >= sizeof(LogHeader) + sizeof(LogFooter)) {
+        LogFooter footer;
+        std::memcpy(&footer, bytes.data() + bytes.size() - sizeof(footer), sizeof(footer));
+        uint64_t indexBytes = uint64_t(footer.blockCount) * sizeof(LogBlockIndex);
+        bool valid = std::memcmp(footer.magic, footerMagic, sizeof(footerMagic)) == 0 &&
+                     footer.indexOffset + indexBytes + sizeof(footer) == bytes.size() &&
+                     crc32(bytes.data() + footer.indexOffset, indexBytes) == footer.indexCrc;
+        if (valid) {
+            std::vector<LogBlockIndex> index(footer.blockCount);
+            std::memcpy(index.data(), bytes.data() + footer.indexOffset, indexBytes);
+            log.records.reserve(footer.recordCount);
+            uint64_t next;
+            bool ok = true;
+            for (const LogBlockIndex& block : index)
+                ok = ok && readBlock(bytes, block.offset, log, &next);
+            if (ok)
+                return true;
+            log.records.clear();
+            log.blocks.clear();
+            log.snapshots.clear();
+        }
+    }
+
+    // No usable footer (the game probably crashed): walk the blocks from the
+    // start and stop at the first one that's torn or corrupt.
+    log.recovered = true;
+    uint64_t offset = sizeof(LogHeader);
+    while (readBlock(bytes, offset, log, &offset)) {}
+    return true;
+}
+
+/// ~~~ Streaming reader ~~~
+
+SessionLogReader::SessionLogReader()
+    : file(nullptr), logHeader(), offset(0), blocksEnd(0), position(0), damaged(false) {}
+
+SessionLogReader::~SessionLogReader() {
+    close();
+}
+
+void SessionLogReader::close() {
+    if (file)
+        std::fclose(file);
+    file = nullptr;
+}
+
+bool SessionLogReader::open(const char* path) {
+    close();
+    file = std::fopen(path, "rb");
+    if (!file) {
+        std::cout << "ERROR::RECORDER::READ_FAILED\n" << path << std::endl;
+        return false;
+    }
+    if (std::fread(&logHeader, sizeof(logHeader), 1, file) != 1) {
+        std::cout << "ERROR::RECORDER::TRUNCATED\n" << path << std::endl;
+        close();
+        return false;
+    }
+    if (std::memcmp(logHeader.magic, headerMagic, sizeof(headerMagic)) != 0 ||
+        logHeader.version != logVersion || logHeader.recordSize != sizeof(SessionRecord)) {
+        std::cout << "ERROR::RECORDER::BAD_HEADER\n" << path << std::endl;
+        close();
+        return false;
+    }
+
+    // The blocks run from the header to the index. Without a footer that
+    // checks out, there's no telling where the index is, so keep going to
+    // the end of the file and let the block checks stop us.
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    blocksEnd = size > 0 ? static_cast<uint64_t>(size) : 0;
+    damaged = true;
+    LogFooter footer;
+    if (blocksEnd >= sizeof(LogHeader) + sizeof(LogFooter) &&
+        std::fseek(file, static_cast<long>(blocksEnd - sizeof(footer)), SEEK_SET) == 0 &&
+        std::fread(&footer, sizeof(footer), 1, file) == 1 &&
+        std::memcmp(footer.magic, footerMagic, sizeof(footerMagic)) == 0) {
+        uint64_t indexBytes = uint64_t(footer.blockCount) * sizeof(LogBlockIndex);
+        if (footer.indexOffset + indexBytes + sizeof(footer) == blocksEnd) {
+            std::vector<unsigned char> index(indexBytes);
+            if (std::fseek(file, static_cast<long>(footer.indexOffset), SEEK_SET) == 0 &&
+                std::fread(index.data(), 1, indexBytes, file) == indexBytes &&
+                crc32(index.data(), indexBytes) == footer.indexCrc) {
+                blocksEnd = footer.indexOffset;
+                damaged = false;
+            }
+        }
+    }
+
+    offset = sizeof(LogHeader);
+    block.clear();
+    position = 0;
+    return true;
+}
+
+bool SessionLogReader::readBlock(LogSnapshot& snapshot, bool& isSnapshot) {
+    if (!file || offset + sizeof(LogBlockHeader) > blocksEnd)
+        return false;
+    LogBlockHeader header;
+    if (std::fseek(file, static_cast<long>(offset), SEEK_SET) != 0 ||
+        std::fread(&header, sizeof(header), 1, file) != 1)
+        return false;
+    if (header.magic != blockMagic && header.magic != snapshotBlockMagic)
+        return false;
+    isSnapshot = header.magic == snapshotBlockMagic;
+
+    uint64_t payload = isSnapshot ? header.recordCount
+                                  : uint64_t(header.recordCount) * sizeof(SessionRecord);
+    uint64_t start = offset + sizeof(header);
+    if (start + payload > blocksEnd)
+        return false;
+
+    void* data;
+    if (isSnapshot) {
+        snapshot.tick = header.firstTick;
+        snapshot.data.resize(payload);
+        data = snapshot.data.data();
+    } else {
+        block.resize(header.recordCount);
+        data = block.data();
+    }
+    if (std::fread(data, 1, payload, file) != payload || crc32(data, payload) != header.crc)
+        return false;
+
+    position = 0;
+    offset = start + payload;
+    return true;
+}
+
+SessionLogReader::Item SessionLogReader::next(SessionRecord& record, LogSnapshot& snapshot) {
+    while (position >= block.size()) {
+        bool isSnapshot = false;
+        if (!readBlock(snapshot, isSnapshot)) {
+            // stopping short of the index means a block was torn or corrupt
+            if (offset < blocksEnd)
+                damaged = true;
+            block.clear();
+            position = 0;
+            offset = blocksEnd;
+            return End;
+        }
+        if (isSnapshot) {
+            block.clear();
+            return Snapshot;
+        }
+    }
+    record = block[position++];
+    return Record;
+}
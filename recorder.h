@@ -0,0 +1,264 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Session recording.
+//
+// Every interesting thing that happens in a session (input samples, shots,
+// spawns, hits, frame timings) is written as one fixed-size 32-byte record.
+// Producer threads drop records into their own lock-free ring buffer and move
+// on; they never take a lock or touch the disk. A background thread drains
+// the rings into large blocks and appends them to the log file.
+//
+// File layout (all little-endian):
+//
+//   LogHeader
+//   { LogBlockHeader, SessionRecord[recordCount] } ...
+//   LogBlockIndex[blockCount]
+//   LogFooter
+//
+// Snapshot blocks (a full copy of the sim state, used to seek in replays)
+// are mixed in with the record blocks. They use the same block header with a
+// different magic, and recordCount holding the size in bytes.
+//
+// The index and footer are only written when the session is closed. If the
+// game crashes before that, readSessionLog() walks the block headers instead
+// and keeps every block whose checksum is intact.
+//
+// Records from different threads are not interleaved in time order; sort by
+// tick/time when reading if that matters.
+
+enum class RecordType : uint8_t {
+    InputSample = 1,
+    // values are the view angles when the button went down and how long
+    // before the end of the tick that was, in seconds
+    Shot,
+    TargetSpawned,
+    TargetHit,
+    TargetExpired,
+    ShotMissed,
+    FrameTiming,
+    // where a shot went relative to the target it was judged against (the
+    // one it hit, or on a miss the one it passed closest to), as of when the
+    // button went down: subject is that target, values are the offset right
+    // and up from its centre and its angular radius, all in radians
+    ShotAim
+};
+
+struct SessionRecord {
+    RecordType type;
+    uint8_t reserved[3];
+    uint32_t tick;
+    uint64_t timeUs;
+    // entity index for target records, 0 otherwise
+    uint32_t subject;
+    // meaning depends on type: positions, view angles, timings in ms, ...
+    float values[3];
+};
+static_assert(sizeof(SessionRecord) == 32, "SessionRecord is a file format");
+
+constexpr uint32_t MAX_SESSION_INFO = 128;
+
+struct LogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t startTimeUs;
+    // opaque blob describing the session (the sim config), so a replay can
+    // set things up exactly as they were
+    uint32_t sessionInfoSize;
+    uint32_t reserved;
+    unsigned char sessionInfo[MAX_SESSION_INFO];
+};
+
+struct LogBlockHeader {
+    uint32_t magic;
+    uint32_t recordCount;
+    uint32_t firstTick;
+    uint32_t lastTick;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+enum class LogBlockKind : uint32_t {
+    Records = 0,
+    Snapshot = 1
+};
+
+struct LogBlockIndex {
+    uint64_t offset;
+    // records, or bytes for a snapshot
+    uint32_t recordCount;
+    uint32_t firstTick;
+    uint32_t lastTick;
+    LogBlockKind kind;
+};
+
+struct LogFooter {
+    char magic[8];
+    uint64_t indexOffset;
+    uint64_t recordCount;
+    uint32_t blockCount;
+    uint32_t indexCrc;
+};
+
+uint32_t crc32(const void* data, std::size_t size, uint32_t crc = 0);
+
+class SessionRecorder {
+public:
+    // maximum number of threads that can record into one recorder
+    static constexpr uint32_t maxThreads = 16;
+    // records per thread ring; must be a power of two
+    static constexpr uint32_t ringCapacity = 1 << 16;
+    // records per block written to disk (1 MB)
+    static constexpr uint32_t blockRecords = 1 << 15;
+    // largest snapshot that can be recorded
+    static constexpr uint32_t snapshotCapacity = 4 << 20;
+
+    SessionRecorder();
+    ~SessionRecorder();
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    // Start a new log at path (overwriting it) and the writer thread.
+    // sessionInfo (up to MAX_SESSION_INFO bytes) is copied into the header.
+    bool open(const char* path, uint64_t startTimeUs,
+              const void* sessionInfo = nullptr, uint32_t sessionInfoSize = 0);
+
+    // Drain everything, write the index and footer, and close the file.
+    void close();
+
+    bool isOpen() const { return file != nullptr; }
+
+    // Never blocks. If this thread's ring is full the record is dropped and
+    // counted in droppedRecords(). The first call from a new thread sets up
+    // its ring, so do that during warm-up.
+    void record(const SessionRecord& r);
+
+    uint64_t droppedRecords() const;
+
+    // Snapshots are staged in a single buffer owned by the recorder. Call
+    // beginSnapshot() to get it (nullptr if the writer is still busy with the
+    // previous one, in which case this snapshot is skipped), fill in up to
+    // snapshotCapacity bytes, then commitSnapshot(). A size of 0 abandons it,
+    // and one over the capacity is refused; both count as dropped.
+    // Game thread only.
+    unsigned char* beginSnapshot();
+    void commitSnapshot(uint32_t tick, uint32_t size);
+    uint64_t droppedSnapshots() const { return skippedSnapshots.load(); }
+    // true while the writer still holds the last committed snapshot
+    bool snapshotBusy() const { return snapshotState.load() != 0; }
+    uint64_t writtenRecords() const { return totalRecords.load(); }
+
+private:
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        alignas(64) std::atomic<uint64_t> dropped{0};
+        SessionRecord records[ringCapacity];
+    };
+
+    Ring* localRing();
+    void writerLoop();
+    void drain();
+    void writeBlock();
+    void writeSnapshot();
+
+    std::FILE* file;
+    uint64_t fileOffset;
+
+    Ring* rings[maxThreads];
+    std::thread::id ringOwners[maxThreads];
+    std::atomic<uint32_t> ringCount;
+    std::mutex registerMutex;
+    // changes on every open() so threads re-fetch their ring
+    std::atomic<uint32_t> session;
+
+    // writer thread state
+    std::thread writer;
+    std::atomic<bool> stopping;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::vector<SessionRecord> staging;
+    std::vector<LogBlockIndex> index;
+    std::atomic<uint64_t> totalRecords;
+
+    // 0 = free, 1 = being filled by the game thread, 2 = ready to write
+    std::atomic<uint32_t> snapshotState;
+    unsigned char* snapshotBuffer;
+    uint32_t snapshotTick;
+    uint32_t snapshotSize;
+    std::atomic<uint64_t> skippedSnapshots;
+};
+
+struct LogSnapshot {
+    uint32_t tick;
+    std::vector<unsigned char> data;
+};
+
+struct SessionLog {
+    LogHeader header;
+    std::vector<SessionRecord> records;
+    std::vector<LogBlockIndex> blocks;
+    // in tick order
+    std::vector<LogSnapshot> snapshots;
+    // true if the footer was missing or damaged and the blocks were found by
+    // scanning
+    bool recovered;
+};
+
+bool readSessionLog(const char* path, SessionLog& log);
+
+// Reads a session log one block at a time, for going through it once
+// without holding all of it in memory. Blocks come back in file order, so
+// records from different threads are interleaved the same way as in
+// readSessionLog(). Like readSessionLog(), it stops quietly at the first
+// torn or corrupt block.
+class SessionLogReader {
+public:
+    enum Item {
+        Record,
+        Snapshot,
+        End
+    };
+
+    SessionLogReader();
+    ~SessionLogReader();
+
+    SessionLogReader(const SessionLogReader&) = delete;
+    SessionLogReader& operator=(const SessionLogReader&) = delete;
+
+    bool open(const char* path);
+    void close();
+
+    const LogHeader& header() const { return logHeader; }
+    // true if the footer was missing or damaged, or a block before it was;
+    // only final once next() has returned End
+    bool recovered() const { return damaged; }
+
+    // Read the next item into record or snapshot.
+    Item next(SessionRecord& record, LogSnapshot& snapshot);
+
+private:
+    // read the block at offset; false at the end of the blocks or a bad one
+    bool readBlock(LogSnapshot& snapshot, bool& isSnapshot);
+
+    std::FILE* file;
+    LogHeader logHeader;
+    uint64_t offset;
+    // where the blocks stop: the index, or the end of the file without one
+    uint64_t blocksEnd;
+    std::vector<SessionRecord> block;
+    std::size_t position;
+    bool damaged;
+};
+
+#endif
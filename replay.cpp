@@ -0,0 +1,318 @@
+#include "replay.h"
+#include "codec.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// A shot's outcome, in a form that can be compared between the log and the
+// re-simulation.
+struct Outcome {
+    uint32_t tick;
+    RecordType type;
+    uint32_t subject;
+
+    bool operator<(const Outcome& o) const {
+        if (tick != o.tick)
+            return tick < o.tick;
+        if (type != o.type)
+            return type < o.type;
+        return subject < o.subject;
+    }
+    bool operator==(const Outcome& o) const {
+        return tick == o.tick && type == o.type && subject == o.subject;
+    }
+};
+
+bool readConfig(const SessionLog& log, SimConfig& config) {
+    if (log.header.sessionInfoSize != sizeof(SimConfig)) {
+        std::cout << "ERROR::REPLAY::MISSING_SIM_CONFIG" << std::endl;
+        return false;
+    }
+    std::memcpy(&config, log.header.sessionInfo, sizeof(config));
+    return true;
+}
+
+// Rebuild the per-tick input stream the sim consumed, and optionally pull out
+// the recorded shot outcomes.
+void readInputs(const SessionLog& log, std::vector<SimInput>& inputs,
+                std::vector<Outcome>* outcomes) {
+    uint32_t tickCount = 0;
+    for (const SessionRecord& r : log.records) {
+        if (r.type == RecordType::InputSample)
+            tickCount = std::max(tickCount, r.tick + 1);
+    }
+    inputs.assign(tickCount, SimInput{0.0f, 0.0f, false, 0.0f, 0.0f, 0.0f});
+    for (const SessionRecord& r : log.records) {
+        if (r.tick >= tickCount)
+            continue;
+        switch (r.type) {
+        case RecordType::InputSample:
+            inputs[r.tick].yaw = r.values[0];
+            inputs[r.tick].pitch = r.values[1];
+            break;
+        case RecordType::Shot:
+            // logs from before shots were timestamped hold the tick's view
+            // angles and a zero age here, which replays the same way
+            inputs[r.tick].fire = true;
+            inputs[r.tick].fireYaw = r.values[0];
+            inputs[r.tick].firePitch = r.values[1];
+            inputs[r.tick].fireAge = r.values[2];
+            break;
+        case RecordType::TargetHit:
+            if (outcomes)
+                outcomes->push_back(Outcome{r.tick, r.type, r.subject});
+            break;
+        case RecordType::ShotMissed:
+            // a miss has no target; the log holds an invalid handle's index
+            if (outcomes)
+                outcomes->push_back(Outcome{r.tick, r.type, 0});
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+}
+
+void recordTick(SessionRecorder& recorder, const SimState& sim,
+                const SimInput& input, uint32_t tick, uint64_t timeUs) {
+    SessionRecord r = {};
+    r.tick = tick;
+    r.timeUs = timeUs;
+
+    r.type = RecordType::InputSample;
+    r.values[0] = input.yaw;
+    r.values[1] = input.pitch;
+    recorder.record(r);
+
+    if (input.fire) {
+        r.type = RecordType::Shot;
+        r.values[0] = input.fireYaw;
+        r.values[1] = input.firePitch;
+        r.values[2] = input.fireAge;
+        recorder.record(r);
+
+        // The shot as the sim judged it: the fire direction against the
+        // target it hit or passed closest to, where that target was when the
+        // button went down. The offset is measured in the plane across the
+        // line to the target's centre and scaled so its length is the angle
+        // between the two, so it's inside the angular radius exactly when
+        // the sim counted a hit on it.
+        const SimShot& shot = sim.shot;
+        const Position& p = shot.targetPosition;
+        float dist = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        if (shot.fired && shot.target.valid() && dist > shot.targetRadius) {
+            float fcp = std::cos(shot.pitch);
+            float fx = fcp * std::sin(shot.yaw);
+            float fy = std::sin(shot.pitch);
+            float fz = -fcp * std::cos(shot.yaw);
+
+            float ty = std::atan2(p.x, -p.z);
+            float tp = std::atan2(p.y, std::sqrt(p.x * p.x + p.z * p.z));
+            float right = fx * std::cos(ty) + fz * std::sin(ty);
+            float up = -fx * std::sin(tp) * std::sin(ty) + fy * std::cos(tp) +
+                       fz * std::sin(tp) * std::cos(ty);
+            float along = (fx * p.x + fy * p.y + fz * p.z) / dist;
+            float angle = std::acos(std::fmin(1.0f, std::fmax(-1.0f, along)));
+            float across = std::sqrt(right * right + up * up);
+            float scale = across > 1e-9f ? angle / across : 0.0f;
+
+            r.type = RecordType::ShotAim;
+            r.subject = shot.target.index;
+            r.values[0] = right * scale;
+            r.values[1] = up * scale;
+            r.values[2] = std::asin(shot.targetRadius / dist);
+            recorder.record(r);
+            r.subject = 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < sim.eventCount; i++) {
+        const SimEvent& e = sim.events[i];
+        switch (e.type) {
+        case SimEventType::TargetSpawned: r.type = RecordType::TargetSpawned; break;
+        case SimEventType::TargetHit:     r.type = RecordType::TargetHit;     break;
+        case SimEventType::TargetExpired: r.type = RecordType::TargetExpired; break;
+        case SimEventType::ShotMissed:    r.type = RecordType::ShotMissed;    break;
+        }
+        r.subject = e.target.index;
+        r.values[0] = e.x;
+        r.values[1] = e.y;
+        r.values[2] = e.z;
+        recorder.record(r);
+    }
+}
+
+void recordSnapshot(SessionRecorder& recorder, const SimState& sim,
+                    uint32_t interval) {
+    if (interval == 0 || sim.tick % interval != 0)
+        return;
+    unsigned char* buffer = recorder.beginSnapshot();
+    if (!buffer)
+        return;
+
+    ByteWriter out(buffer, SessionRecorder::snapshotCapacity);
+    simSaveSnapshot(sim, out);
+    recorder.commitSnapshot(sim.tick, out.overflow ? 0 : static_cast<uint32_t>(out.size));
+}
+
+bool replaySession(const SessionLog& log, ReplayResult& result, JobSystem* jobs) {
+    result = ReplayResult{};
+
+    SimConfig config;
+    if (!readConfig(log, config))
+        return false;
+
+    std::vector<SimInput> inputs;
+    std::vector<Outcome> recorded;
+    readInputs(log, inputs, &recorded);
+    uint32_t tickCount = static_cast<uint32_t>(inputs.size());
+
+    // Re-simulate. SimState is big, so it goes on the heap; this is an
+    // offline tool so that's fine.
+    std::unique_ptr<SimState> sim(new SimState());
+    FrameArena frameArena(4 << 20);
+    simInit(*sim, config);
+
+    std::vector<Outcome> simulated;
+    simulated.reserve(recorded.size());
+
+    // No reset between ticks: simUpdate hands its scratch back itself, the
+    // same way in the game where one frame can run many ticks, so both see
+    // the arena the same way.
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t tick = 0; tick < tickCount; tick++) {
+        simUpdate(*sim, inputs[tick], frameArena, jobs);
+        for (uint32_t i = 0; i < sim->eventCount; i++) {
+            const SimEvent& e = sim->events[i];
+            if (e.type == SimEventType::TargetHit)
+                simulated.push_back(Outcome{tick, RecordType::TargetHit, e.target.index});
+            else if (e.type == SimEventType::ShotMissed)
+                simulated.push_back(Outcome{tick, RecordType::ShotMissed, 0});
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // records from different threads may be out of order in the log
+    std::sort(recorded.begin(), recorded.end());
+    std::sort(simulated.begin(), simulated.end());
+
+    for (const Outcome& o : recorded)
+        (o.type == RecordType::TargetHit ? result.recordedHits : result.recordedMisses)++;
+
+    size_t common = std::min(recorded.size(), simulated.size());
+    for (size_t i = 0; i < common; i++) {
+        if (!(recorded[i] == simulated[i]))
+            result.mismatches++;
+    }
+    result.mismatches += static_cast<uint32_t>(
+        std::max(recorded.size(), simulated.size()) - common);
+
+    result.ticks = tickCount;
+    result.hits = sim->hits;
+    result.misses = sim->misses;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    double realTime = double(tickCount) / SIM_TICK_RATE;
+    result.speedup = result.seconds > 0.0 ? realTime / result.seconds : 0.0;
+    result.matches = result.mismatches == 0;
+    return true;
+}
+
+/// ~~~ Seeking ~~~
+
+ReplayPlayer::ReplayPlayer()
+    : sim(new SimState()), frameArena(4 << 20), config(defaultSimConfig()),
+      seekTicks(0) {
+    simInit(*sim, config);
+}
+
+bool ReplayPlayer::load(const SessionLog& log) {
+    if (!readConfig(log, config))
+        return false;
+    readInputs(log, inputs, nullptr);
+    snapshots = log.snapshots;
+    simInit(*sim, config);
+    seekTicks = 0;
+    return true;
+}
+
+bool ReplayPlayer::step() {
+    if (sim->tick >= inputs.size())
+        return false;
+    simUpdate(*sim, inputs[sim->tick], frameArena, nullptr);
+    return true;
+}
+
+bool ReplayPlayer::seek(uint32_t tick) {
+    if (tick > tickCount())
+        tick = tickCount();
+
+    // Latest snapshot at or before the target. If we're already between it
+    // and the target, just keep going from where we are.
+    const LogSnapshot* best = nullptr;
+    for (const LogSnapshot& s : snapshots) {
+        if (s.tick <= tick)
+            best = &s;
+    }
+
+    uint32_t from = sim->tick;
+    bool restart = from > tick || (best && best->tick > from);
+    if (restart) {
+        if (best) {
+            // A snapshot that doesn't load means the log and this build
+            // disagree about the sim state; simulating from the start would
+            // only hide that, so start over and say so.
+            ByteReader in(best->data.data(), best->data.size());
+            if (!simLoadSnapshot(*sim, in)) {
+                std::cout << "ERROR::REPLAY::SNAPSHOT_RESTORE_FAILED\n"
+                          << "snapshot at tick " << best->tick << std::endl;
+                simInit(*sim, config);
+                seekTicks = 0;
+                return false;
+            }
+        } else {
+            simInit(*sim, config);
+        }
+        from = sim->tick;
+    }
+
+    while (sim->tick < tick)
+        step();
+    seekTicks = tick - from;
+    return true;
+}
+
+int replayFiles(int count, char** paths) {
+    int failures = 0;
+    SessionLog log;
+    for (int i = 0; i < count; i++) {
+        ReplayResult result;
+        bool loaded = isCompressedReplay(paths[i]) ? readCompressedReplay(paths[i], log)
+                                                   : readSessionLog(paths[i], log);
+        if (!loaded || !replaySession(log, result)) {
+            std::cout << paths[i] << ": FAILED to load" << std::endl;
+            failures++;
+            continue;
+        }
+
+        std::cout << paths[i] << ": " << (result.matches ? "OK" : "MISMATCH")
+                  << " ticks=" << result.ticks
+                  << " hits=" << result.hits << "/" << result.recordedHits
+                  << " misses=" << result.misses << "/" << result.recordedMisses
+                  << " mismatches=" << result.mismatches
+                  << " speed=" << static_cast<int>(result.speedup) << "x"
+                  << (log.recovered ? " (recovered)" : "") << std::endl;
+        if (!result.matches)
+            failures++;
+    }
+    return failures;
+}
@@ -0,0 +1,84 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "arena.h"
+#include "jobs.h"
+#include "recorder.h"
+#include "sim.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Recording sessions and playing them back.
+//
+// Headless replay re-runs a recorded session's per-tick inputs through the
+// simulation with no window or GL context, as fast as the CPU allows, and
+// checks that it produces the same hits and misses as the recording did.
+
+// Write one tick's input and the sim events it produced. Call right after
+// simUpdate() with the tick number the update ran.
+void recordTick(SessionRecorder& recorder, const SimState& sim,
+                const SimInput& input, uint32_t tick, uint64_t timeUs);
+
+// Every `interval` ticks, write a full sim snapshot so replays can seek
+// without simulating from the start. Larger intervals make smaller files but
+// slower seeks; 0 disables snapshots. Call after simUpdate().
+void recordSnapshot(SessionRecorder& recorder, const SimState& sim,
+                    uint32_t interval);
+
+struct ReplayResult {
+    uint32_t ticks;
+    // from re-simulating
+    uint32_t hits;
+    uint32_t misses;
+    // from the log
+    uint32_t recordedHits;
+    uint32_t recordedMisses;
+    // shot outcomes that differ in tick, kind or target
+    uint32_t mismatches;
+    // wall-clock time spent re-simulating, and how much faster than real
+    // time that was
+    double seconds;
+    double speedup;
+    bool matches;
+};
+
+// jobs may be null to re-simulate on the calling thread.
+bool replaySession(const SessionLog& log, ReplayResult& result,
+                   JobSystem* jobs = nullptr);
+
+// Interactive playback with seeking. Seeking restores the nearest snapshot at
+// or before the requested tick and simulates forward from there. If that
+// snapshot can't be restored, seek() fails and leaves the player at tick 0.
+class ReplayPlayer {
+public:
+    ReplayPlayer();
+
+    // Takes what it needs from the log; the log can be discarded afterwards.
+    bool load(const SessionLog& log);
+
+    bool seek(uint32_t tick);
+    // advance one tick; returns false at the end of the session
+    bool step();
+
+    const SimState& state() const { return *sim; }
+    uint32_t tick() const { return sim->tick; }
+    uint32_t tickCount() const { return static_cast<uint32_t>(inputs.size()); }
+    // ticks simulated by the last seek, after restoring a snapshot
+    uint32_t lastSeekTicks() const { return seekTicks; }
+
+private:
+    std::unique_ptr<SimState> sim;
+    FrameArena frameArena;
+    SimConfig config;
+    std::vector<SimInput> inputs;
+    std::vector<LogSnapshot> snapshots;
+    uint32_t seekTicks;
+};
+
+// Replay every file (raw session logs or compressed replays), print one line
+// per session and return the number that failed to load or didn't match.
+int replayFiles(int count, char** paths);
+
+#endif
@@ -0,0 +1,69 @@
+#include "resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// weight of each new timing in the running average
+const float smoothing = 0.2f;
+
+// frames under raiseBelow before the scale goes up
+const uint32_t calmFrames = 30;
+
+// Changes smaller than this aren't worth a visible resolution switch.
+const float minChange = 0.02f;
+
+}
+
+ResolutionConfig defaultResolutionConfig(float budgetMs) {
+    ResolutionConfig config;
+    config.budgetMs = budgetMs;
+    config.minScale = 0.5f;
+    config.maxScale = 1.0f;
+    config.raiseBelow = 0.75f;
+    config.raiseStep = 0.05f;
+    config.settleFrames = 4;
+    return config;
+}
+
+ResolutionController::ResolutionController(const ResolutionConfig& config)
+    : config(config), current(config.maxScale), average(0.0f), settle(0), calm(0) {
+}
+
+bool ResolutionController::update(float gpuMs) {
+    if (!(gpuMs > 0.0f))
+        return false;
+    average = average > 0.0f ? average + smoothing * (gpuMs - average) : gpuMs;
+    if (settle) {
+        settle--;
+        return false;
+    }
+
+    float wanted = current;
+    if (gpuMs > config.budgetMs) {
+        // React to the spike itself rather than the average, aiming a little
+        // under budget so the next frame isn't borderline again.
+        calm = 0;
+        wanted = current * std::sqrt(0.9f * config.budgetMs / gpuMs);
+    } else if (average < config.raiseBelow * config.budgetMs) {
+        if (++calm < calmFrames)
+            return false;
+        calm = 0;
+        float fit = current * std::sqrt(0.9f * config.budgetMs / average);
+        wanted = std::min(fit, current + config.raiseStep);
+    } else {
+        calm = 0;
+        return false;
+    }
+
+    wanted = std::min(std::max(wanted, config.minScale), config.maxScale);
+    // Always take a step that reaches either end, however small.
+    bool toLimit = wanted != current &&
+                   (wanted == config.minScale || wanted == config.maxScale);
+    if (std::fabs(wanted - current) < minChange && !toLimit)
+        return false;
+    current = wanted;
+    settle = config.settleFrames;
+    return true;
+}
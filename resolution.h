@@ -0,0 +1,51 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <cstdint>
+
+// Picks the scale the 3D scene renders at to keep its GPU time in budget.
+//
+// The scene's cost is close to proportional to the pixels drawn, which go
+// with the square of the scale, so an over-budget frame is answered at once
+// with the scale that would have fit it. Going back up is slower: only after
+// a run of frames comfortably under budget, and a few percent at a time, so
+// a single quiet frame doesn't bounce the resolution around. GPU timings
+// arrive a few frames late (see GpuTimer in scenetarget.h), so after each
+// change the controller waits for timings taken at the new scale.
+
+struct ResolutionConfig {
+    // GPU time to stay under, in milliseconds
+    float budgetMs;
+    float minScale;
+    float maxScale;
+    // only go up while under this fraction of the budget
+    float raiseBelow;
+    // most the scale goes up in one step
+    float raiseStep;
+    // frames to ignore after a change, while older timings drain
+    uint32_t settleFrames;
+};
+
+ResolutionConfig defaultResolutionConfig(float budgetMs);
+
+class ResolutionController {
+public:
+    explicit ResolutionController(const ResolutionConfig& config);
+
+    // Feed one GPU timing for the scene. Returns true if the scale changed.
+    bool update(float gpuMs);
+
+    float scale() const { return current; }
+    // smoothed GPU time the controller is working from
+    float averageMs() const { return average; }
+
+private:
+    ResolutionConfig config;
+    float current;
+    float average;
+    uint32_t settle;
+    // frames in a row under raiseBelow of the budget
+    uint32_t calm;
+};
+
+#endif
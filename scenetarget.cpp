@@ -0,0 +1,199 @@
+#include <GL/glew.h>
+
+#include "scenetarget.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// One triangle that covers the whole window; uv runs 0..1 across it.
+const char* upscaleVertexSource =
+    "#version 330 core\n"
+    "out vec2 uv;\n"
+    "void main()\n"
+    "{\n"
+    "    uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\0";
+
+// region is the part of the texture the scene was drawn into. Samples stay
+// half a texel inside it, so filtering never picks up what's past its edge.
+const char* upscaleFragmentSource =
+    "#version 330 core\n"
+    "in vec2 uv;\n"
+    "out vec4 FragColor;\n"
+    "uniform sampler2D scene;\n"
+    "uniform vec2 region;\n"
+    "uniform vec2 clampTo;\n"
+    "void main()\n"
+    "{\n"
+    "    FragColor = texture(scene, min(uv * region, clampTo));\n"
+    "}\0";
+
+// the scene goes on screen before anything else in the composite pass
+const uint32_t upscaleOrder = 0;
+
+}
+
+GpuTimer::GpuTimer()
+    : queries{}, pending{}, next(0), oldest(0), running(false) {
+}
+
+GpuTimer::~GpuTimer() {
+    if (queries[0])
+        glDeleteQueries(depth, queries);
+}
+
+void GpuTimer::setup() {
+    glGenQueries(depth, queries);
+}
+
+void GpuTimer::begin() {
+    // every query is still waiting on the GPU; skip this frame
+    if (!queries[0] || pending[next])
+        return;
+    glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    running = true;
+}
+
+void GpuTimer::end() {
+    if (!running)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+    next = (next + 1) % depth;
+    running = false;
+}
+
+bool GpuTimer::poll(float& ms) {
+    bool any = false;
+    while (pending[oldest]) {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &ns);
+        ms = static_cast<float>(ns / 1e6);
+        any = true;
+        pending[oldest] = false;
+        oldest = (oldest + 1) % depth;
+    }
+    return any;
+}
+
+SceneTarget::SceneTarget()
+    : fbo(0), color(0), depth(0), width(0), height(0), scaledWidth(0), scaledHeight(0),
+      ready(false), program(0), vao(0), regionLocation(-1), clampLocation(-1) {
+}
+
+SceneTarget::~SceneTarget() {
+    if (program) {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+    }
+}
+
+bool SceneTarget::setup() {
+    program = buildShaderProgram(upscaleVertexSource, upscaleFragmentSource);
+    if (!program)
+        return false;
+    regionLocation = glGetUniformLocation(program, "region");
+    clampLocation = glGetUniformLocation(program, "clampTo");
+
+    // core profile still wants a vertex array bound to draw, even an empty one
+    glGenVertexArrays(1, &vao);
+
+    // Storage comes in begin(), once the window size is known.
+    glGenTextures(1, &color);
+    glBindTexture(GL_TEXTURE_2D, color);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenRenderbuffers(1, &depth);
+    glGenFramebuffers(1, &fbo);
+    ready = true;
+    return true;
+}
+
+void SceneTarget::begin(int windowWidth, int windowHeight, float scale) {
+    if (ready && (windowWidth != width || windowHeight != height) && windowWidth > 0 &&
+        windowHeight > 0) {
+        // Put back whatever texture was bound, which GlState remembers.
+        GLint bound = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowWidth, windowHeight, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(bound));
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, windowWidth,
+                              windowHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                                  depth);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERROR::FRAMEBUFFER::SCENE::INCOMPLETE\n" << std::hex << status
+                      << std::dec << std::endl;
+            ready = false;
+        }
+    }
+    width = windowWidth;
+    height = windowHeight;
+
+    glClearColor(0.08f, 0.08f, 0.1f, 1.0f);
+    if (!ready) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        scaledWidth = width;
+        scaledHeight = height;
+        return;
+    }
+
+    scale = std::min(std::max(scale, 0.1f), 1.0f);
+    scaledWidth = std::max(1, static_cast<int>(width * scale + 0.5f));
+    scaledHeight = std::max(1, static_cast<int>(height * scale + 0.5f));
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, scaledWidth, scaledHeight);
+    // only the corner the scene uses
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, scaledWidth, scaledHeight);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+void SceneTarget::record(CommandBuffer& commands) {
+    if (!ready || width <= 0 || height <= 0)
+        return;
+    DrawPacket packet = {program, vao, color, GL_TRIANGLES, 0, 3, 0, 0, 0,
+                         &SceneTarget::setUniforms, this};
+    commands.add(compositeKey(upscaleOrder), packet);
+}
+
+void SceneTarget::end() {
+    if (!ready)
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+}
+
+void SceneTarget::setUniforms(void* context) {
+    const SceneTarget* self = static_cast<const SceneTarget*>(context);
+    float w = static_cast<float>(self->width);
+    float h = static_cast<float>(self->height);
+    glUniform2f(self->regionLocation, self->scaledWidth / w, self->scaledHeight / h);
+    glUniform2f(self->clampLocation, (self->scaledWidth - 0.5f) / w,
+                (self->scaledHeight - 0.5f) / h);
+}
@@ -0,0 +1,88 @@
+#ifndef SCENETARGET_H
+#define SCENETARGET_H
+
+#include "commandbuffer.h"
+
+#include <cstdint>
+
+// Rendering the 3D scene below native resolution.
+//
+// The scene is drawn into an offscreen framebuffer at some fraction of the
+// window size, then stretched over the window by one composite packet with
+// bilinear filtering, before the HUD and crosshair are drawn at full
+// resolution on top. The offscreen buffer is allocated at the full window
+// size and the scene uses its bottom-left corner, so changing the scale
+// every frame costs nothing. How far to scale is up to the caller; see
+// ResolutionController in resolution.h and GpuTimer below.
+
+// Measures GPU time between begin() and end() with timer queries. Results
+// arrive a few frames later, when the GPU has caught up; reading them never
+// waits. Frames where every query is still in flight go unmeasured.
+class GpuTimer {
+public:
+    static constexpr uint32_t depth = 4;
+
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Needs a current GL context.
+    void setup();
+    void begin();
+    void end();
+    // The newest result that has come in since the last poll, in
+    // milliseconds; false if none has.
+    bool poll(float& ms);
+
+private:
+    unsigned int queries[depth];
+    bool pending[depth];
+    uint32_t next;
+    uint32_t oldest;
+    bool running;
+};
+
+class SceneTarget {
+public:
+    SceneTarget();
+    ~SceneTarget();
+
+    SceneTarget(const SceneTarget&) = delete;
+    SceneTarget& operator=(const SceneTarget&) = delete;
+
+    // Needs a current GL context.
+    bool setup();
+
+    // Bind the offscreen buffer at `scale` of the window size and clear it.
+    // If it couldn't be made, draws go straight to the window at full size
+    // instead and everything below is a no-op.
+    void begin(int width, int height, float scale);
+    // Record the packet that stretches the scene over the window.
+    void record(CommandBuffer& commands);
+    // Go back to the window, ready for the composite and overlay passes.
+    void end();
+
+    // size the scene was last drawn at, in pixels
+    int sceneWidth() const { return scaledWidth; }
+    int sceneHeight() const { return scaledHeight; }
+
+private:
+    static void setUniforms(void* context);
+
+    unsigned int fbo;
+    unsigned int color;
+    unsigned int depth;
+    // size the buffers were allocated at, and the window size
+    int width, height;
+    int scaledWidth, scaledHeight;
+    bool ready;
+
+    unsigned int program;
+    unsigned int vao;
+    int regionLocation;
+    int clampLocation;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include <GL/glew.h>
+
+#include "shader.h"
+
+#include <iostream>
+
+namespace {
+
+// 0 if it didn't compile.
+unsigned int compileShader(GLenum type, const char* const* sources, int count,
+                           const char* name) {
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, count, sources, NULL);
+    glCompileShader(shader);
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::" << name << "::COMPILATION_FAILED\n" << infoLog
+                  << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+}
+
+unsigned int buildShaderProgram(const char* vertexSource, const char* fragmentSource) {
+    return buildShaderProgram(&vertexSource, 1, fragmentSource);
+}
+
+unsigned int buildShaderProgram(const char* const* vertexSources, int vertexCount,
+                                const char* fragmentSource) {
+    unsigned int vertexShader =
+        compileShader(GL_VERTEX_SHADER, vertexSources, vertexCount, "VERTEX");
+    unsigned int fragmentShader =
+        compileShader(GL_FRAGMENT_SHADER, &fragmentSource, 1, "FRAGMENT");
+    if (!vertexShader || !fragmentShader) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    // the program keeps what it needs
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
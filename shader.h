@@ -0,0 +1,16 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+// Shader programs from GLSL source strings, for the views' setup.
+//
+// Compile and link errors are printed with the driver's log and give
+// program 0, which the views treat as "not set up" and skip drawing.
+
+// A program from a vertex and a fragment shader. Needs a current GL context.
+unsigned int buildShaderProgram(const char* vertexSource, const char* fragmentSource);
+// The same with the vertex shader split over vertexCount strings, joined in
+// order; e.g. a header that differs between variants, then a shared body.
+unsigned int buildShaderProgram(const char* const* vertexSources, int vertexCount,
+                                const char* fragmentSource);
+
+#endif
@@ -0,0 +1,564 @@
+#include "sim.h"
+#include "sweep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// xorshift32: tiny, fast, and fully determined by the seed
+uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float randomRange(uint32_t& state, float lo, float hi) {
+    return lo + (hi - lo) * (nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+void pushEvent(SimState& sim, SimEventType type, Handle target,
+               float x, float y, float z) {
+    // if the frame's event budget is exhausted the event is dropped rather
+    // than growing anything
+    if (sim.eventCount >= MAX_EVENTS_PER_FRAME)
+        return;
+    sim.events[sim.eventCount++] = SimEvent{type, target, x, y, z};
+}
+
+// Scratch for one tick. Without it the tick would skip collisions, expiry
+// or the swept test and play out differently from a replay of it, so
+// running out means the arena is too small, not something to carry on from.
+template <typename T>
+T* tickScratch(FrameArena& frameArena, std::size_t count) {
+    T* p = frameArena.allocateArray<T>(count);
+    if (!p) {
+        std::cout << "ERROR::SIM::OUT_OF_SCRATCH\n"
+                  << sizeof(T) * count << " bytes" << std::endl;
+        assert(!"frame arena too small for a sim tick");
+    }
+    return p;
+}
+
+// Rows per chunk when a pass over the targets is split across the job
+// system.
+const uint32_t simChunk = 256;
+
+// Run f(chunk, begin, end) over [0, count) in chunks of simChunk rows, across
+// the job system if there is one. The chunks depend on count alone, so
+// results kept per chunk and combined in chunk order come out the same
+// however many threads ran them, which replays rely on.
+template <typename F>
+void forEachChunk(JobSystem* jobs, uint32_t count, F&& f) {
+    uint32_t chunks = (count + simChunk - 1) / simChunk;
+    auto run = [&](uint32_t first, uint32_t last) {
+        for (uint32_t c = first; c < last; c++)
+            f(c, c * simChunk, std::min(count, (c + 1) * simChunk));
+    };
+    if (jobs)
+        jobs->parallelFor(chunks, 1, run);
+    else
+        run(0, chunks);
+}
+
+uint32_t chunkCount(uint32_t count) {
+    return (count + simChunk - 1) / simChunk;
+}
+
+// The target nearest a direction by angle, over some run of rows.
+struct NearestTarget {
+    Handle target;
+    // cosine of the angle to it; -2 if there's none
+    float cos;
+    float distance;
+    float radius;
+    Position position;
+};
+
+// Take b over a if it's strictly nearer. Keeping the first of equals makes
+// combining chunk results in order give what one pass over all rows would.
+void takeNearer(NearestTarget& a, const NearestTarget& b) {
+    if (b.cos > a.cos)
+        a = b;
+}
+
+void spawnTarget(SimState& sim) {
+    Position p;
+    Velocity v = {0.0f, 0.0f, 0.0f};
+    if (sim.config.bouncing) {
+        // anywhere in the arena box, heading off in a random direction
+        const CollisionBounds& b = sim.config.bounds;
+        p.x = randomRange(sim.rng, b.minX + 1.0f, b.maxX - 1.0f);
+        p.y = randomRange(sim.rng, b.minY + 1.0f, b.maxY - 1.0f);
+        p.z = randomRange(sim.rng, b.minZ + 1.0f, b.maxZ - 1.0f);
+        v.x = randomRange(sim.rng, -1.0f, 1.0f) * sim.config.targetSpeed;
+        v.y = randomRange(sim.rng, -1.0f, 1.0f) * sim.config.targetSpeed;
+        v.z = randomRange(sim.rng, -1.0f, 1.0f) * sim.config.targetSpeed;
+    } else {
+        p.x = randomRange(sim.rng, -6.0f, 6.0f);
+        p.y = randomRange(sim.rng, -3.0f, 3.0f);
+        p.z = -15.0f;
+    }
+
+    PositionHistory history = {};
+    history.firstTick = sim.tick;
+    Handle h = sim.world.create(p, v, TargetBody{sim.config.targetRadius},
+                                Lifetime{0.0f, sim.config.targetLifetime}, history);
+    if (h.valid())
+        pushEvent(sim, SimEventType::TargetSpawned, h, p.x, p.y, p.z);
+}
+
+// Where a target was `ticksAgo` ticks before the end of tick `tick` (the one
+// being simulated), interpolated between the ends of the ticks either side.
+// `current` is its position at the end of this tick, which isn't in the
+// history yet. False if it hadn't spawned by then.
+bool positionAt(const PositionHistory& history, const Position& current,
+                uint32_t tick, float ticksAgo, Position& out) {
+    if (static_cast<float>(tick - history.firstTick) < ticksAgo)
+        return false;
+    uint32_t k = static_cast<uint32_t>(ticksAgo);
+    float f = ticksAgo - static_cast<float>(k);
+    const Position& newer = k == 0
+        ? current : history.positions[(tick - k) % TARGET_HISTORY_TICKS];
+    if (f == 0.0f) {
+        out = newer;
+        return true;
+    }
+    const Position& older = history.positions[(tick - k - 1) % TARGET_HISTORY_TICKS];
+    out.x = newer.x + (older.x - newer.x) * f;
+    out.y = newer.y + (older.y - newer.y) * f;
+    out.z = newer.z + (older.z - newer.z) * f;
+    return true;
+}
+
+// True if the crosshair passed over a target at any point during this tick.
+// Targets go from where they ended the last tick to where they are now.
+bool sweptOverTarget(SimState& sim, const SimInput& input, FrameArena& frameArena,
+                     JobSystem* jobs) {
+    uint32_t count = sim.world.count<Position, TargetBody, PositionHistory>();
+    if (count == 0)
+        return false;
+    float* x0 = tickScratch<float>(frameArena, count);
+    float* y0 = tickScratch<float>(frameArena, count);
+    float* z0 = tickScratch<float>(frameArena, count);
+    float* x1 = tickScratch<float>(frameArena, count);
+    float* y1 = tickScratch<float>(frameArena, count);
+    float* z1 = tickScratch<float>(frameArena, count);
+    float* radius = tickScratch<float>(frameArena, count);
+    if (!x0 || !y0 || !z0 || !x1 || !y1 || !z1 || !radius)
+        return false;
+
+    uint32_t n = 0;
+    const uint32_t previous = (sim.tick - 1) % TARGET_HISTORY_TICKS;
+    sim.world.query<Position, TargetBody, PositionHistory>(
+        [&](uint32_t rows, const Handle*, Position* p, TargetBody* body,
+            PositionHistory* history) {
+            forEachChunk(jobs, rows, [&](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    const Position& from = history[i].firstTick < sim.tick
+                        ? history[i].positions[previous] : p[i];
+                    uint32_t k = n + i;
+                    x0[k] = from.x; y0[k] = from.y; z0[k] = from.z;
+                    x1[k] = p[i].x; y1[k] = p[i].y; z1[k] = p[i].z;
+                    radius[k] = body[i].radius;
+                }
+            });
+            n += rows;
+        });
+
+    CrosshairSweep sweep = makeCrosshairSweep(sim.lastYaw, sim.lastPitch,
+                                              input.yaw, input.pitch);
+    std::atomic<uint32_t> crossed{0};
+    forEachChunk(jobs, n, [&](uint32_t, uint32_t begin, uint32_t end) {
+        SweepTargets targets = {x0 + begin, y0 + begin, z0 + begin, x1 + begin,
+                                y1 + begin, z1 + begin, radius + begin, end - begin};
+        if (sweepCrosshair(sweep, targets) > 0)
+            crossed.fetch_add(1, std::memory_order_relaxed);
+    });
+    return crossed.load() > 0;
+}
+
+// The collision code wants one array per field, indexed by a stable body id.
+// Table rows move when entities are destroyed, so use the entity index as the
+// id and scatter the columns into scratch arrays from the frame arena, then
+// copy the results back.
+void collideTargets(SimState& sim, FrameArena& frameArena, JobSystem* jobs) {
+    CollisionBodies bodies;
+    bodies.capacity = MAX_TARGETS;
+    bodies.x = tickScratch<float>(frameArena, MAX_TARGETS);
+    bodies.y = tickScratch<float>(frameArena, MAX_TARGETS);
+    bodies.z = tickScratch<float>(frameArena, MAX_TARGETS);
+    bodies.vx = tickScratch<float>(frameArena, MAX_TARGETS);
+    bodies.vy = tickScratch<float>(frameArena, MAX_TARGETS);
+    bodies.vz = tickScratch<float>(frameArena, MAX_TARGETS);
+    float* radius = tickScratch<float>(frameArena, MAX_TARGETS);
+    uint8_t* active = tickScratch<uint8_t>(frameArena, MAX_TARGETS);
+    if (!bodies.x || !bodies.y || !bodies.z || !bodies.vx || !bodies.vy ||
+        !bodies.vz || !radius || !active)
+        return;
+    bodies.radius = radius;
+    bodies.active = active;
+
+    // Every row has its own id, so scattering and gathering split across
+    // the job system freely. The broadphase keeps its sorted order from
+    // tick to tick and stays on this thread; the narrowphase and the walls
+    // split, and the response is serial (see resolveCollisions).
+    std::memset(active, 0, MAX_TARGETS);
+    sim.world.query<Position, Velocity, TargetBody>(
+        [&](uint32_t count, const Handle* handles, Position* p, Velocity* v,
+            TargetBody* body) {
+            forEachChunk(jobs, count, [&](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t row = begin; row < end; row++) {
+                    uint32_t id = handles[row].index;
+                    active[id] = 1;
+                    bodies.x[id] = p[row].x; bodies.y[id] = p[row].y; bodies.z[id] = p[row].z;
+                    bodies.vx[id] = v[row].x; bodies.vy[id] = v[row].y; bodies.vz[id] = v[row].z;
+                    radius[id] = body[row].radius;
+                }
+            });
+        });
+
+    CollisionPair* pairs;
+    uint32_t pairCount = sim.broadphase.findPairs(bodies, frameArena, &pairs);
+    resolveCollisions(bodies, pairs, pairCount, frameArena, jobs);
+    collideWithBounds(bodies, sim.config.bounds, jobs);
+
+    sim.world.query<Position, Velocity, TargetBody>(
+        [&](uint32_t count, const Handle* handles, Position* p, Velocity* v,
+            TargetBody*) {
+            forEachChunk(jobs, count, [&](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t row = begin; row < end; row++) {
+                    uint32_t id = handles[row].index;
+                    p[row] = Position{bodies.x[id], bodies.y[id], bodies.z[id]};
+                    v[row] = Velocity{bodies.vx[id], bodies.vy[id], bodies.vz[id]};
+                }
+            });
+        });
+}
+
+}
+
+SimConfig defaultSimConfig() {
+    SimConfig config;
+    config.seed = 12345;
+    config.activeTargets = 3;
+    config.targetRadius = 0.5f;
+    config.targetLifetime = 2.0f;
+    config.effectLifetime = 0.3f;
+    config.bouncing = 0;
+    config.targetSpeed = 4.0f;
+    config.bounds = CollisionBounds{-8.0f, 8.0f, -4.0f, 4.0f, -20.0f, -10.0f};
+    return config;
+}
+
+void simInit(SimState& sim, const SimConfig& config) {
+    // a fresh entity table, so handles come out the same as in any other
+    // run with this config
+    sim.world.reset();
+    sim.effects.clear();
+    sim.broadphase.clear();
+
+    sim.config = config;
+    sim.tick = 0;
+    sim.aim = SimAim{Handle{}, INFINITY, 0.0f, 0.0f, 0.0f, false};
+    sim.shot = SimShot{};
+    sim.lastYaw = 0.0f;
+    sim.lastPitch = 0.0f;
+    // xorshift gets stuck on 0
+    sim.rng = config.seed ? config.seed : 0x9E3779B9u;
+    sim.hits = 0;
+    sim.misses = 0;
+
+    sim.eventCount = 0;
+}
+
+void simUpdate(SimState& sim, const SimInput& input,
+               FrameArena& frameArena, JobSystem* jobs) {
+    const float dt = SIM_DT;
+
+    // every scratch allocation below is handed back at the end of the tick
+    const std::size_t scratchMark = frameArena.used();
+    sim.eventCount = 0;
+
+    // age out effects and targets
+    sim.effects.forEach([&](Handle h, HitEffect& e) {
+        e.age += dt;
+        if (e.age >= sim.config.effectLifetime)
+            sim.effects.destroy(h);
+    });
+
+    // Moving targets is independent per entity, so each table's rows are
+    // split across the job system.
+    sim.world.query<Position, Velocity, Lifetime>(
+        [&](uint32_t count, const Handle*, Position* p, Velocity* v,
+            Lifetime* life) {
+            auto advance = [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    p[i].x += v[i].x * dt;
+                    p[i].y += v[i].y * dt;
+                    p[i].z += v[i].z * dt;
+                    life[i].age += dt;
+                }
+            };
+            if (jobs)
+                jobs->parallelFor(count, 256, advance);
+            else
+                advance(0, count);
+        });
+
+    if (sim.config.bouncing)
+        collideTargets(sim, frameArena, jobs);
+
+    // Destroying moves rows around, so collect the expired targets first and
+    // remove them after the query. Chunks mark their expired rows in
+    // parallel; the events go out in row order.
+    Handle* expired = tickScratch<Handle>(frameArena, MAX_TARGETS);
+    uint32_t expiredCount = 0;
+    sim.world.query<Position, Lifetime>(
+        [&](uint32_t count, const Handle* handles, Position* p, Lifetime* life) {
+            uint8_t* gone = tickScratch<uint8_t>(frameArena, count);
+            uint32_t* chunkGone = tickScratch<uint32_t>(frameArena, chunkCount(count));
+            if (!expired || !gone || !chunkGone)
+                return;
+            forEachChunk(jobs, count, [&](uint32_t c, uint32_t begin, uint32_t end) {
+                uint32_t n = 0;
+                for (uint32_t row = begin; row < end; row++) {
+                    gone[row] = life[row].age >= life[row].lifetime;
+                    n += gone[row];
+                }
+                chunkGone[c] = n;
+            });
+            for (uint32_t c = 0; c < chunkCount(count); c++) {
+                if (!chunkGone[c])
+                    continue;
+                uint32_t end = std::min(count, (c + 1) * simChunk);
+                for (uint32_t row = c * simChunk; row < end; row++) {
+                    if (!gone[row])
+                        continue;
+                    pushEvent(sim, SimEventType::TargetExpired, handles[row],
+                              p[row].x, p[row].y, p[row].z);
+                    expired[expiredCount++] = handles[row];
+                }
+            }
+        });
+    for (uint32_t i = 0; i < expiredCount; i++)
+        sim.world.destroy(expired[i]);
+
+    // aim direction from the view angles
+    float cp = std::cos(input.pitch);
+    float dx = cp * std::sin(input.yaw);
+    float dy = std::sin(input.pitch);
+    float dz = -cp * std::cos(input.yaw);
+
+    // Find the target nearest the crosshair by angle. Comparing cosines
+    // avoids an acos per target; only the winner needs real angles. Each
+    // chunk finds its own nearest, and they're combined in order.
+    const NearestTarget none = {Handle{}, -2.0f, 1.0f, 0.0f, {0.0f, 0.0f, 0.0f}};
+    sim.aim = SimAim{Handle{}, INFINITY, 0.0f, 0.0f, 0.0f, false};
+    NearestTarget aimed = none;
+    std::atomic<uint32_t> overTarget{0};
+    sim.world.query<Position, TargetBody>(
+        [&](uint32_t count, const Handle* handles, Position* position, TargetBody* body) {
+            NearestTarget* chunks = tickScratch<NearestTarget>(frameArena, chunkCount(count));
+            if (!chunks)
+                return;
+            forEachChunk(jobs, count, [&](uint32_t c, uint32_t begin, uint32_t end) {
+                NearestTarget nearest = none;
+                bool over = false;
+                for (uint32_t row = begin; row < end; row++) {
+                    const Position& p = position[row];
+                    float radius = body[row].radius;
+                    float dist = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+                    if (dist <= radius)
+                        continue;
+                    float cosine = (p.x * dx + p.y * dy + p.z * dz) / dist;
+                    // sin^2 of the angular radius; the crosshair is on the
+                    // target when the angle to its centre is within it
+                    float sin2 = (radius * radius) / (dist * dist);
+                    if (cosine > 0.0f && 1.0f - cosine * cosine <= sin2)
+                        over = true;
+                    takeNearer(nearest, NearestTarget{handles[row], cosine, dist, radius, p});
+                }
+                chunks[c] = nearest;
+                if (over)
+                    overTarget.fetch_add(1, std::memory_order_relaxed);
+            });
+            for (uint32_t c = 0; c < chunkCount(count); c++)
+                takeNearer(aimed, chunks[c]);
+        });
+    sim.aim.target = aimed.target;
+    sim.aim.onTarget = overTarget.load() > 0;
+    if (sim.sweptAim && !sim.aim.onTarget && sim.tick > 0)
+        sim.aim.onTarget = sweptOverTarget(sim, input, frameArena, jobs);
+    sim.lastYaw = input.yaw;
+    sim.lastPitch = input.pitch;
+
+    if (sim.aim.target.valid()) {
+        sim.aim.error = std::acos(std::fmin(1.0f, std::fmax(-1.0f, aimed.cos)));
+        sim.aim.targetAngularRadius = std::asin(aimed.radius / aimed.distance);
+        const Position& p = aimed.position;
+        sim.aim.targetYaw = std::atan2(p.x, -p.z);
+        sim.aim.targetPitch = std::atan2(p.y, std::sqrt(p.x * p.x + p.z * p.z));
+    }
+
+    sim.shot = SimShot{};
+    if (input.fire) {
+        // ray/sphere test against every target, keeping the nearest hit. The
+        // ray starts at the origin so the closest approach is just the
+        // projection of the centre onto the direction. Both the ray and the
+        // targets are taken as of the moment the button went down. The
+        // target nearest the ray by angle is kept too, to report a miss
+        // against.
+        float fcp = std::cos(input.firePitch);
+        float fx = fcp * std::sin(input.fireYaw);
+        float fy = std::sin(input.firePitch);
+        float fz = -fcp * std::cos(input.fireYaw);
+        float ticksAgo = std::fmin(std::fmax(input.fireAge / dt, 0.0f),
+                                   static_cast<float>(TARGET_HISTORY_TICKS - 1));
+
+        // Per chunk: the nearest hit along the ray (distance in `distance`)
+        // and the nearest target by angle; combined in order like the aim.
+        struct ShotChunk {
+            NearestTarget hit;
+            NearestTarget nearest;
+        };
+        NearestTarget hit = none;
+        hit.distance = INFINITY;
+        NearestTarget nearest = none;
+        sim.world.query<Position, TargetBody, PositionHistory>(
+            [&](uint32_t count, const Handle* handles, Position* current, TargetBody* body,
+                PositionHistory* history) {
+                ShotChunk* chunks = tickScratch<ShotChunk>(frameArena, chunkCount(count));
+                if (!chunks)
+                    return;
+                forEachChunk(jobs, count, [&](uint32_t c, uint32_t begin, uint32_t end) {
+                    ShotChunk chunk = {none, none};
+                    chunk.hit.distance = INFINITY;
+                    for (uint32_t row = begin; row < end; row++) {
+                        Position p;
+                        if (!positionAt(history[row], current[row], sim.tick, ticksAgo, p))
+                            continue;
+                        float radius = body[row].radius;
+                        float along = p.x * fx + p.y * fy + p.z * fz;
+                        float length2 = p.x * p.x + p.y * p.y + p.z * p.z;
+                        if (length2 > 0.0f) {
+                            float cosine = along / std::sqrt(length2);
+                            takeNearer(chunk.nearest,
+                                       NearestTarget{handles[row], cosine, 0.0f, radius, p});
+                        }
+                        if (along <= 0.0f)
+                            continue;
+                        float dist2 = length2 - along * along;
+                        if (dist2 <= radius * radius && along < chunk.hit.distance)
+                            chunk.hit = NearestTarget{handles[row], 0.0f, along, radius, p};
+                    }
+                    chunks[c] = chunk;
+                });
+                for (uint32_t c = 0; c < chunkCount(count); c++) {
+                    if (chunks[c].hit.distance < hit.distance)
+                        hit = chunks[c].hit;
+                    takeNearer(nearest, chunks[c].nearest);
+                }
+            });
+        Handle best = hit.target;
+
+        sim.shot.fired = true;
+        sim.shot.hit = best.valid();
+        sim.shot.yaw = input.fireYaw;
+        sim.shot.pitch = input.firePitch;
+        const NearestTarget& judged = best.valid() ? hit : nearest;
+        sim.shot.target = judged.target;
+        sim.shot.targetPosition = judged.position;
+        sim.shot.targetRadius = judged.radius;
+
+        if (Position* p = sim.world.get<Position>(best)) {
+            sim.hits++;
+            pushEvent(sim, SimEventType::TargetHit, best, p->x, p->y, p->z);
+            sim.effects.create(HitEffect{p->x, p->y, p->z, 0.0f});
+            sim.world.destroy(best);
+        } else {
+            sim.misses++;
+            pushEvent(sim, SimEventType::ShotMissed, Handle{},
+                      fx * 100.0f, fy * 100.0f, fz * 100.0f);
+        }
+    }
+
+    // keep the scenario topped up
+    uint32_t targetCount = sim.world.count<TargetBody>();
+    while (targetCount < sim.config.activeTargets && sim.world.size() < sim.world.capacity()) {
+        spawnTarget(sim);
+        targetCount++;
+    }
+
+    // remember where every target ended this tick
+    const uint32_t slot = sim.tick % TARGET_HISTORY_TICKS;
+    sim.world.query<Position, PositionHistory>(
+        [&](uint32_t count, const Handle*, Position* p, PositionHistory* history) {
+            forEachChunk(jobs, count, [&](uint32_t, uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++)
+                    history[i].positions[slot] = p[i];
+            });
+        });
+
+    sim.tick++;
+    frameArena.rewind(scratchMark);
+}
+
+/// ~~~ Snapshots ~~~
+
+namespace {
+const uint32_t snapshotMagic = 0x50414E53; // "SNAP"
+// 2: targets carry a PositionHistory
+// 3: last tick's view angles
+// 4: fixed component ids
+const uint32_t snapshotVersion = 4;
+}
+
+void simSaveSnapshot(const SimState& sim, ByteWriter& out) {
+    out.put(snapshotMagic);
+    out.put(snapshotVersion);
+    out.put(sim.config);
+    out.put(sim.tick);
+    out.put(sim.rng);
+    out.put(sim.hits);
+    out.put(sim.misses);
+    out.put(sim.lastYaw);
+    out.put(sim.lastPitch);
+
+    sim.world.save(out);
+    sim.broadphase.save(out);
+
+    // Effects are cosmetic, so only their contents are kept; their handles
+    // never feed back into the simulation.
+    out.put(sim.effects.size());
+    sim.effects.forEach([&](Handle, const HitEffect& e) { out.put(e); });
+}
+
+bool simLoadSnapshot(SimState& sim, ByteReader& in) {
+    if (in.get<uint32_t>() != snapshotMagic || in.get<uint32_t>() != snapshotVersion)
+        return false;
+
+    sim.config = in.get<SimConfig>();
+    sim.tick = in.get<uint32_t>();
+    sim.rng = in.get<uint32_t>();
+    sim.hits = in.get<uint32_t>();
+    sim.misses = in.get<uint32_t>();
+    sim.lastYaw = in.get<float>();
+    sim.lastPitch = in.get<float>();
+
+    if (!sim.world.load(in) || !sim.broadphase.load(in))
+        return false;
+
+    sim.effects.clear();
+    uint32_t effectCount = in.get<uint32_t>();
+    for (uint32_t i = 0; i < effectCount && !in.failed; i++)
+        sim.effects.create(in.get<HitEffect>());
+
+    sim.eventCount = 0;
+    return !in.failed;
+}
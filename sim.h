@@ -0,0 +1,200 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "arena.h"
+#include "bytes.h"
+#include "collision.h"
+#include "jobs.h"
+#include "pool.h"
+#include "world.h"
+
+#include <cstdint>
+
+// The simulation is everything that decides what happens in a round:
+// spawning targets, aging them out, and judging shots. It knows nothing about
+// windows or OpenGL, so main() just feeds it input once per tick.
+//
+// It is also deterministic: it always advances by exactly SIM_DT, all
+// randomness comes from the seeded generator in SimState, and the job
+// system only ever splits work whose result doesn't depend on the split. The
+// same config plus the same per-tick inputs always gives the same session,
+// which is what lets replay.cpp re-run recorded sessions without a window.
+//
+// Coordinates: the player sits at the origin looking down -Z. Targets spawn on
+// a wall in front of the player.
+
+constexpr uint32_t MAX_TARGETS = 8192;
+constexpr uint32_t MAX_EFFECTS = 4096;
+constexpr uint32_t MAX_EVENTS_PER_FRAME = 1024;
+
+constexpr uint32_t SIM_TICK_RATE = 240;
+constexpr float SIM_DT = 1.0f / SIM_TICK_RATE;
+
+// Ticks of target positions kept for judging shots at the moment they were
+// fired (see SimInput::fireAge). Must be a power of two.
+constexpr uint32_t TARGET_HISTORY_TICKS = 8;
+
+// Target components. A target is an entity in SimState::world with all five
+// of these; systems query the columns they need. Their ids are part of the
+// snapshot format (see WORLD_COMPONENT).
+struct Position {
+    float x, y, z;
+};
+WORLD_COMPONENT(Position, 0);
+
+struct Velocity {
+    float x, y, z;
+};
+WORLD_COMPONENT(Velocity, 1);
+
+struct TargetBody {
+    float radius;
+};
+WORLD_COMPONENT(TargetBody, 2);
+
+struct Lifetime {
+    float age;
+    float lifetime;
+};
+WORLD_COMPONENT(Lifetime, 3);
+
+// Where the target was at the end of each of the last TARGET_HISTORY_TICKS
+// ticks, in slot tick % TARGET_HISTORY_TICKS. Kept with the other columns so
+// writing it each tick is one more store per target, and looking it up for
+// a shot needs no search.
+struct PositionHistory {
+    Position positions[TARGET_HISTORY_TICKS];
+    // tick the target spawned on; slots for earlier ticks hold nothing
+    uint32_t firstTick;
+};
+WORLD_COMPONENT(PositionHistory, 4);
+
+// Short-lived visual feedback left behind when a target is hit.
+struct HitEffect {
+    float x, y, z;
+    float age;
+};
+
+enum class SimEventType : uint8_t {
+    TargetSpawned,
+    TargetHit,
+    TargetExpired,
+    ShotMissed
+};
+
+// Transient events produced during one update. They are only valid until
+// the next update.
+struct SimEvent {
+    SimEventType type;
+    Handle target;
+    float x, y, z;
+};
+
+struct SimInput {
+    // view angles in radians; yaw turns right, pitch looks up
+    float yaw;
+    float pitch;
+    // true on the tick the fire button went down
+    bool fire;
+    // When fire is set: how long before the end of this tick the button went
+    // down, in seconds, and where the view pointed at that moment. The shot
+    // is judged against where the targets were then, interpolated between
+    // ticks, so a flick isn't judged against positions from after it
+    // landed. Ages past the kept history are clamped to it.
+    float fireAge;
+    float fireYaw;
+    float firePitch;
+};
+
+// Where the crosshair is relative to the targets, worked out every tick for
+// stats and the HUD. Angles are in radians.
+struct SimAim {
+    // target whose centre is closest to the crosshair, if any
+    Handle target;
+    // angle between the crosshair and that target's centre
+    float error;
+    // angular radius of that target as seen from the player
+    float targetAngularRadius;
+    // view angles that would put the crosshair on that target's centre
+    float targetYaw, targetPitch;
+    // the crosshair is over some target, or with SimState::sweptAim set,
+    // passed over one at some point during the tick
+    bool onTarget;
+};
+
+// How the shot fired this tick was judged, for stats and replays. It is the
+// fire angles and the target positions as of when the button went down, not
+// the end of the tick that SimAim describes.
+struct SimShot {
+    // a shot was fired this tick; nothing else is set otherwise
+    bool fired;
+    bool hit;
+    float yaw, pitch;
+    // the target the shot hit, or on a miss the one whose centre it passed
+    // closest to by angle; invalid if there were no targets to shoot at
+    Handle target;
+    // where that target was when the button went down, interpolated
+    // between ticks, and its radius
+    Position targetPosition;
+    float targetRadius;
+};
+
+// Everything that decides how a session plays out besides the input. It's
+// stored in the session log header, so it must stay plain data.
+struct SimConfig {
+    uint32_t seed;
+    uint32_t activeTargets;
+    float targetRadius;
+    float targetLifetime;
+    float effectLifetime;
+    // moving targets that bounce off each other and the arena walls
+    uint32_t bouncing;
+    float targetSpeed;
+    CollisionBounds bounds;
+};
+
+SimConfig defaultSimConfig();
+
+struct SimState {
+    World world{MAX_TARGETS};
+    Pool<HitEffect, MAX_EFFECTS> effects;
+
+    // sort-and-sweep state, kept between frames so re-sorting stays cheap
+    SweepAndPrune broadphase{MAX_TARGETS};
+
+    SimConfig config;
+
+    uint32_t tick;
+    uint32_t rng;
+    SimAim aim;
+    SimShot shot;
+    // view angles of the previous tick's input, for the swept aim test
+    float lastYaw, lastPitch;
+    // Test the crosshair's whole path over each tick against the targets'
+    // motion instead of only its position at the end, so fast flicks and
+    // fast targets that cross between ticks still count as on target. Only
+    // changes aim, never how shots are judged, so it can be switched freely
+    // without affecting replays. Not reset by simInit().
+    bool sweptAim = false;
+    uint32_t hits;
+    uint32_t misses;
+
+    SimEvent events[MAX_EVENTS_PER_FRAME];
+    uint32_t eventCount;
+};
+
+void simInit(SimState& sim, const SimConfig& config);
+// Advance one tick of SIM_DT. jobs may be null, in which case everything runs
+// on the calling thread. Scratch comes from frameArena and is handed back
+// before returning, so any number of ticks can run between resets. Running
+// out of it is a bug (the tick would play out differently), and asserts.
+void simUpdate(SimState& sim, const SimInput& input,
+               FrameArena& frameArena, JobSystem* jobs);
+
+// Snapshot the full sim state into out, so that loading it and simulating
+// forward gives exactly the same results as the original run. Writing never
+// allocates; check out.overflow afterwards. Transient events are not saved.
+void simSaveSnapshot(const SimState& sim, ByteWriter& out);
+bool simLoadSnapshot(SimState& sim, ByteReader& in);
+
+#endif
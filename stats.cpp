@@ -0,0 +1,347 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Angular speed of the view, in radians per second, below which the player
+// counts as holding still and above which they have started to react.
+const float restSpeed = 0.25f;
+const float reactSpeed = 1.5f;
+// Nobody takes this long to react; the player just wasn't playing.
+const float reactionTimeout = 1.5f;
+
+} // namespace
+
+/// ~~~ QuantileSketch ~~~
+
+QuantileSketch::QuantileSketch() {
+    clear();
+}
+
+void QuantileSketch::clear() {
+    for (uint32_t i = 0; i < levels; i++)
+        sizes[i] = 0;
+    promoteOdd = 0;
+    total = 0;
+    sum = 0.0;
+    lowest = 0.0f;
+    highest = 0.0f;
+    rankedCount = 0;
+    dirty = false;
+}
+
+void QuantileSketch::add(float value) {
+    if (total == 0) {
+        lowest = value;
+        highest = value;
+    }
+    lowest = std::min(lowest, value);
+    highest = std::max(highest, value);
+    total++;
+    sum += value;
+    dirty = true;
+
+    items[0][sizes[0]++] = value;
+    if (sizes[0] == levelSize)
+        compact(0);
+}
+
+void QuantileSketch::compact(uint32_t level) {
+    float* in = items[level];
+    std::sort(in, in + levelSize);
+
+    uint32_t start = (promoteOdd >> level) & 1;
+    promoteOdd ^= 1u << level;
+
+    if (level + 1 == levels) {
+        // Nowhere left to promote to, so keep half in place. The samples kept
+        // now stand for more than their weight says; with a billion samples
+        // behind them that no longer matters.
+        uint32_t n = 0;
+        for (uint32_t i = start; i < levelSize; i += 2)
+            in[n++] = in[i];
+        sizes[level] = n;
+        return;
+    }
+
+    float* out = items[level + 1];
+    for (uint32_t i = start; i < levelSize; i += 2)
+        out[sizes[level + 1]++] = in[i];
+    sizes[level] = 0;
+
+    if (sizes[level + 1] == levelSize)
+        compact(level + 1);
+}
+
+void QuantileSketch::summarize() const {
+    rankedCount = 0;
+    for (uint32_t level = 0; level < levels; level++) {
+        for (uint32_t i = 0; i < sizes[level]; i++)
+            ranked[rankedCount++] = RankedSample{items[level][i], 1ull << level};
+    }
+    std::sort(ranked, ranked + rankedCount,
+              [](const RankedSample& a, const RankedSample& b) {
+                  return a.value < b.value;
+              });
+    // turn weights into running totals so quantile() can binary search
+    uint64_t rank = 0;
+    for (uint32_t i = 0; i < rankedCount; i++) {
+        rank += ranked[i].rank;
+        ranked[i].rank = rank;
+    }
+    dirty = false;
+}
+
+float QuantileSketch::quantile(float q) const {
+    if (total == 0)
+        return 0.0f;
+    if (q <= 0.0f)
+        return lowest;
+    if (q >= 1.0f)
+        return highest;
+    if (dirty)
+        summarize();
+
+    // first sample whose running weight reaches q of the total
+    uint64_t weight = ranked[rankedCount - 1].rank;
+    uint64_t target = static_cast<uint64_t>(std::ceil(q * weight));
+    const RankedSample* it = std::lower_bound(
+        ranked, ranked + rankedCount, target,
+        [](const RankedSample& s, uint64_t r) { return s.rank < r; });
+    if (it == ranked + rankedCount)
+        return highest;
+    return it->value;
+}
+
+/// ~~~ SessionStats ~~~
+
+void statsInit(SessionStats& stats) {
+    stats.ticks = 0;
+    stats.onTargetTicks = 0;
+    stats.shots = 0;
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.expired = 0;
+
+    for (uint32_t i = 0; i < MAX_TARGETS; i++) {
+        stats.spawnTick[i] = 0;
+        stats.spawnGeneration[i] = 0xFFFFFFFFu;
+    }
+    stats.timeToKill.clear();
+
+    stats.reactionTime.clear();
+    stats.awaitingReaction = false;
+    stats.reactionStartTick = 0;
+    stats.lastYaw = 0.0f;
+    stats.lastPitch = 0.0f;
+
+    stats.overshoots = 0;
+    stats.overshootSum = 0.0f;
+    stats.overshootMax = 0.0f;
+    stats.overshootPhase = OvershootPhase::Approaching;
+    stats.overshootTarget = Handle{};
+    stats.overshootPeak = 0.0f;
+    stats.haveLastOffset = false;
+    stats.lastOffsetX = 0.0f;
+    stats.lastOffsetY = 0.0f;
+    stats.approachX = 0.0f;
+    stats.approachY = 0.0f;
+}
+
+namespace {
+
+void countEvents(SessionStats& stats, const SimState& sim, uint32_t tick,
+                 bool stillAim) {
+    for (uint32_t i = 0; i < sim.eventCount; i++) {
+        const SimEvent& e = sim.events[i];
+        uint32_t slot = e.target.index;
+        switch (e.type) {
+        case SimEventType::TargetSpawned:
+            if (slot < MAX_TARGETS) {
+                stats.spawnTick[slot] = tick;
+                stats.spawnGeneration[slot] = e.target.generation;
+            }
+            // A reaction can only be timed from a standing start; if the aim
+            // is already moving we can't tell reacting from carrying on.
+            if (stillAim && !stats.awaitingReaction) {
+                stats.awaitingReaction = true;
+                stats.reactionStartTick = tick;
+            }
+            break;
+        case SimEventType::TargetHit:
+            stats.shots++;
+            stats.hits++;
+            if (slot < MAX_TARGETS &&
+                stats.spawnGeneration[slot] == e.target.generation) {
+                stats.timeToKill.add((tick - stats.spawnTick[slot]) * SIM_DT);
+                stats.spawnGeneration[slot] = 0xFFFFFFFFu;
+            }
+            break;
+        case SimEventType::ShotMissed:
+            stats.shots++;
+            stats.misses++;
+            break;
+        case SimEventType::TargetExpired:
+            stats.expired++;
+            if (slot < MAX_TARGETS)
+                stats.spawnGeneration[slot] = 0xFFFFFFFFu;
+            break;
+        }
+    }
+}
+
+// Crosshair offset from the aim target in radians, flattened onto the view:
+// a yaw difference covers less of the screen the further up or down we look.
+void aimOffset(const SimAim& aim, const SimInput& input, float& x, float& y) {
+    float yaw = std::remainder(input.yaw - aim.targetYaw, 6.2831853f);
+    x = yaw * std::cos(aim.targetPitch);
+    y = input.pitch - aim.targetPitch;
+}
+
+// Closest the crosshair came to the target centre moving in a straight line
+// from offset (ax, ay) to offset (bx, by).
+float closestApproach(float ax, float ay, float bx, float by) {
+    float mx = bx - ax, my = by - ay;
+    float lengthSq = mx * mx + my * my;
+    float t = lengthSq > 0.0f ? -(ax * mx + ay * my) / lengthSq : 0.0f;
+    t = std::min(1.0f, std::max(0.0f, t));
+    return std::hypot(ax + t * mx, ay + t * my);
+}
+
+void recordOvershoot(SessionStats& stats) {
+    stats.overshoots++;
+    stats.overshootSum += stats.overshootPeak;
+    stats.overshootMax = std::max(stats.overshootMax, stats.overshootPeak);
+}
+
+// An overshoot is the crosshair getting onto a target (or flicking right over
+// it between two ticks), leaving it on the far side, and then turning back.
+// Its size is how far past the edge it got. Backing out the way it came in
+// doesn't count.
+void trackOvershoot(SessionStats& stats, const SimAim& aim,
+                    const SimInput& input) {
+    if (aim.target != stats.overshootTarget) {
+        stats.overshootTarget = aim.target;
+        stats.overshootPhase = OvershootPhase::Approaching;
+        stats.haveLastOffset = false;
+    }
+    if (!aim.target.valid())
+        return;
+
+    float x, y;
+    aimOffset(aim, input, x, y);
+    float distance = std::hypot(x, y);
+    float radius = aim.targetAngularRadius;
+    bool inside = distance <= radius;
+    float px = stats.lastOffsetX, py = stats.lastOffsetY;
+    stats.lastOffsetX = x;
+    stats.lastOffsetY = y;
+    if (!stats.haveLastOffset) {
+        stats.haveLastOffset = true;
+        stats.overshootPhase = inside ? OvershootPhase::OnTarget
+                                      : OvershootPhase::Approaching;
+        stats.approachX = x;
+        stats.approachY = y;
+        return;
+    }
+
+    switch (stats.overshootPhase) {
+    case OvershootPhase::Approaching:
+        stats.approachX = px;
+        stats.approachY = py;
+        if (inside) {
+            stats.overshootPhase = OvershootPhase::OnTarget;
+        } else if (px * x + py * y < 0.0f &&
+                   closestApproach(px, py, x, y) <= radius) {
+            stats.overshootPhase = OvershootPhase::Past;
+            stats.overshootPeak = distance - radius;
+        }
+        break;
+    case OvershootPhase::OnTarget:
+        if (!inside) {
+            bool farSide = x * stats.approachX + y * stats.approachY < 0.0f;
+            stats.overshootPhase = farSide ? OvershootPhase::Past
+                                           : OvershootPhase::Approaching;
+            stats.overshootPeak = distance - radius;
+        }
+        break;
+    case OvershootPhase::Past:
+        if (inside || distance < std::hypot(px, py)) {
+            // turned back: the overshoot is over
+            recordOvershoot(stats);
+            stats.approachX = px;
+            stats.approachY = py;
+            stats.overshootPhase = inside ? OvershootPhase::OnTarget
+                                          : OvershootPhase::Approaching;
+        } else {
+            stats.overshootPeak = std::max(stats.overshootPeak, distance - radius);
+        }
+        break;
+    }
+}
+
+} // namespace
+
+void statsUpdate(SessionStats& stats, const SimState& sim,
+                 const SimInput& input, uint32_t tick) {
+    float dyaw = input.yaw - stats.lastYaw;
+    float dpitch = input.pitch - stats.lastPitch;
+    float speed = std::sqrt(dyaw * dyaw + dpitch * dpitch) / SIM_DT;
+    stats.lastYaw = input.yaw;
+    stats.lastPitch = input.pitch;
+
+    if (stats.awaitingReaction) {
+        float elapsed = (tick - stats.reactionStartTick) * SIM_DT;
+        if (speed >= reactSpeed) {
+            stats.reactionTime.add(elapsed);
+            stats.awaitingReaction = false;
+        } else if (elapsed > reactionTimeout) {
+            stats.awaitingReaction = false;
+        }
+    }
+
+    // the first tick has no previous view angles to measure speed against
+    countEvents(stats, sim, tick, stats.ticks > 0 && speed < restSpeed);
+
+    stats.ticks++;
+    if (sim.aim.onTarget)
+        stats.onTargetTicks++;
+    trackOvershoot(stats, sim.aim, input);
+}
+
+float statsAccuracy(const SessionStats& stats) {
+    return stats.shots ? static_cast<float>(stats.hits) / stats.shots : 0.0f;
+}
+
+float statsOnTargetFraction(const SessionStats& stats) {
+    return stats.ticks ? static_cast<float>(stats.onTargetTicks) / stats.ticks
+                       : 0.0f;
+}
+
+float statsMeanOvershoot(const SessionStats& stats) {
+    return stats.overshoots ? stats.overshootSum / stats.overshoots : 0.0f;
+}
+
+void statsPrint(const SessionStats& stats) {
+    const float toMs = 1000.0f;
+    const float toDegrees = 57.2957795f;
+    std::cout << "shots " << stats.shots << ", hits " << stats.hits
+              << ", misses " << stats.misses << ", expired " << stats.expired
+              << ", accuracy " << statsAccuracy(stats) * 100.0f << "%\n";
+    std::cout << "on target " << statsOnTargetFraction(stats) * 100.0f
+              << "% of " << stats.ticks << " ticks\n";
+    std::cout << "time to kill (ms): mean "
+              << stats.timeToKill.mean() * toMs << ", p50 "
+              << stats.timeToKill.quantile(0.5f) * toMs << ", p90 "
+              << stats.timeToKill.quantile(0.9f) * toMs << "\n";
+    std::cout << "reaction time (ms): " << stats.reactionTime.count()
+              << " samples, p10 " << stats.reactionTime.quantile(0.1f) * toMs
+              << ", p50 " << stats.reactionTime.quantile(0.5f) * toMs
+              << ", p90 " << stats.reactionTime.quantile(0.9f) * toMs << "\n";
+    std::cout << "overshoots: " << stats.overshoots << ", mean "
+              << statsMeanOvershoot(stats) * toDegrees << " deg, max "
+              << stats.overshootMax * toDegrees << " deg" << std::endl;
+}
@@ -0,0 +1,123 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "sim.h"
+
+#include <cstdint>
+
+// Per-session scoring. Everything here updates online from what one sim tick
+// produced, in constant time per event, and keeps only fixed-size state, so
+// the HUD can read any number every frame without looking back through the
+// session.
+
+// Streaming quantile estimate in fixed memory (a KLL-style compactor stack).
+// Samples go into level 0. When a level fills up we sort it and promote every
+// other sample to the level above, where each one stands for twice as many
+// samples. Which half gets promoted alternates, so the estimate stays
+// unbiased without needing a random number generator, and the same samples
+// always give the same answers.
+//
+// Error is about 1% of rank with the sizes below, and the sketch can take
+// levelSize * 2^(levels - 1) samples (about a billion) before the top level
+// starts throwing samples away.
+class QuantileSketch {
+public:
+    static constexpr uint32_t levels = 24;
+    static constexpr uint32_t levelSize = 128;
+
+    QuantileSketch();
+
+    void clear();
+    void add(float value);
+
+    // q in [0, 1]. Returns 0 when there are no samples. The sorted summary is
+    // cached until the next add(), so calling this every frame is cheap.
+    float quantile(float q) const;
+
+    uint64_t count() const { return total; }
+    float min() const { return lowest; }
+    float max() const { return highest; }
+    float mean() const { return total ? static_cast<float>(sum / total) : 0.0f; }
+
+private:
+    void compact(uint32_t level);
+    void summarize() const;
+
+    float items[levels][levelSize];
+    uint32_t sizes[levels];
+    uint32_t promoteOdd;  // one bit per level
+    uint64_t total;
+    double sum;
+    float lowest, highest;
+
+    // Every retained sample with its running total of weight, sorted by
+    // value; quantile() binary searches this.
+    struct RankedSample {
+        float value;
+        uint64_t rank;
+    };
+    mutable RankedSample ranked[levels * levelSize];
+    mutable uint32_t rankedCount;
+    mutable bool dirty;
+};
+
+// Where we are in judging one overshoot: the crosshair has to get onto a
+// target, leave it, and then turn back towards it.
+enum class OvershootPhase : uint8_t {
+    Approaching,
+    OnTarget,
+    Past
+};
+
+struct SessionStats {
+    uint32_t ticks;
+    // ticks the crosshair spent over a target: sampled once per input tick,
+    // or over the whole tick with SimState::sweptAim
+    uint32_t onTargetTicks;
+
+    uint32_t shots;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t expired;
+
+    // Seconds from a target spawning to it being shot. We remember the spawn
+    // tick by entity slot; the generation tells a recycled slot apart.
+    uint32_t spawnTick[MAX_TARGETS];
+    uint32_t spawnGeneration[MAX_TARGETS];
+    QuantileSketch timeToKill;
+
+    // Seconds from a target appearing while the aim was still to the aim
+    // starting to move.
+    QuantileSketch reactionTime;
+    bool awaitingReaction;
+    uint32_t reactionStartTick;
+    float lastYaw, lastPitch;
+
+    // Radians by which the crosshair ran past a target before coming back.
+    uint32_t overshoots;
+    float overshootSum;
+    float overshootMax;
+    OvershootPhase overshootPhase;
+    Handle overshootTarget;
+    float overshootPeak;
+    // crosshair offset from the target last tick, and the side it came in
+    // from
+    bool haveLastOffset;
+    float lastOffsetX, lastOffsetY;
+    float approachX, approachY;
+};
+
+void statsInit(SessionStats& stats);
+// Fold in one tick. Call right after simUpdate() with the tick number the
+// update ran and the input it was given.
+void statsUpdate(SessionStats& stats, const SimState& sim,
+                 const SimInput& input, uint32_t tick);
+
+// HUD readouts; all O(1) (quantiles are cached between samples).
+float statsAccuracy(const SessionStats& stats);
+float statsOnTargetFraction(const SessionStats& stats);
+float statsMeanOvershoot(const SessionStats& stats);
+
+void statsPrint(const SessionStats& stats);
+
+#endif
@@ -0,0 +1,169 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SWEEP_SSE 1
+#endif
+
+namespace {
+
+// Targets closer to the tangent plane than this (or behind it) can't be
+// projected and are never counted as crossed.
+const float minDepth = 1e-3f;
+
+void viewDirection(float yaw, float pitch, float out[3]) {
+    float cp = std::cos(pitch);
+    out[0] = cp * std::sin(yaw);
+    out[1] = std::sin(pitch);
+    out[2] = -cp * std::cos(yaw);
+}
+
+// One target, same maths as the SIMD loop below.
+bool sweepOne(const CrosshairSweep& s, float x0, float y0, float z0,
+              float x1, float y1, float z1, float r) {
+    const float* R = s.right;
+    const float* U = s.up;
+    const float* F = s.forward;
+    float f0 = x0 * F[0] + y0 * F[1] + z0 * F[2];
+    float f1 = x1 * F[0] + y1 * F[1] + z1 * F[2];
+    float len0 = x0 * x0 + y0 * y0 + z0 * z0;
+    float len1 = x1 * x1 + y1 * y1 + z1 * z1;
+    float r2 = r * r;
+    if (f0 <= minDepth || f1 <= minDepth || len0 <= r2 || len1 <= r2)
+        return false;
+
+    float dx0 = (x0 * R[0] + y0 * R[1] + z0 * R[2]) / f0 - s.x0;
+    float dy0 = (x0 * U[0] + y0 * U[1] + z0 * U[2]) / f0 - s.y0;
+    float dx1 = (x1 * R[0] + y1 * R[1] + z1 * R[2]) / f1 - s.x1;
+    float dy1 = (x1 * U[0] + y1 * U[1] + z1 * U[2]) / f1 - s.y1;
+
+    // Image radius: tan of the angular radius, stretched by 1 / cos^2 of
+    // the angle off the plane's centre (the radial stretch, the larger one).
+    float rho0 = r * len0 / (f0 * f0 * std::sqrt(len0 - r2));
+    float rho1 = r * len1 / (f1 * f1 * std::sqrt(len1 - r2));
+    float rho = std::max(rho0, rho1);
+
+    float ex = dx1 - dx0, ey = dy1 - dy0;
+    float ee = std::max(ex * ex + ey * ey, 1e-30f);
+    float t = std::min(std::max(-(dx0 * ex + dy0 * ey) / ee, 0.0f), 1.0f);
+    float cx = dx0 + ex * t, cy = dy0 + ey * t;
+    return cx * cx + cy * cy <= rho * rho;
+}
+
+#ifdef SWEEP_SSE
+struct Plane {
+    __m128 v[3];
+};
+
+// p . axis for four points
+inline __m128 dot4(__m128 x, __m128 y, __m128 z, const Plane& axis) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, axis.v[0]), _mm_mul_ps(y, axis.v[1])),
+                      _mm_mul_ps(z, axis.v[2]));
+}
+
+inline Plane splat(const float v[3]) {
+    return Plane{{_mm_set1_ps(v[0]), _mm_set1_ps(v[1]), _mm_set1_ps(v[2])}};
+}
+#endif
+
+}
+
+CrosshairSweep makeCrosshairSweep(float yaw0, float pitch0, float yaw1, float pitch1) {
+    CrosshairSweep s;
+    // centre the plane between the two views so neither end is far off it
+    float yaw = yaw0 + 0.5f * std::remainder(yaw1 - yaw0, 6.2831853f);
+    float pitch = 0.5f * (pitch0 + pitch1);
+    float cy = std::cos(yaw), sy = std::sin(yaw);
+    float cp = std::cos(pitch), sp = std::sin(pitch);
+    s.forward[0] = cp * sy;  s.forward[1] = sp;  s.forward[2] = -cp * cy;
+    s.right[0] = cy;         s.right[1] = 0.0f;  s.right[2] = sy;
+    s.up[0] = -sp * sy;      s.up[1] = cp;       s.up[2] = sp * cy;
+
+    float d[3];
+    viewDirection(yaw0, pitch0, d);
+    float f = d[0] * s.forward[0] + d[1] * s.forward[1] + d[2] * s.forward[2];
+    s.x0 = (d[0] * s.right[0] + d[1] * s.right[1] + d[2] * s.right[2]) / f;
+    s.y0 = (d[0] * s.up[0] + d[1] * s.up[1] + d[2] * s.up[2]) / f;
+    viewDirection(yaw1, pitch1, d);
+    f = d[0] * s.forward[0] + d[1] * s.forward[1] + d[2] * s.forward[2];
+    s.x1 = (d[0] * s.right[0] + d[1] * s.right[1] + d[2] * s.right[2]) / f;
+    s.y1 = (d[0] * s.up[0] + d[1] * s.up[1] + d[2] * s.up[2]) / f;
+    return s;
+}
+
+uint32_t sweepCrosshair(const CrosshairSweep& sweep, const SweepTargets& t,
+                        uint8_t* crossed) {
+    uint32_t hits = 0;
+    uint32_t i = 0;
+#ifdef SWEEP_SSE
+    const Plane R = splat(sweep.right);
+    const Plane U = splat(sweep.up);
+    const Plane F = splat(sweep.forward);
+    const __m128 sx0 = _mm_set1_ps(sweep.x0), sy0 = _mm_set1_ps(sweep.y0);
+    const __m128 sx1 = _mm_set1_ps(sweep.x1), sy1 = _mm_set1_ps(sweep.y1);
+    const __m128 depth = _mm_set1_ps(minDepth);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 tiny = _mm_set1_ps(1e-30f);
+    for (; i + 4 <= t.count; i += 4) {
+        __m128 x0 = _mm_loadu_ps(t.x0 + i), y0 = _mm_loadu_ps(t.y0 + i),
+               z0 = _mm_loadu_ps(t.z0 + i);
+        __m128 x1 = _mm_loadu_ps(t.x1 + i), y1 = _mm_loadu_ps(t.y1 + i),
+               z1 = _mm_loadu_ps(t.z1 + i);
+        __m128 r = _mm_loadu_ps(t.radius + i);
+        __m128 r2 = _mm_mul_ps(r, r);
+
+        __m128 f0 = dot4(x0, y0, z0, F);
+        __m128 f1 = dot4(x1, y1, z1, F);
+        __m128 len0 = dot4(x0, y0, z0, Plane{{x0, y0, z0}});
+        __m128 len1 = dot4(x1, y1, z1, Plane{{x1, y1, z1}});
+        __m128 valid = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(f0, depth), _mm_cmpgt_ps(f1, depth)),
+                                  _mm_and_ps(_mm_cmpgt_ps(len0, r2), _mm_cmpgt_ps(len1, r2)));
+        if (!_mm_movemask_ps(valid)) {
+            if (crossed)
+                crossed[i] = crossed[i + 1] = crossed[i + 2] = crossed[i + 3] = 0;
+            continue;
+        }
+        // keep the invalid lanes' arithmetic finite; they're masked off below
+        f0 = _mm_max_ps(f0, depth);
+        f1 = _mm_max_ps(f1, depth);
+        __m128 s0 = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(len0, r2), tiny));
+        __m128 s1 = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(len1, r2), tiny));
+
+        __m128 dx0 = _mm_sub_ps(_mm_div_ps(dot4(x0, y0, z0, R), f0), sx0);
+        __m128 dy0 = _mm_sub_ps(_mm_div_ps(dot4(x0, y0, z0, U), f0), sy0);
+        __m128 dx1 = _mm_sub_ps(_mm_div_ps(dot4(x1, y1, z1, R), f1), sx1);
+        __m128 dy1 = _mm_sub_ps(_mm_div_ps(dot4(x1, y1, z1, U), f1), sy1);
+
+        __m128 rho0 = _mm_div_ps(_mm_mul_ps(r, len0), _mm_mul_ps(_mm_mul_ps(f0, f0), s0));
+        __m128 rho1 = _mm_div_ps(_mm_mul_ps(r, len1), _mm_mul_ps(_mm_mul_ps(f1, f1), s1));
+        __m128 rho = _mm_max_ps(rho0, rho1);
+
+        __m128 ex = _mm_sub_ps(dx1, dx0), ey = _mm_sub_ps(dy1, dy0);
+        __m128 ee = _mm_max_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), tiny);
+        __m128 de = _mm_add_ps(_mm_mul_ps(dx0, ex), _mm_mul_ps(dy0, ey));
+        __m128 s = _mm_min_ps(_mm_max_ps(_mm_div_ps(_mm_sub_ps(zero, de), ee), zero), one);
+        __m128 cx = _mm_add_ps(dx0, _mm_mul_ps(ex, s));
+        __m128 cy = _mm_add_ps(dy0, _mm_mul_ps(ey, s));
+        __m128 dist2 = _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy));
+        int mask = _mm_movemask_ps(_mm_and_ps(valid, _mm_cmple_ps(dist2, _mm_mul_ps(rho, rho))));
+
+        if (crossed) {
+            for (int lane = 0; lane < 4; lane++)
+                crossed[i + lane] = (mask >> lane) & 1;
+        }
+        hits += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+#endif
+    for (; i < t.count; i++) {
+        bool hit = sweepOne(sweep, t.x0[i], t.y0[i], t.z0[i], t.x1[i], t.y1[i], t.z1[i],
+                            t.radius[i]);
+        if (crossed)
+            crossed[i] = hit;
+        hits += hit;
+    }
+    return hits;
+}
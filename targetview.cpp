@@ -0,0 +1,334 @@
+#include <GL/glew.h>
+
+#include "targetview.h"
+#include "shader.h"
+#include "vertexformat.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// The vertex shader comes in two versions, one per instance format. Each
+// starts with one of these, which read the instance into a sphere (centre
+// and radius) and a colour.
+const char* fullInputSource =
+    "#version 330 core\n"
+    "layout (location = 0) in vec4 aSphere;\n"
+    "layout (location = 1) in vec4 aColor;\n"
+    "vec4 instanceSphere() { return aSphere; }\n"
+    "vec4 instanceColor() { return aColor; }\n";
+
+// See PackedTargetInstance.
+const char* packedInputSource =
+    "#version 330 core\n"
+    "layout (location = 0) in vec3 aCentre;\n"
+    "layout (location = 1) in uint aRadiusState;\n"
+    "uniform vec3 palette[2];\n"
+    "uniform float fadeDepth;\n"
+    "vec4 instanceSphere()\n"
+    "{\n"
+    "    return vec4(aCentre, float(aRadiusState & 0x7FFu) / 256.0);\n"
+    "}\n"
+    "vec4 instanceColor()\n"
+    "{\n"
+    "    float faded = float((aRadiusState >> 11) & 0xFu) / 15.0;\n"
+    "    return vec4(palette[aRadiusState >> 15] * (1.0 - fadeDepth * faded), 1.0);\n"
+    "}\n";
+
+// Everything is in view space, where the eye is at the origin. The quad sits
+// in the plane through the sphere's centre, square to the line of sight, and
+// is as big as the sphere's silhouette cone is wide there; that's the
+// smallest square certain to cover the sphere from this eye.
+const char* targetVertexSource =
+    "uniform mat4 view;\n"
+    "uniform mat4 projection;\n"
+    "out vec3 quadPosition;\n"
+    "flat out vec3 centre;\n"
+    "flat out float radius;\n"
+    "flat out vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 sphere = instanceSphere();\n"
+    "    centre = (view * vec4(sphere.xyz, 1.0)).xyz;\n"
+    "    radius = sphere.w;\n"
+    "    color = instanceColor();\n"
+    "    float d2 = dot(centre, centre);\n"
+    "    vec3 w = centre * inversesqrt(d2);\n"
+    "    vec3 u = normalize(cross(w, abs(w.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));\n"
+    "    vec3 v = cross(u, w);\n"
+    "    float size = radius * sqrt(d2 / max(d2 - radius * radius, 1e-6));\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+    "    quadPosition = centre + (u * corner.x + v * corner.y) * size;\n"
+    "    gl_Position = projection * vec4(quadPosition, 1.0);\n"
+    "}\0";
+
+// The view ray through this pixel against the sphere: |t*dir - centre| = r
+// is a quadratic in t, and the nearer root is the visible surface.
+const char* targetFragmentSource =
+    "#version 330 core\n"
+    "in vec3 quadPosition;\n"
+    "flat in vec3 centre;\n"
+    "flat in float radius;\n"
+    "flat in vec4 color;\n"
+    "out vec4 FragColor;\n"
+    "uniform mat4 projection;\n"
+    "uniform vec3 light;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 dir = normalize(quadPosition);\n"
+    "    float b = dot(dir, centre);\n"
+    "    float h = b * b - dot(centre, centre) + radius * radius;\n"
+    "    if (h < 0.0)\n"
+    "        discard;\n"
+    "    vec3 hit = dir * (b - sqrt(h));\n"
+    "    vec3 normal = (hit - centre) / radius;\n"
+    "    vec4 clip = projection * vec4(hit, 1.0);\n"
+    "    gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;\n"
+    "    float diffuse = max(dot(normal, light), 0.0);\n"
+    "    float rim = pow(1.0 - clamp(dot(normal, -dir), 0.0, 1.0), 3.0);\n"
+    "    vec3 shade = color.rgb * (0.25 + 0.75 * diffuse) + rim * 0.35;\n"
+    "    FragColor = vec4(shade, color.a);\n"
+    "}\0";
+
+// orange, and lighter when aimed at
+const uint8_t targetColor[3] = {255, 128, 51};
+const uint8_t aimedColor[3] = {255, 205, 160};
+
+// targets darken over the last part of their life
+const float fadeStart = 0.75f;
+const float fadeDepth = 0.6f;
+
+// steps of radius and fade in PackedTargetInstance
+const float radiusSteps = 256.0f;
+const uint32_t maxRadiusStep = 0x7FF;
+const float fadeSteps = 15.0f;
+
+// The target shader with the given instance input code. 0 on failure.
+unsigned int linkTargetProgram(const char* inputSource) {
+    const char* vertexSources[2] = {inputSource, targetVertexSource};
+    return buildShaderProgram(vertexSources, 2, targetFragmentSource);
+}
+
+}
+
+TargetInstance makeTargetInstance(float x, float y, float z, float radius, bool aimed,
+                                  float fade) {
+    const uint8_t* base = aimed ? aimedColor : targetColor;
+    TargetInstance t;
+    t.x = x;
+    t.y = y;
+    t.z = z;
+    t.radius = radius;
+    for (int c = 0; c < 3; c++)
+        t.color[c] = static_cast<uint8_t>(base[c] * fade);
+    t.color[3] = 255;
+    return t;
+}
+
+PackedTargetInstance packTargetInstance(float x, float y, float z, float radius, bool aimed,
+                                        float fade) {
+    PackedTargetInstance t;
+    t.x = toHalf(x);
+    t.y = toHalf(y);
+    t.z = toHalf(z);
+    float steps = std::fmin(std::fmax(radius * radiusSteps + 0.5f, 1.0f),
+                            static_cast<float>(maxRadiusStep));
+    float faded = std::fmin(std::fmax((1.0f - fade) / fadeDepth, 0.0f), 1.0f);
+    uint32_t fadeStep = static_cast<uint32_t>(faded * fadeSteps + 0.5f);
+    t.radiusState = static_cast<uint16_t>(static_cast<uint32_t>(steps) | fadeStep << 11 |
+                                          (aimed ? 0x8000u : 0u));
+    return t;
+}
+
+template <>
+struct VertexLayout<TargetInstance> {
+    static constexpr VertexAttrib attribs[] = {
+        // centre and radius
+        VERTEX_ATTRIB(TargetInstance, x, 0, 4, AttribType::Float),
+        VERTEX_ATTRIB(TargetInstance, color, 1, 4, AttribType::UByteNorm),
+    };
+};
+
+template <>
+struct VertexLayout<PackedTargetInstance> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(PackedTargetInstance, x, 0, 3, AttribType::Half),
+        VERTEX_ATTRIB(PackedTargetInstance, radiusState, 1, 1, AttribType::UShort),
+    };
+};
+
+TargetView::TargetView()
+    : full{0, 0, -1, -1, -1}, packed{0, 0, -1, -1, -1}, vbo(0), drawn(nullptr),
+      view{}, projection{}, light{}, instances(0), stats{0, 0} {
+}
+
+TargetView::~TargetView() {
+    Variant* variants[2] = {&full, &packed};
+    for (Variant* v : variants) {
+        if (v->program) {
+            glDeleteProgram(v->program);
+            glDeleteVertexArrays(1, &v->vao);
+        }
+    }
+    if (vbo)
+        glDeleteBuffers(1, &vbo);
+}
+
+bool TargetView::setup() {
+    full.program = linkTargetProgram(fullInputSource);
+    packed.program = linkTargetProgram(packedInputSource);
+    if (!full.program || !packed.program)
+        return false;
+
+    Variant* variants[2] = {&full, &packed};
+    for (Variant* v : variants) {
+        v->viewLocation = glGetUniformLocation(v->program, "view");
+        v->projectionLocation = glGetUniformLocation(v->program, "projection");
+        v->lightLocation = glGetUniformLocation(v->program, "light");
+    }
+    // The packed format's palette never changes.
+    float palette[6];
+    for (int c = 0; c < 3; c++) {
+        palette[c] = targetColor[c] / 255.0f;
+        palette[3 + c] = aimedColor[c] / 255.0f;
+    }
+    glUseProgram(packed.program);
+    glUniform3fv(glGetUniformLocation(packed.program, "palette"), 2, palette);
+    glUniform1f(glGetUniformLocation(packed.program, "fadeDepth"), fadeDepth);
+    glUseProgram(0);
+
+    // Instance data only: the quad's corners come from gl_VertexID. Both
+    // formats share one buffer, sized for the bigger one.
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, MAX_TARGETS * sizeof(TargetInstance), NULL, GL_STREAM_DRAW);
+    glGenVertexArrays(1, &full.vao);
+    glBindVertexArray(full.vao);
+    applyVertexLayout<TargetInstance>(1);
+    glGenVertexArrays(1, &packed.vao);
+    glBindVertexArray(packed.vao);
+    applyVertexLayout<PackedTargetInstance>(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void TargetView::setUniforms(void* context) {
+    const TargetView* self = static_cast<const TargetView*>(context);
+    const Variant* v = self->drawn;
+    glUniformMatrix4fv(v->viewLocation, 1, GL_FALSE, self->view);
+    glUniformMatrix4fv(v->projectionLocation, 1, GL_FALSE, self->projection);
+    glUniform3fv(v->lightLocation, 1, self->light);
+}
+
+void TargetView::record(CommandBuffer& commands, SimState& sim, const Camera& camera,
+                        float drawDistance, bool halfPositions, JobSystem* jobs,
+                        FrameArena& frameArena) {
+    instances = 0;
+    stats = CullStats{0, 0};
+    if (!full.program)
+        return;
+
+    // Gather the targets into arrays the culling kernel can load eight at a
+    // time, working out how each one looks on the way.
+    uint32_t count = sim.world.count<Position, TargetBody, Lifetime>();
+    float* x = frameArena.allocateArray<float>(count);
+    float* y = frameArena.allocateArray<float>(count);
+    float* z = frameArena.allocateArray<float>(count);
+    float* radius = frameArena.allocateArray<float>(count);
+    float* fades = frameArena.allocateArray<float>(count);
+    uint8_t* aimed = frameArena.allocateArray<uint8_t>(count);
+    if (count == 0 || !x || !y || !z || !radius || !fades || !aimed)
+        return;
+
+    uint32_t gathered = 0;
+    sim.world.query<Position, TargetBody, Lifetime>(
+        [&](uint32_t rows, const Handle* handles, Position* p, TargetBody* body,
+            Lifetime* life) {
+            auto gather = [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; i++) {
+                    uint32_t n = gathered + i;
+                    float used = life[i].lifetime > 0.0f
+                        ? life[i].age / life[i].lifetime : 0.0f;
+                    float fade = used > fadeStart
+                        ? 1.0f - fadeDepth * (used - fadeStart) / (1.0f - fadeStart) : 1.0f;
+                    fade = std::fmax(fade, 1.0f - fadeDepth);
+
+                    x[n] = p[i].x;
+                    y[n] = p[i].y;
+                    z[n] = p[i].z;
+                    radius[n] = body[i].radius;
+                    fades[n] = fade;
+                    aimed[n] = sim.aim.onTarget && handles[i] == sim.aim.target;
+                }
+            };
+            if (jobs)
+                jobs->parallelFor(rows, CULL_CHUNK, gather);
+            else
+                gather(0, rows);
+            gathered += rows;
+        });
+
+    // The whole buffer is rewritten every frame, so let the driver hand us
+    // fresh memory instead of waiting for last frame's draw to finish. The
+    // culling jobs write the survivors straight into it, in the smaller
+    // format when half precision will do, and note how far away the nearest
+    // one is for the sort key.
+    drawn = halfPositions ? &packed : &full;
+    size_t stride = halfPositions ? sizeof(PackedTargetInstance) : sizeof(TargetInstance);
+    std::atomic<float> nearest(drawDistance);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    void* out = glMapBufferRange(GL_ARRAY_BUFFER, 0, count * stride,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (out) {
+        TargetInstance* fullOut = static_cast<TargetInstance*>(out);
+        PackedTargetInstance* packedOut = static_cast<PackedTargetInstance*>(out);
+        CullSpheres spheres = {x, y, z, radius, count};
+        stats = cullSpheresParallel(
+            cameraFrustum(camera), drawDistance, spheres, jobs, frameArena,
+            [&](uint32_t offset, const uint32_t* indices, uint32_t visible) {
+                float closest = drawDistance;
+                for (uint32_t j = 0; j < visible; j++) {
+                    uint32_t i = indices[j];
+                    if (halfPositions)
+                        packedOut[offset + j] = packTargetInstance(
+                            x[i], y[i], z[i], radius[i], aimed[i], fades[i]);
+                    else
+                        fullOut[offset + j] = makeTargetInstance(
+                            x[i], y[i], z[i], radius[i], aimed[i], fades[i]);
+                    float depth = x[i] * camera.forward[0] + y[i] * camera.forward[1] +
+                                  z[i] * camera.forward[2] - radius[i];
+                    closest = std::fmin(closest, depth);
+                }
+                float seen = nearest.load(std::memory_order_relaxed);
+                while (closest < seen &&
+                       !nearest.compare_exchange_weak(seen, closest, std::memory_order_relaxed)) {
+                }
+            });
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        instances = stats.visible;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (instances == 0)
+        return;
+
+    // a light from above and behind the player's right shoulder, in view
+    // space
+    const float world[3] = {0.32f, 0.84f, 0.44f};
+    for (int i = 0; i < 3; i++)
+        light[i] = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        light[0] += camera.right[i] * world[i];
+        light[1] += camera.up[i] * world[i];
+        light[2] -= camera.forward[i] * world[i];
+    }
+    std::memcpy(view, camera.view, sizeof(view));
+    std::memcpy(projection, camera.projection, sizeof(projection));
+
+    DrawPacket packet = {drawn->program, drawn->vao, 0, GL_TRIANGLE_STRIP, 0, 4, instances,
+                         0, RENDER_DEPTH_TEST | RENDER_DEPTH_WRITE, &TargetView::setUniforms,
+                         this};
+    commands.add(opaqueKey(drawn->program, drawn->vao, nearest.load()), packet);
+}
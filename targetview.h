@@ -0,0 +1,101 @@
+#ifndef TARGETVIEW_H
+#define TARGETVIEW_H
+
+#include "arena.h"
+#include "camera.h"
+#include "commandbuffer.h"
+#include "cull.h"
+#include "jobs.h"
+#include "sim.h"
+
+#include <cstdint>
+
+// Draws the targets as sphere impostors.
+//
+// Each target is one instance of a four-vertex quad that just covers the
+// sphere on screen. The fragment shader casts the view ray at the sphere
+// analytically, drops the pixels that miss, and writes the real surface
+// depth and normal for the ones that hit. Spheres come out perfectly round
+// at any size, and a thousand targets cost four thousand vertices.
+//
+// Targets outside the view or past the draw distance are culled on the job
+// system first (see cull.h), and only the ones left are written to the
+// instance buffer. All of it goes out as one opaque packet.
+//
+// Instances come in two formats. The packed one is less than half the size,
+// and is used whenever half-float positions are precise enough for the
+// frame (see halfPositionsFit in camera.h).
+
+// One target, as it goes to the vertex shader.
+struct TargetInstance {
+    float x, y, z;
+    float radius;
+    uint8_t color[4];
+};
+
+// The same, packed. The centre is in halves, relative to the arena origin
+// where the player stands. radiusState holds the radius in 1/256ths in its
+// low 11 bits (so up to 8), how far the target has faded in the next 4 (0
+// not at all, 15 fully), and whether it's under the crosshair in the top
+// bit; the shader turns the last two into a colour.
+struct PackedTargetInstance {
+    uint16_t x, y, z;
+    uint16_t radiusState;
+};
+
+// A target in either format. fade runs from 1 (fresh) down to the darkest a
+// target gets.
+TargetInstance makeTargetInstance(float x, float y, float z, float radius, bool aimed,
+                                  float fade);
+PackedTargetInstance packTargetInstance(float x, float y, float z, float radius, bool aimed,
+                                        float fade);
+
+class TargetView {
+public:
+    TargetView();
+    ~TargetView();
+
+    TargetView(const TargetView&) = delete;
+    TargetView& operator=(const TargetView&) = delete;
+
+    // Needs a current GL context.
+    bool setup();
+    // Upload the targets in view and within drawDistance and record the
+    // draw for them. The one under the crosshair is lightened. They go out
+    // packed if halfPositions is set. Scratch space comes from frameArena.
+    void record(CommandBuffer& commands, SimState& sim, const Camera& camera,
+                float drawDistance, bool halfPositions, JobSystem* jobs,
+                FrameArena& frameArena);
+
+    // targets drawn in the last record
+    uint32_t instanceCount() const { return instances; }
+    // targets considered and drawn in the last record
+    CullStats cullStats() const { return stats; }
+
+private:
+    // the program and vertex array for one instance format
+    struct Variant {
+        unsigned int program;
+        unsigned int vao;
+        int viewLocation;
+        int projectionLocation;
+        int lightLocation;
+    };
+
+    static void setUniforms(void* context);
+
+    Variant full;
+    Variant packed;
+    // shared by both formats
+    unsigned int vbo;
+    // the one the last record used
+    const Variant* drawn;
+    // the camera as of the last record, for the packet's uniforms
+    float view[16];
+    float projection[16];
+    float light[3];
+    uint32_t instances;
+    CullStats stats;
+};
+
+#endif
@@ -1,8 +1,24 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "vertexformat.h"
+
 #include <iostream>
 
+// One vertex of the triangle: just a 3D position.
+struct TriangleVertex {
+    float x, y, z;
+};
+
+// Where each field of TriangleVertex goes in the vertex shader; see
+// vertexformat.h. Location 0 is aPos below.
+template <>
+struct VertexLayout<TriangleVertex> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(TriangleVertex, x, 0, 3, AttribType::Float),
+    };
+};
+
 // This will be the source for the vertex shader. For now, it'll just be
 // stored in a C string so we don't have to compile it and OpenGL will just
 // dynamically compile it at runtime
@@ -37,13 +53,13 @@ void renderTriangleSetup() {
     // This is called the "normalized device coordinates" which will be the
     // range of coordinates that can appear on your screen.
     
-    // this float array specifies a total of three vertices with each vertex
+    // this array specifies a total of three vertices with each vertex
     // having a 3D position. It's basically just three sets of coordinates.
     // They are defined using the normalized device coordinates:
-    float vertices[] = {
-        -0.5f, -0.5f, 0.0f,
-         0.5f, -0.5f, 0.0f,
-         0.0f,  0.5f, 0.0f
+    TriangleVertex vertices[] = {
+        {-0.5f, -0.5f, 0.0f},
+        { 0.5f, -0.5f, 0.0f},
+        { 0.0f,  0.5f, 0.0f}
     };
 
     // After creating vertex data, we need to send it as input to the first
@@ -196,8 +212,12 @@ void renderTriangleSetup() {
     //
     // Param 6: This is the offset of where the position data begins in the buffer.
     // since the position data begins at just 0, can just pass it 0.
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    //
+    // Rather than writing those out by hand, applyVertexLayout makes the call
+    // for every attribute in TriangleVertex's layout (at the top of this file),
+    // taking the size, type, stride and offset from the struct itself, and the
+    // layout is checked against the struct when it compiles. The call is
+    // recorded in whichever VAO is bound, so it's made once that exists, below.
 
     //finally, generate a VAO
     glGenVertexArrays(1, &VAO);
@@ -206,8 +226,7 @@ void renderTriangleSetup() {
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    applyVertexLayout<TriangleVertex>();
 
     // note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
     glBindBuffer(GL_ARRAY_BUFFER, 0); 
@@ -0,0 +1,117 @@
+#include <GL/glew.h>
+
+#include "vertexformat.h"
+
+#include <cmath>
+#include <cstring>
+
+void applyVertexAttribs(const VertexAttrib* attribs, uint32_t count, uint32_t stride,
+                        uint32_t divisor) {
+    for (uint32_t i = 0; i < count; i++) {
+        const VertexAttrib& a = attribs[i];
+        const void* offset = reinterpret_cast<const void*>(static_cast<uintptr_t>(a.offset));
+        switch (a.type) {
+        case AttribType::Float:
+            glVertexAttribPointer(a.location, a.components, GL_FLOAT, GL_FALSE, stride, offset);
+            break;
+        case AttribType::Half:
+            glVertexAttribPointer(a.location, a.components, GL_HALF_FLOAT, GL_FALSE, stride,
+                                  offset);
+            break;
+        case AttribType::UByteNorm:
+            glVertexAttribPointer(a.location, a.components, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                                  offset);
+            break;
+        case AttribType::ShortNorm:
+            glVertexAttribPointer(a.location, a.components, GL_SHORT, GL_TRUE, stride, offset);
+            break;
+        case AttribType::UShortNorm:
+            glVertexAttribPointer(a.location, a.components, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                                  offset);
+            break;
+        case AttribType::Int2_10_10_10Norm:
+            glVertexAttribPointer(a.location, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, offset);
+            break;
+        case AttribType::UInt:
+            glVertexAttribIPointer(a.location, a.components, GL_UNSIGNED_INT, stride, offset);
+            break;
+        case AttribType::UShort:
+            glVertexAttribIPointer(a.location, a.components, GL_UNSIGNED_SHORT, stride, offset);
+            break;
+        }
+        glEnableVertexAttribArray(a.location);
+        glVertexAttribDivisor(a.location, divisor);
+    }
+}
+
+uint16_t toHalf(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+
+    // The common case, anything a normal half can hold, without branching on
+    // the rounding: rebias the exponent, then add just under half a half-ulp
+    // plus the kept lowest bit, so ties go to even, and let the carry ripple.
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x38800000 && magnitude <= 0x477FE000) {
+        uint32_t rounded = magnitude - (112u << 23) + 0xFFF + ((magnitude >> 13) & 1);
+        return sign | static_cast<uint16_t>(rounded >> 13);
+    }
+
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF)
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    // rebias from 127 to 15
+    int e = static_cast<int>(exponent) - 127 + 15;
+    if (e >= 31)
+        return sign | 0x7C00;
+    if (e <= 0) {
+        // subnormal half, or zero
+        if (e < -10)
+            return sign;
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - e);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1)))
+            half++;
+        return sign | static_cast<uint16_t>(half);
+    }
+    uint32_t half = (static_cast<uint32_t>(e) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    // a carry out of the mantissa moves the exponent up, which is right,
+    // including into infinity
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | static_cast<uint16_t>(half);
+}
+
+float fromHalf(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    float value;
+    if (exponent == 0)
+        value = std::ldexp(static_cast<float>(mantissa), -24);
+    else if (exponent == 31)
+        value = mantissa ? NAN : INFINITY;
+    else
+        value = std::ldexp(static_cast<float>(mantissa | 0x400), static_cast<int>(exponent) - 25);
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits |= sign;
+    std::memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+uint32_t packNormal(float x, float y, float z) {
+    auto snorm10 = [](float v) {
+        v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+        int32_t i = static_cast<int32_t>(std::lround(v * 511.0f));
+        return static_cast<uint32_t>(i) & 0x3FF;
+    };
+    return snorm10(x) | snorm10(y) << 10 | snorm10(z) << 20;
+}
@@ -0,0 +1,179 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Vertex layouts described once, next to the struct they describe.
+//
+// Instead of glVertexAttribPointer calls with offsets and sizes typed in by
+// hand, a vertex (or instance) struct gets a VertexLayout specialization
+// listing its attributes:
+//
+//   template <> struct VertexLayout<TargetInstance> {
+//       static constexpr VertexAttrib attribs[] = {
+//           VERTEX_ATTRIB(TargetInstance, x, 0, 4, AttribType::Float),
+//           VERTEX_ATTRIB(TargetInstance, color, 1, 4, AttribType::UByteNorm),
+//       };
+//   };
+//
+// and applyVertexLayout<TargetInstance>() makes every pointer, enable and
+// divisor call for the bound vertex array and buffer, with the struct's
+// size as the stride. The list is checked when it's compiled: an attribute
+// has to start on a field of the right type, fit inside the struct, be
+// aligned to its component size and not overlap another one, and locations
+// can't repeat. An attribute may run on over the fields after its first, as
+// x does above to take in y, z and radius.
+
+enum class AttribType : uint8_t {
+    // float
+    Float,
+    // uint16_t holding an IEEE half (see toHalf)
+    Half,
+    // uint8_t, 0..255 read as 0..1
+    UByteNorm,
+    // int16_t, -32767..32767 read as -1..1
+    ShortNorm,
+    // uint16_t, 0..65535 read as 0..1
+    UShortNorm,
+    // one uint32_t holding x, y, z in signed 10 bits each and w in 2 bits,
+    // all read as -1..1 (see packNormal); always 4 components
+    Int2_10_10_10Norm,
+    // uint32_t, read as an integer (uint in the shader)
+    UInt,
+    // uint16_t, read as an integer (uint in the shader), for bit fields
+    UShort
+};
+
+// the type of an attribute's first field, as far as the checks care
+enum class AttribField : uint8_t {
+    Float,
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Other
+};
+
+struct VertexAttrib {
+    uint32_t location;
+    uint32_t components;
+    AttribType type;
+    uint32_t offset;
+    AttribField field;
+};
+
+template <typename Field>
+constexpr AttribField attribField() {
+    using T = std::remove_cv_t<std::remove_all_extents_t<Field>>;
+    return std::is_same<T, float>::value ? AttribField::Float
+         : std::is_same<T, int8_t>::value ? AttribField::Int8
+         : std::is_same<T, uint8_t>::value ? AttribField::UInt8
+         : std::is_same<T, int16_t>::value ? AttribField::Int16
+         : std::is_same<T, uint16_t>::value ? AttribField::UInt16
+         : std::is_same<T, int32_t>::value ? AttribField::Int32
+         : std::is_same<T, uint32_t>::value ? AttribField::UInt32
+         : AttribField::Other;
+}
+
+// One attribute that starts at Type::member.
+#define VERTEX_ATTRIB(Type, member, location, components, type)                    \
+    VertexAttrib{location, components, type, offsetof(Type, member),              \
+                 attribField<decltype(Type::member)>()}
+
+// Specialized for each vertex struct; see the top of the file.
+template <typename Vertex>
+struct VertexLayout;
+
+// bytes the attribute reads
+constexpr uint32_t attribBytes(const VertexAttrib& a) {
+    switch (a.type) {
+    case AttribType::Float:
+    case AttribType::UInt:
+        return 4 * a.components;
+    case AttribType::Half:
+    case AttribType::ShortNorm:
+    case AttribType::UShortNorm:
+    case AttribType::UShort:
+        return 2 * a.components;
+    case AttribType::UByteNorm:
+        return a.components;
+    case AttribType::Int2_10_10_10Norm:
+        return 4;
+    }
+    return 0;
+}
+
+constexpr bool attribFieldMatches(const VertexAttrib& a) {
+    switch (a.type) {
+    case AttribType::Float:
+        return a.field == AttribField::Float;
+    case AttribType::Half:
+    case AttribType::UShortNorm:
+    case AttribType::UShort:
+        return a.field == AttribField::UInt16;
+    case AttribType::UByteNorm:
+        return a.field == AttribField::UInt8;
+    case AttribType::ShortNorm:
+        return a.field == AttribField::Int16;
+    case AttribType::Int2_10_10_10Norm:
+    case AttribType::UInt:
+        return a.field == AttribField::UInt32;
+    }
+    return false;
+}
+
+template <typename Vertex, std::size_t N>
+constexpr bool validVertexLayout(const VertexAttrib (&attribs)[N]) {
+    for (std::size_t i = 0; i < N; i++) {
+        const VertexAttrib& a = attribs[i];
+        if (a.components < 1 || a.components > 4)
+            return false;
+        if (a.type == AttribType::Int2_10_10_10Norm && a.components != 4)
+            return false;
+        uint32_t align =
+            a.type == AttribType::Int2_10_10_10Norm ? 4 : attribBytes(a) / a.components;
+        if (!attribFieldMatches(a) || a.offset % align != 0 ||
+            a.offset + attribBytes(a) > sizeof(Vertex))
+            return false;
+        for (std::size_t j = 0; j < i; j++) {
+            const VertexAttrib& b = attribs[j];
+            if (a.location == b.location)
+                return false;
+            if (a.offset < b.offset + attribBytes(b) && b.offset < a.offset + attribBytes(a))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Make the pointer, enable and divisor calls for the bound vertex array
+// and array buffer. Needs a current GL context.
+void applyVertexAttribs(const VertexAttrib* attribs, uint32_t count, uint32_t stride,
+                        uint32_t divisor);
+
+// Set up Vertex's layout on the bound vertex array and array buffer, as
+// per-vertex data (divisor 0) or per-instance (divisor 1).
+template <typename Vertex>
+void applyVertexLayout(uint32_t divisor = 0) {
+    constexpr const auto& attribs = VertexLayout<Vertex>::attribs;
+    static_assert(std::is_standard_layout<Vertex>::value,
+                  "offsetof needs a standard-layout vertex struct");
+    static_assert(validVertexLayout<Vertex>(attribs),
+                  "vertex layout doesn't match its struct");
+    applyVertexAttribs(attribs, sizeof(attribs) / sizeof(attribs[0]), sizeof(Vertex),
+                       divisor);
+}
+
+// Nearest IEEE half to f, rounding to even; out of range values become
+// infinity and NaN stays NaN.
+uint16_t toHalf(float f);
+float fromHalf(uint16_t h);
+
+// A unit vector (or anything in -1..1) as Int2_10_10_10Norm, with w = 0.
+uint32_t packNormal(float x, float y, float z);
+
+#endif
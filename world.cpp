@@ -0,0 +1,245 @@
+#include "world.h"
+
+#include <cstdlib>
+
+namespace {
+
+struct ComponentInfo {
+    std::size_t size;
+    std::size_t alignment;
+};
+
+// Filled in before main by WORLD_COMPONENT; a size of 0 means the id is free.
+ComponentInfo componentInfo[MAX_COMPONENT_TYPES];
+
+}
+
+bool detail::registerComponent(uint32_t id, std::size_t size, std::size_t alignment) {
+    // an id out of range or given to two types is a programming error, not a
+    // runtime one
+    if (id >= MAX_COMPONENT_TYPES || componentInfo[id].size != 0)
+        std::abort();
+    componentInfo[id] = ComponentInfo{size, alignment};
+    return true;
+}
+
+std::size_t detail::componentSize(uint32_t id) {
+    return componentInfo[id].size;
+}
+
+std::size_t detail::componentAlignment(uint32_t id) {
+    return componentInfo[id].alignment;
+}
+
+World::World(uint32_t maxEntities)
+    : maxEntities(maxEntities),
+      records(static_cast<EntityRecord*>(std::malloc(sizeof(EntityRecord) * maxEntities))),
+      highWater(0), freeHead(0), liveCount(0), archetypeCount(0) {
+    for (uint32_t i = 0; i < maxEntities; i++)
+        records[i] = EntityRecord{0, 0, 0, i + 1, false};
+}
+
+World::~World() {
+    for (uint32_t i = 0; i < archetypeCount; i++) {
+        for (unsigned char* column : archetypes[i].columns)
+            std::free(column);
+        std::free(archetypes[i].handles);
+    }
+    std::free(records);
+}
+
+Archetype* World::archetypeFor(ComponentMask mask) {
+    for (uint32_t i = 0; i < archetypeCount; i++) {
+        if (archetypes[i].mask == mask)
+            return &archetypes[i];
+    }
+    if (archetypeCount == MAX_ARCHETYPES)
+        return nullptr;
+
+    // First time we've seen this set of components: give it a table big
+    // enough to hold every entity so it never has to grow.
+    Archetype& a = archetypes[archetypeCount];
+    a.mask = mask;
+    a.count = 0;
+    a.capacity = maxEntities;
+    for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++) {
+        if (!(mask & (1u << id)))
+            continue;
+        std::size_t align = detail::componentAlignment(id);
+        if (align < alignof(std::max_align_t))
+            align = alignof(std::max_align_t);
+        std::size_t bytes = detail::componentSize(id) * maxEntities;
+        bytes = (bytes + align - 1) / align * align;
+        a.columns[id] = static_cast<unsigned char*>(std::aligned_alloc(align, bytes ? bytes : align));
+    }
+    a.handles = static_cast<Handle*>(std::malloc(sizeof(Handle) * maxEntities));
+    archetypeCount++;
+    return &a;
+}
+
+Handle World::allocateEntity(Archetype* a) {
+    if (freeHead >= maxEntities || a->count >= a->capacity)
+        return Handle{};
+
+    uint32_t index = freeHead;
+    EntityRecord& r = records[index];
+    freeHead = r.nextFree;
+
+    if (index >= highWater)
+        highWater = index + 1;
+
+    r.archetype = static_cast<uint32_t>(a - archetypes);
+    r.row = a->count++;
+    r.alive = true;
+    liveCount++;
+
+    Handle h{index, r.generation};
+    a->handles[r.row] = h;
+    return h;
+}
+
+bool World::alive(Handle h) const {
+    return h.index < maxEntities && records[h.index].alive &&
+           records[h.index].generation == h.generation;
+}
+
+bool World::destroy(Handle h) {
+    if (!alive(h))
+        return false;
+
+    EntityRecord& r = records[h.index];
+    Archetype& a = archetypes[r.archetype];
+
+    // swap the last row into the hole to keep the columns dense
+    uint32_t last = a.count - 1;
+    if (r.row != last) {
+        for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++) {
+            if (!a.columns[id])
+                continue;
+            std::size_t size = detail::componentSize(id);
+            std::memcpy(a.columns[id] + r.row * size, a.columns[id] + last * size, size);
+        }
+        Handle moved = a.handles[last];
+        a.handles[r.row] = moved;
+        records[moved.index].row = r.row;
+    }
+    a.count--;
+
+    r.alive = false;
+    r.generation++;
+    r.nextFree = freeHead;
+    freeHead = h.index;
+    liveCount--;
+    return true;
+}
+
+void World::clear() {
+    for (uint32_t i = 0; i < archetypeCount; i++) {
+        Archetype& a = archetypes[i];
+        while (a.count > 0)
+            destroy(a.handles[a.count - 1]);
+    }
+}
+
+void World::reset() {
+    for (uint32_t i = 0; i < archetypeCount; i++)
+        archetypes[i].count = 0;
+    for (uint32_t i = 0; i < highWater; i++)
+        records[i] = EntityRecord{0, 0, 0, i + 1, false};
+    highWater = 0;
+    freeHead = 0;
+    liveCount = 0;
+}
+
+void World::save(ByteWriter& out) const {
+    out.put(maxEntities);
+    out.put(highWater);
+    out.put(freeHead);
+    out.put(liveCount);
+    for (uint32_t i = 0; i < highWater; i++) {
+        out.put(records[i].generation);
+        out.put(records[i].nextFree);
+        out.put(static_cast<uint8_t>(records[i].alive));
+    }
+
+    uint32_t tables = 0;
+    for (uint32_t i = 0; i < archetypeCount; i++)
+        tables += archetypes[i].count > 0;
+    out.put(tables);
+
+    for (uint32_t i = 0; i < archetypeCount; i++) {
+        const Archetype& a = archetypes[i];
+        if (a.count == 0)
+            continue;
+        out.put(a.mask);
+        out.put(a.count);
+        out.write(a.handles, sizeof(Handle) * a.count);
+        for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++) {
+            if (!a.columns[id])
+                continue;
+            uint32_t size = static_cast<uint32_t>(detail::componentSize(id));
+            out.put(size);
+            out.write(a.columns[id], size * a.count);
+        }
+    }
+}
+
+bool World::load(ByteReader& in) {
+    for (uint32_t i = 0; i < archetypeCount; i++)
+        archetypes[i].count = 0;
+
+    uint32_t savedMax = in.get<uint32_t>();
+    uint32_t savedHighWater = in.get<uint32_t>();
+    uint32_t savedFreeHead = in.get<uint32_t>();
+    uint32_t savedLive = in.get<uint32_t>();
+    if (in.failed || savedMax != maxEntities || savedHighWater > maxEntities)
+        return false;
+
+    for (uint32_t i = 0; i < savedHighWater; i++) {
+        records[i].generation = in.get<uint32_t>();
+        records[i].nextFree = in.get<uint32_t>();
+        records[i].alive = in.get<uint8_t>() != 0;
+        records[i].archetype = 0;
+        records[i].row = 0;
+    }
+    // slots past the high water mark look exactly like a fresh world
+    for (uint32_t i = savedHighWater; i < maxEntities; i++)
+        records[i] = EntityRecord{0, 0, 0, i + 1, false};
+    highWater = savedHighWater;
+    freeHead = savedFreeHead;
+    liveCount = savedLive;
+
+    uint32_t tables = in.get<uint32_t>();
+    for (uint32_t t = 0; t < tables && !in.failed; t++) {
+        ComponentMask mask = in.get<ComponentMask>();
+        uint32_t count = in.get<uint32_t>();
+        for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++) {
+            if ((mask & (1u << id)) && detail::componentSize(id) == 0)
+                return false;
+        }
+        Archetype* a = archetypeFor(mask);
+        if (!a || count > a->capacity)
+            return false;
+
+        in.read(a->handles, sizeof(Handle) * count);
+        for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; id++) {
+            if (!a->columns[id])
+                continue;
+            uint32_t size = in.get<uint32_t>();
+            if (size != detail::componentSize(id))
+                return false;
+            in.read(a->columns[id], size * count);
+        }
+        a->count = count;
+
+        uint32_t archetypeIndex = static_cast<uint32_t>(a - archetypes);
+        for (uint32_t row = 0; row < count; row++) {
+            Handle h = a->handles[row];
+            if (h.index >= highWater)
+                return false;
+            records[h.index].archetype = archetypeIndex;
+            records[h.index].row = row;
+        }
+    }
+    return !in.failed;
+}
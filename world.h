@@ -0,0 +1,196 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "bytes.h"
+#include "pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+// Archetype-based entity store.
+//
+// An entity is just a Handle (index + generation, same as the pools). Its
+// components are stored in an archetype table: one table per distinct set of
+// component types, with one contiguous column per component. Iterating
+// everything that has, say, Position and Velocity walks those columns in
+// order, which is about as cache-friendly as it gets.
+//
+// All entity bookkeeping is sized up front. A table's columns are allocated
+// the first time that combination of components is created, so after
+// warm-up nothing allocates.
+//
+// Components must be trivially copyable: rows are moved around with memcpy
+// when entities are destroyed.
+
+constexpr uint32_t MAX_COMPONENT_TYPES = 32;
+constexpr uint32_t MAX_ARCHETYPES = 64;
+
+using ComponentMask = uint32_t;
+
+namespace detail {
+bool registerComponent(uint32_t id, std::size_t size, std::size_t alignment);
+std::size_t componentSize(uint32_t id);
+std::size_t componentAlignment(uint32_t id);
+}
+
+// Every component type has a fixed id, given next to the type with
+// WORLD_COMPONENT(Type, id). Masks and columns are indexed by it, and
+// snapshots store them as they are, so an id must never be reused or
+// changed once snapshots with it exist. Registration happens before main,
+// so a fresh process can load a snapshot before it has touched any of the
+// types.
+template <typename T>
+struct ComponentType;
+
+#define WORLD_COMPONENT(T, ID)                                                  \
+    template <>                                                                 \
+    struct ComponentType<T> {                                                   \
+        static constexpr uint32_t id = ID;                                      \
+    };                                                                          \
+    inline const bool T##ComponentRegistered =                                  \
+        detail::registerComponent(ID, sizeof(T), alignof(T))
+
+template <typename T>
+constexpr uint32_t componentId() {
+    return ComponentType<T>::id;
+}
+
+template <typename... Ts>
+ComponentMask componentMask() {
+    return (0u | ... | (1u << componentId<Ts>()));
+}
+
+struct Archetype {
+    ComponentMask mask = 0;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    // rows of each component, indexed by component id; null if the
+    // archetype doesn't have that component
+    unsigned char* columns[MAX_COMPONENT_TYPES] = {};
+    // handle of the entity in each row
+    Handle* handles = nullptr;
+
+    template <typename T>
+    T* column() {
+        return reinterpret_cast<T*>(columns[componentId<T>()]);
+    }
+};
+
+class World {
+public:
+    explicit World(uint32_t maxEntities);
+    ~World();
+
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    // Create an entity with the given components. Returns an invalid handle
+    // if the world is full.
+    template <typename... Ts>
+    Handle create(const Ts&... components) {
+        Archetype* a = archetypeFor(componentMask<Ts...>());
+        if (!a)
+            return Handle{};
+        Handle h = allocateEntity(a);
+        if (!h.valid())
+            return h;
+        uint32_t row = records[h.index].row;
+        (std::memcpy(a->column<Ts>() + row, &components, sizeof(Ts)), ...);
+        return h;
+    }
+
+    // Remove the entity. The last row of its table is moved into the hole,
+    // so don't destroy entities while iterating that table; collect the
+    // handles and destroy them afterwards.
+    bool destroy(Handle h);
+
+    bool alive(Handle h) const;
+
+    // Remove every entity, keeping the tables' memory.
+    void clear();
+
+    // Like clear(), but also put the entity table back exactly as it was
+    // when the world was constructed, so the same sequence of creates hands
+    // out the same handles. Handles from before the reset may become valid
+    // again, so only use this when starting over completely.
+    void reset();
+
+    template <typename T>
+    T* get(Handle h) {
+        if (!alive(h))
+            return nullptr;
+        const EntityRecord& r = records[h.index];
+        Archetype& a = archetypes[r.archetype];
+        if (!(a.mask & (1u << componentId<T>())))
+            return nullptr;
+        return a.column<T>() + r.row;
+    }
+
+    // Call f(count, handles, columns...) once per table that has all of Ts.
+    // The columns are plain arrays of `count` components, so f can loop over
+    // them directly (or hand them to the job system).
+    template <typename... Ts, typename F>
+    void query(F&& f) {
+        ComponentMask mask = componentMask<Ts...>();
+        for (uint32_t i = 0; i < archetypeCount; i++) {
+            Archetype& a = archetypes[i];
+            if ((a.mask & mask) == mask && a.count > 0)
+                f(a.count, static_cast<const Handle*>(a.handles), a.column<Ts>()...);
+        }
+    }
+
+    // Per-entity version of query: f(handle, components&...).
+    template <typename... Ts, typename F>
+    void each(F&& f) {
+        query<Ts...>([&](uint32_t count, const Handle* handles, Ts*... columns) {
+            for (uint32_t row = 0; row < count; row++)
+                f(handles[row], columns[row]...);
+        });
+    }
+
+    // Number of entities that have all of Ts.
+    template <typename... Ts>
+    uint32_t count() {
+        uint32_t total = 0;
+        query<Ts...>([&](uint32_t n, const Handle*, Ts*...) { total += n; });
+        return total;
+    }
+
+    uint32_t size() const { return liveCount; }
+    uint32_t capacity() const { return maxEntities; }
+
+    // Write the complete state of the world (including the free list, so
+    // entities created after a load get the same handles they would have
+    // originally) and read it back. Only the part of the entity table that
+    // has ever been used is stored. load() fails if the data came from a
+    // world with a different capacity, or uses a component id that isn't
+    // registered or has a different size here.
+    void save(ByteWriter& out) const;
+    bool load(ByteReader& in);
+
+private:
+    struct EntityRecord {
+        uint32_t generation;
+        uint32_t archetype;
+        uint32_t row;
+        uint32_t nextFree;
+        bool alive;
+    };
+
+    Archetype* archetypeFor(ComponentMask mask);
+    Handle allocateEntity(Archetype* a);
+
+    uint32_t maxEntities;
+    EntityRecord* records;
+    // entity slots at or past this index have never been used
+    uint32_t highWater;
+    uint32_t freeHead;
+    uint32_t liveCount;
+
+    Archetype archetypes[MAX_ARCHETYPES];
+    uint32_t archetypeCount;
+};
+
+#endif